@@ -34,8 +34,8 @@ Core::AstNodeList AstNode::childrenNodes() const
 {
     QList<AstNode> children;
     if (auto n = node()) {
-        const auto childNodes = n->children();
-        for (const auto &node : childNodes) {
+        children.reserve(n->childCount());
+        for (const auto &node : n->childRange()) {
             children.append(AstNode(node, document()));
         }
     }
@@ -72,7 +72,13 @@ QString AstNode::type() const
 
 QString AstNode::text() const
 {
-    return m_mark.text();
+    // Slice the text snapshot shared with the syntax tree, instead of copying the whole document.
+    if (auto doc = document(); doc && isValid()) {
+        const auto &source = doc->m_treeSitterHelper->text();
+        if (endPos() <= source.size())
+            return source.sliced(startPos(), endPos() - startPos());
+    }
+    return {};
 }
 
 int AstNode::startPos() const
@@ -30,18 +30,20 @@ ClassSymbol::ClassSymbol(QObject *parent, const QueryMatch &match, Kind kind)
 {
 }
 
-QList<Symbol *> ClassSymbol::findMembers() const
+// Members are all the symbols nested in the class, in document order.
+void ClassSymbol::appendMembers(const Symbol *symbol, QList<Symbol *> &members)
 {
-    if (auto codeDocument = qobject_cast<Core::CodeDocument *>(parent())) {
-        QList<Symbol *> members;
-        for (auto &symbol : codeDocument->symbols()) {
-            if (m_range.contains(symbol->range()) && m_name != symbol->name())
-                members.append(symbol);
-        }
-        return members;
+    for (auto *child : symbol->m_children) {
+        members.append(child);
+        appendMembers(child, members);
     }
-    spdlog::warn("{}: Parent of CppClass {} is not an CodeDocument!", FUNCTION_NAME, m_name);
-    return {};
+}
+
+QList<Symbol *> ClassSymbol::findMembers() const
+{
+    QList<Symbol *> members;
+    appendMembers(this, members);
+    return members;
 }
 
 const QList<Symbol *> &ClassSymbol::members() const
@@ -52,6 +54,13 @@ const QList<Symbol *> &ClassSymbol::members() const
     return *m_members;
 }
 
+void ClassSymbol::resetContext()
+{
+    Symbol::resetContext();
+    // The members are the nested symbols, they may have changed.
+    m_members.reset();
+}
+
 QString ClassSymbol::description() const
 {
     return "Class with " + QString::number(members().size()) + " members";
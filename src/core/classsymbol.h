@@ -24,6 +24,7 @@ class ClassSymbol : public Symbol
     Q_PROPERTY(QList<Symbol *> members READ members CONSTANT)
 
     QList<Symbol *> findMembers() const;
+    static void appendMembers(const Symbol *symbol, QList<Symbol *> &members);
 
 protected:
     friend class Symbol;
@@ -32,6 +33,8 @@ protected:
     // mutable for lazy initialization
     mutable std::optional<QList<Symbol *>> m_members;
 
+    void resetContext() override;
+
 public:
     const QList<Symbol *> &members() const;
     QString description() const override;
@@ -14,6 +14,7 @@
 #include "logger.h"
 #include "lsp_utils.h"
 #include "project.h"
+#include "querycache.h"
 #include "querymatch.h"
 #include "rangemark.h"
 #include "symbol.h"
@@ -569,21 +570,40 @@ Symbol *CodeDocument::findSymbol(const QString &name, int options) const
 {
     LOG(LOG_ARG("text", name), options);
 
-    auto symbols = this->symbols();
-    const auto regexp =
-        (options & FindRegexp) ? ::Utils::createRegularExpression(name, options) : QRegularExpression {};
-    auto byName = [name, options, regexp](Symbol *symbol) {
-        if (options & FindWholeWords)
-            return symbol->name().compare(name,
-                                          (options & FindCaseSensitively) ? Qt::CaseSensitive : Qt::CaseInsensitive)
-                == 0;
-        else if (options & FindRegexp)
-            return regexp.match(symbol->name()).hasMatch();
-        else
-            return symbol->name().endsWith(name,
-                                           (options & FindCaseSensitively) ? Qt::CaseSensitive : Qt::CaseInsensitive);
-    };
-    auto it = std::ranges::find_if(symbols, byName);
+    return lookupSymbol(name, options);
+}
+
+/*!
+ * \qmlmethod array<Symbol> CodeDocument::findSymbols(array<string> names, int options = TextDocument.NoFindFlags)
+ * Finds the symbols for all `names`, using the same find `options` as `findSymbol`.
+ *
+ * The returned array has the same size as `names`, with a `null` symbol for each name not found. This is faster than
+ * calling `findSymbol` in a loop.
+ */
+Core::SymbolList CodeDocument::findSymbols(const QStringList &names, int options) const
+{
+    LOG(names, options);
+
+    Core::SymbolList symbols;
+    symbols.reserve(names.size());
+    for (const auto &name : names)
+        symbols.push_back(lookupSymbol(name, options));
+    return symbols;
+}
+
+Symbol *CodeDocument::lookupSymbol(const QString &name, int options) const
+{
+    const auto caseSensitivity = (options & FindCaseSensitively) ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    if (options & FindWholeWords)
+        return m_treeSitterHelper->symbolIndex().find(name, true, caseSensitivity);
+    if (!(options & FindRegexp))
+        return m_treeSitterHelper->symbolIndex().find(name, false, caseSensitivity);
+
+    const auto regexp = ::Utils::createRegularExpression(name, options);
+    const auto &symbols = m_treeSitterHelper->symbols();
+    auto it = std::ranges::find_if(symbols, [&regexp](Symbol *symbol) {
+        return regexp.match(symbol->name()).hasMatch();
+    });
     if (it != symbols.end())
         return *it;
     return nullptr;
@@ -614,6 +634,43 @@ void CodeDocument::didClose()
     m_lspClient->didClose(std::move(params));
 }
 
+void CodeDocument::setPreloadedTree(const QString &fileName, PreloadedTree tree)
+{
+    m_preloadedTree.emplace(fileName, std::move(tree));
+}
+
+bool CodeDocument::doLoad(const QString &fileName)
+{
+    auto preloadedTree = std::move(m_preloadedTree);
+    m_preloadedTree.reset();
+    if (!TextDocument::doLoad(fileName))
+        return false;
+    if (!preloadedTree || preloadedTree->first != fileName)
+        return true;
+
+    // The text of the document may differ from the text of the file (non-breaking spaces, line endings...).
+    auto &[text, ranges, tree] = preloadedTree->second;
+    auto sameRange = [](const treesitter::Range &left, const treesitter::Range &right) {
+        return left.start_byte == right.start_byte && left.end_byte == right.end_byte;
+    };
+    if (textEdit()->toPlainText() == text && std::ranges::equal(ranges, includedRanges(), sameRange))
+        m_treeSitterHelper->setSyntaxTree(std::move(text), std::move(tree));
+    return true;
+}
+
+void CodeDocument::doUnload()
+{
+    TextDocument::doUnload();
+    m_treeSitterHelper->unload();
+}
+
+qint64 CodeDocument::memoryUsage() const
+{
+    if (!isLoaded())
+        return 0;
+    return TextDocument::memoryUsage() + m_treeSitterHelper->memoryUsage();
+}
+
 Lsp::Client *CodeDocument::client() const
 {
     return m_lspClient;
@@ -629,7 +686,8 @@ std::unique_ptr<TreeSitterHelper> &CodeDocument::helper()
     return m_treeSitterHelper;
 }
 
-std::optional<treesitter::QueryCursor> CodeDocument::createQueryCursor(const std::shared_ptr<treesitter::Query> &query)
+std::optional<treesitter::QueryCursor> CodeDocument::createQueryCursor(const std::shared_ptr<treesitter::Query> &query,
+                                                                       const treesitter::Query::Parameters &parameters)
 {
     const auto &tree = m_treeSitterHelper->syntaxTree();
     if (!tree || !query) {
@@ -638,13 +696,19 @@ std::optional<treesitter::QueryCursor> CodeDocument::createQueryCursor(const std
 
     treesitter::QueryCursor cursor;
     cursor.setProgressCallback(ScriptDialogItem::updateProgress);
-    cursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(text()));
+    if (const auto &range = m_treeSitterHelper->queryRange()) {
+        cursor.setByteRange(range->start * sizeof(QChar), range->end * sizeof(QChar));
+    }
+    cursor.execute(query, tree->rootNode(),
+                   std::make_unique<treesitter::Predicates>(m_treeSitterHelper->text(), parameters,
+                                                            m_treeSitterHelper->predicateCaches()));
     return cursor;
 }
 
-Core::QueryMatch CodeDocument::queryFirst(const std::shared_ptr<treesitter::Query> &query)
+Core::QueryMatch CodeDocument::queryFirst(const std::shared_ptr<treesitter::Query> &query,
+                                          const treesitter::Query::Parameters &parameters /* = {} */)
 {
-    auto cursor = createQueryCursor(query);
+    auto cursor = createQueryCursor(query, parameters);
     if (!cursor.has_value()) {
         return {};
     }
@@ -657,18 +721,34 @@ Core::QueryMatch CodeDocument::queryFirst(const std::shared_ptr<treesitter::Quer
     }
 }
 
-Core::QueryMatchList CodeDocument::query(const std::shared_ptr<treesitter::Query> &query)
+Core::QueryMatchList CodeDocument::query(const std::shared_ptr<treesitter::Query> &query,
+                                         const treesitter::Query::Parameters &parameters /* = {} */)
 {
-    auto cursor = createQueryCursor(query);
+    // With the query cache, results for an unchanged document are restored without parsing it.
+    // Queries restricted to a range while updating the symbols don't return all results, they are not cached.
+    auto *cache = query && !m_treeSitterHelper->queryRange() ? Project::instance()->queryCache() : nullptr;
+    QByteArray queryKey;
+    if (cache) {
+        queryKey = QueryCache::queryKey(*query, parameters);
+        if (auto cached = cache->find(*this, m_treeSitterHelper->contentKey(), queryKey)) {
+            return *cached;
+        }
+    }
+
+    auto cursor = createQueryCursor(query, parameters);
     if (!cursor.has_value()) {
         return {};
     }
 
     auto matches = cursor->allRemainingMatches();
 
-    return kdalgorithms::transformed<Core::QueryMatchList>(matches, [this](const treesitter::QueryMatch &match) {
+    auto result = kdalgorithms::transformed<Core::QueryMatchList>(matches, [this](const treesitter::QueryMatch &match) {
         return QueryMatch(*this, match);
     });
+    if (cache) {
+        cache->insert(*this, m_treeSitterHelper->contentKey(), queryKey, result);
+    }
+    return result;
 }
 
 /*!
@@ -718,6 +798,84 @@ Core::QueryMatchList CodeDocument::queryInRange(const Core::RangeMark &range, co
 {
     LOG(LOG_ARG("range", range), LOG_ARG("query", query));
 
+    return queryInRange(range, m_treeSitterHelper->constructQuery(query));
+}
+
+/*!
+ * \qmlmethod array<RangeMark> CodeDocument::queryCaptures(string query, string name)
+ * Runs the given Tree-sitter `query` and returns the ranges of all captures with the given `name`, in document order.
+ *
+ * This is faster than `query` when only one capture is needed, as the matches are not created.
+ *
+ * ```javascript
+ * let names = document.queryCaptures("(call_expression function: (identifier) @name)", "name");
+ * ```
+ *
+ * \sa CodeDocument::query
+ */
+Core::RangeMarkList CodeDocument::queryCaptures(const QString &query, const QString &name)
+{
+    LOG(LOG_ARG("query", query), LOG_ARG("name", name));
+
+    return queryCaptures(m_treeSitterHelper->constructQuery(query), name);
+}
+
+/*!
+ * \qmlmethod object CodeDocument::profileQuery(string query)
+ * Runs the given Tree-sitter `query` on the whole document and returns statistics about its execution, to find which
+ * pattern or predicate makes a query slow. The returned object contains:
+ *
+ * - `matches`: the number of matches, same as `query(query).length`
+ * - `totalTime`: the time spent running the query, in milliseconds
+ * - `patterns`: for each pattern of the query:
+ *   - `candidates`: the number of matches found before running the predicates
+ *   - `rejections`: the number of candidates discarded by the predicates
+ *   - `predicates`: for each predicate of the pattern, its `name`, the number of `calls` and `rejections`, and the
+ *   `time` spent in it, in milliseconds
+ *
+ * The query is always executed, the query cache is not used.
+ */
+QVariantMap CodeDocument::profileQuery(const QString &query)
+{
+    LOG(LOG_ARG("query", query));
+
+    const auto tsQuery = m_treeSitterHelper->constructQuery(query);
+    const auto &tree = m_treeSitterHelper->syntaxTree();
+    if (!tree || !tsQuery) {
+        return {};
+    }
+
+    treesitter::QueryCursor cursor;
+    cursor.setProfilingEnabled(true);
+    cursor.execute(tsQuery, tree->rootNode(), std::make_unique<treesitter::Predicates>(m_treeSitterHelper->text()));
+    const auto matches = cursor.allRemainingMatches();
+    const auto &profile = cursor.profile();
+
+    auto toMsecs = [](qint64 nsecs) {
+        return nsecs / 1'000'000.0;
+    };
+
+    QVariantList patterns;
+    for (const auto &pattern : profile->patterns) {
+        QVariantList predicates;
+        for (const auto &predicate : pattern.predicates) {
+            predicates.push_back(QVariantMap {{"name", predicate.name},
+                                              {"calls", predicate.calls},
+                                              {"rejections", predicate.rejections},
+                                              {"time", toMsecs(predicate.nsecs)}});
+        }
+        patterns.push_back(QVariantMap {{"candidates", pattern.candidates},
+                                        {"rejections", pattern.rejections},
+                                        {"predicates", predicates}});
+    }
+
+    return {{"matches", matches.size()}, {"totalTime", toMsecs(profile->totalNsecs)}, {"patterns", patterns}};
+}
+
+Core::QueryMatchList CodeDocument::queryInRange(const Core::RangeMark &range,
+                                                const std::shared_ptr<treesitter::Query> &query,
+                                                const treesitter::Query::Parameters &parameters /* = {} */)
+{
     if (!range.isValid()) {
         spdlog::warn("{}: Range is not valid", FUNCTION_NAME);
         return {};
@@ -731,14 +889,16 @@ Core::QueryMatchList CodeDocument::queryInRange(const Core::RangeMark &range, co
     }
     spdlog::debug("{}: Found {} nodes in range", FUNCTION_NAME, nodes.size());
 
-    auto tsQuery = m_treeSitterHelper->constructQuery(query);
-    if (!tsQuery)
+    if (!query)
         return {};
 
+    const auto &source = m_treeSitterHelper->text();
     treesitter::QueryCursor cursor;
     Core::QueryMatchList matches;
     for (const treesitter::Node &node : nodes) {
-        cursor.execute(tsQuery, node, std::make_unique<treesitter::Predicates>(text()));
+        cursor.execute(query, node,
+                       std::make_unique<treesitter::Predicates>(source, parameters,
+                                                                m_treeSitterHelper->predicateCaches()));
         matches.append(kdalgorithms::transformed<QList<QueryMatch>>(cursor.allRemainingMatches(),
                                                                     [this](const treesitter::QueryMatch &match) {
                                                                         return QueryMatch(*this, match);
@@ -747,6 +907,33 @@ Core::QueryMatchList CodeDocument::queryInRange(const Core::RangeMark &range, co
     return matches;
 }
 
+Core::RangeMarkList CodeDocument::queryCaptures(const std::shared_ptr<treesitter::Query> &query, const QString &name,
+                                                const treesitter::Query::Parameters &parameters /* = {} */)
+{
+    if (!query) {
+        return {};
+    }
+
+    const auto captures = query->captures();
+    const auto capture = kdalgorithms::find_if(captures, [&name](const treesitter::Query::Capture &capture) {
+        return capture.name == name;
+    });
+    if (!capture) {
+        spdlog::warn("{}: No capture named {} in the query", FUNCTION_NAME, name);
+        return {};
+    }
+
+    auto cursor = createQueryCursor(query, parameters);
+    if (!cursor.has_value()) {
+        return {};
+    }
+
+    return kdalgorithms::transformed<Core::RangeMarkList>(
+        cursor->allRemainingCaptures(capture->id), [this](const treesitter::QueryMatch::Capture &capture) {
+            return createRangeMark(capture.node.startPosition(), capture.node.endPosition());
+        });
+}
+
 int CodeDocument::revision() const
 {
     return m_revision;
@@ -826,8 +1013,7 @@ void CodeDocument::changeContentTreeSitter(int position, int charsRemoved, int c
 
     // Note: This invalidates all existing treesitter::Node instances of this tree!
     // Only use treesitter nodes as long as you're certain the document isn't edited!
-    // TODO: If we keep the old string around, we could implement incremental parsing here.
-    // If TreeSitter parsing ever becomes a performance bottleneck, this would be where to fix it.
+    // The helper keeps the previous tree, the next parse is incremental.
     m_treeSitterHelper->clear();
 }
 
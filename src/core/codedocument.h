@@ -17,9 +17,13 @@
 #include "textdocument.h"
 #include "treesitter/parser.h"
 #include "treesitter/query.h"
+#include "treesitter/tree.h"
 
+#include <QVariantMap>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <utility>
 
 namespace Lsp {
 class Client;
@@ -47,6 +51,7 @@ public:
     void setLspClient(Lsp::Client *client);
 
     Q_INVOKABLE Core::Symbol *findSymbol(const QString &name, int options = NoFindFlags) const;
+    Q_INVOKABLE Core::SymbolList findSymbols(const QStringList &names, int options = NoFindFlags) const;
     Q_INVOKABLE Core::SymbolList symbols() const;
     Q_INVOKABLE QString hover() const;
     Q_INVOKABLE const Core::Symbol *symbolUnderCursor() const;
@@ -54,17 +59,41 @@ public:
     Q_INVOKABLE Core::QueryMatchList query(const QString &query);
     Q_INVOKABLE Core::QueryMatch queryFirst(const QString &query);
     Q_INVOKABLE Core::QueryMatchList queryInRange(const Core::RangeMark &range, const QString &query);
+    Q_INVOKABLE Core::RangeMarkList queryCaptures(const QString &query, const QString &name);
+    Q_INVOKABLE QVariantMap profileQuery(const QString &query);
 
     // This overload exists for improved performance. It's not user-facing API.
     //
     // It turns out that constructing Query instances is relatively expensive.
     // Therefore it's better to construct them once and reuse them.
     // So allow this for outside users.
-    QList<Core::QueryMatch> query(const std::shared_ptr<treesitter::Query> &query);
-    Core::QueryMatch queryFirst(const std::shared_ptr<treesitter::Query> &query);
+    //
+    // Queries may contain parameters (e.g. `(#eq? @name "$className")`), whose values are given by `parameters`.
+    // That way, the same query can be reused for different names.
+    QList<Core::QueryMatch> query(const std::shared_ptr<treesitter::Query> &query,
+                                  const treesitter::Query::Parameters &parameters = {});
+    Core::QueryMatch queryFirst(const std::shared_ptr<treesitter::Query> &query,
+                                const treesitter::Query::Parameters &parameters = {});
+    QList<Core::QueryMatch> queryInRange(const Core::RangeMark &range, const std::shared_ptr<treesitter::Query> &query,
+                                         const treesitter::Query::Parameters &parameters = {});
+    Core::RangeMarkList queryCaptures(const std::shared_ptr<treesitter::Query> &query, const QString &name,
+                                      const treesitter::Query::Parameters &parameters = {});
 
     bool hasLspClient() const;
 
+    qint64 memoryUsage() const override;
+
+    // Syntax tree parsed in the background from the text of a file, see Project::preload.
+    struct PreloadedTree
+    {
+        QString text;
+        QList<treesitter::Range> includedRanges;
+        treesitter::Tree tree;
+    };
+    // Used instead of parsing if `fileName` is loaded next, and the document text and included ranges are the ones the
+    // tree was parsed from.
+    void setPreloadedTree(const QString &fileName, PreloadedTree tree);
+
     Symbol *currentSymbol(const std::function<bool(const Symbol &)> &filterFunc) const;
     void deleteSymbol(const Symbol &symbol);
 
@@ -92,8 +121,10 @@ public slots:
 protected:
     explicit CodeDocument(Type type, QObject *parent = nullptr);
 
+    bool doLoad(const QString &fileName) override;
     void didOpen() override;
     void didClose() override;
+    void doUnload() override;
 
     Lsp::Client *client() const;
     std::string toUri() const;
@@ -109,8 +140,11 @@ protected:
 private:
     bool checkClient() const;
     Document *followSymbol(int pos);
+    // findSymbol without logging, also used by findSymbols.
+    Symbol *lookupSymbol(const QString &name, int options) const;
 
-    std::optional<treesitter::QueryCursor> createQueryCursor(const std::shared_ptr<treesitter::Query> &query);
+    std::optional<treesitter::QueryCursor> createQueryCursor(const std::shared_ptr<treesitter::Query> &query,
+                                                             const treesitter::Query::Parameters &parameters);
 
     void changeContent(int position, int charsRemoved, int charsAdded);
     void changeContentLsp(int position, int charsRemoved, int charsAdded);
@@ -123,6 +157,7 @@ private:
     // TreeSitter
     friend TreeSitterHelper;
     std::unique_ptr<TreeSitterHelper> m_treeSitterHelper;
+    std::optional<std::pair<QString, PreloadedTree>> m_preloadedTree;
 
     friend class AstNode;
 };
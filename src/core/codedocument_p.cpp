@@ -10,14 +10,111 @@
 
 #include "codedocument_p.h"
 #include "codedocument.h"
+#include "querycache.h"
 #include "treesitter/languages.h"
 #include "treesitter/tree_cursor.h"
 #include "utils/log.h"
 
+#include <algorithm>
+#include <bit>
 #include <kdalgorithms.h>
 
 namespace Core {
 
+///////////////////////////////////////////////////////////////////////////////
+// SymbolIndex
+///////////////////////////////////////////////////////////////////////////////
+static QString reversed(QString text)
+{
+    std::ranges::reverse(text);
+    return text;
+}
+
+SymbolIndex::SymbolIndex(const QList<Core::Symbol *> &symbols)
+    : m_symbols(symbols)
+{
+    QList<QString> names;
+    QList<QString> foldedNames;
+    names.reserve(symbols.size());
+    foldedNames.reserve(symbols.size());
+    for (const auto *symbol : symbols) {
+        names.push_back(symbol->name());
+        foldedNames.push_back(symbol->name().toCaseFolded());
+    }
+
+    // Iterate backward, so the first symbol with a given name is the one kept.
+    for (auto index = symbols.size() - 1; index >= 0; --index) {
+        m_names.insert(names.at(index), index);
+        m_foldedNames.insert(foldedNames.at(index), index);
+    }
+    m_suffixes = buildSuffixes(names);
+    m_foldedSuffixes = buildSuffixes(foldedNames);
+}
+
+SymbolIndex::Suffixes SymbolIndex::buildSuffixes(const QList<QString> &names)
+{
+    Suffixes suffixes;
+    auto &entries = suffixes.entries;
+    entries.reserve(names.size());
+    for (qsizetype index = 0; index < names.size(); ++index)
+        entries.push_back({.reversedName = reversed(names.at(index)), .index = index});
+    std::ranges::sort(entries, [](const Suffix &left, const Suffix &right) {
+        return left.reversedName < right.reversedName;
+    });
+
+    const auto count = static_cast<qsizetype>(entries.size());
+    if (count == 0)
+        return suffixes;
+    auto &levels = suffixes.minimumIndices;
+    levels.emplace_back();
+    levels.back().reserve(count);
+    for (const auto &entry : entries)
+        levels.back().push_back(entry.index);
+    for (qsizetype width = 2; width <= count; width *= 2) {
+        const auto &previous = levels.back();
+        std::vector<qsizetype> level(count - width + 1);
+        for (qsizetype i = 0; i < static_cast<qsizetype>(level.size()); ++i)
+            level[i] = std::min(previous[i], previous[i + width / 2]);
+        levels.push_back(std::move(level));
+    }
+    return suffixes;
+}
+
+qsizetype SymbolIndex::findSuffix(const Suffixes &suffixes, const QString &name) const
+{
+    const auto reversedName = reversed(name);
+    const auto &entries = suffixes.entries;
+    const auto first = std::ranges::lower_bound(entries, reversedName, {}, &Suffix::reversedName);
+    const auto last = std::partition_point(first, entries.end(), [&reversedName](const Suffix &suffix) {
+        return suffix.reversedName.startsWith(reversedName);
+    });
+    if (first == last)
+        return m_symbols.size();
+
+    // Two overlapping ranges of the same power of 2 cover [first, last).
+    const auto start = std::distance(entries.begin(), first);
+    const auto length = std::distance(first, last);
+    const auto level = std::bit_width(static_cast<size_t>(length)) - 1;
+    const auto &minimums = suffixes.minimumIndices[level];
+    return std::min(minimums[start], minimums[start + length - (qsizetype(1) << level)]);
+}
+
+Core::Symbol *SymbolIndex::symbolAt(qsizetype index) const
+{
+    return index >= 0 && index < m_symbols.size() ? m_symbols.at(index) : nullptr;
+}
+
+Core::Symbol *SymbolIndex::find(const QString &name, bool wholeName, Qt::CaseSensitivity caseSensitivity) const
+{
+    const bool caseSensitive = caseSensitivity == Qt::CaseSensitive;
+    if (wholeName) {
+        const auto &names = caseSensitive ? m_names : m_foldedNames;
+        return symbolAt(names.value(caseSensitive ? name : name.toCaseFolded(), -1));
+    }
+    return caseSensitive ? symbolAt(findSuffix(m_suffixes, name))
+                         : symbolAt(findSuffix(m_foldedSuffixes, name.toCaseFolded()));
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // TreeSitterHelper
 ///////////////////////////////////////////////////////////////////////////////
@@ -28,9 +125,59 @@ TreeSitterHelper::TreeSitterHelper(CodeDocument *document)
 
 void TreeSitterHelper::clear()
 {
+    // Keep the tree parsed before the first edit since the last parse, it's edited to match all the edits at once.
+    if (m_tree && !m_previousTree) {
+        m_previousTree = std::move(m_tree);
+        m_previousText = std::move(m_text);
+    }
+    // The symbols are kept, to update only the ones affected by the edits.
+    if (m_flags & HasSymbols) {
+        m_flags = (m_flags & ~HasSymbols) | OutdatedSymbols;
+    }
+
     m_tree = {};
+    m_text.reset();
+    m_contentKey.reset();
+    m_predicateCaches.reset();
+    m_symbolIndex.reset();
+}
+
+void TreeSitterHelper::unload()
+{
+    // The symbols are children of the document, they would only be freed with it. They are deleted once back in the
+    // event loop, so the code running now can still use them; scripts holding one then see it as null.
+    for (auto *symbol : std::as_const(m_symbols))
+        symbol->deleteLater();
     m_symbols.clear();
-    m_flags &= ~HasSymbols;
+    m_symbolChanges.clear();
+    m_flags = 0;
+
+    m_tree.reset();
+    m_text.reset();
+    m_previousTree.reset();
+    m_previousText.reset();
+    m_contentKey.reset();
+    m_predicateCaches.reset();
+    m_symbolIndex.reset();
+}
+
+qint64 TreeSitterHelper::memoryUsage() const
+{
+    // tree-sitter doesn't report the size of a tree, it's estimated from the size of the text it was parsed from.
+    constexpr qint64 TreeBytesPerCharacter = 10;
+    constexpr qint64 BytesPerSymbol = 256;
+
+    qint64 usage = static_cast<qint64>(m_symbols.size()) * BytesPerSymbol;
+    if (m_text)
+        usage += m_text->size() * static_cast<qint64>(sizeof(QChar));
+    if (m_tree && m_text)
+        usage += m_text->size() * TreeBytesPerCharacter;
+    if (m_previousText) {
+        usage += m_previousText->size() * static_cast<qint64>(sizeof(QChar));
+        if (m_previousTree)
+            usage += m_previousText->size() * TreeBytesPerCharacter;
+    }
+    return usage;
 }
 
 treesitter::Parser &TreeSitterHelper::parser()
@@ -53,7 +200,14 @@ std::optional<treesitter::Tree> &TreeSitterHelper::syntaxTree()
             spdlog::warn("{}: Unable to set the included ranges on the treesitter parser!", FUNCTION_NAME);
             parser.setIncludedRanges({});
         }
-        m_tree = parser.parseString(m_document->text());
+        if (m_previousTree) {
+            parseIncrementally();
+        } else {
+            m_tree = parser.parseString(text());
+            ++m_parseCount;
+            // Without the previous tree, nothing tells which symbols changed.
+            m_flags &= ~OutdatedSymbols;
+        }
         if (!m_tree) {
             spdlog::warn("{}: Failed to parse document {}!", FUNCTION_NAME, m_document->fileName());
         }
@@ -61,6 +215,81 @@ std::optional<treesitter::Tree> &TreeSitterHelper::syntaxTree()
     return m_tree;
 }
 
+void TreeSitterHelper::parseIncrementally()
+{
+    auto previousTree = std::move(*m_previousTree);
+    const auto previousText = std::move(*m_previousText);
+    m_previousTree.reset();
+    m_previousText.reset();
+
+    const auto edit = treesitter::inputEdit(previousText, text());
+    if (!edit) {
+        // The edits were undone, the previous tree is still valid.
+        m_tree = std::move(previousTree);
+        return;
+    }
+
+    previousTree.edit(*edit);
+    m_tree = parser().parseString(text(), &previousTree);
+    ++m_parseCount;
+    if (!m_tree) {
+        m_flags &= ~OutdatedSymbols;
+        return;
+    }
+
+    if (m_flags & OutdatedSymbols) {
+        // Range marks follow the next edits, until the symbols are updated.
+        auto addChange = [this](uint32_t startByte, uint32_t endByte) {
+            m_symbolChanges.push_back(RangeMark(m_document, static_cast<int>(startByte / sizeof(QChar)),
+                                                static_cast<int>(endByte / sizeof(QChar))));
+        };
+        addChange(edit->start_byte, edit->new_end_byte);
+        for (const auto &range : previousTree.changedRanges(*m_tree)) {
+            addChange(range.start_byte, range.end_byte);
+        }
+    }
+}
+
+void TreeSitterHelper::setSyntaxTree(QString text, treesitter::Tree tree)
+{
+    clear();
+    m_previousTree.reset();
+    m_previousText.reset();
+    m_flags &= ~OutdatedSymbols;
+
+    m_text = std::move(text);
+    m_tree = std::move(tree);
+}
+
+int TreeSitterHelper::parseCount() const
+{
+    return m_parseCount;
+}
+
+const QString &TreeSitterHelper::text()
+{
+    if (!m_text) {
+        m_text = m_document->text();
+    }
+    return *m_text;
+}
+
+const QByteArray &TreeSitterHelper::contentKey()
+{
+    if (!m_contentKey) {
+        m_contentKey = QueryCache::documentKey(text(), m_document->includedRanges(), parser().language());
+    }
+    return *m_contentKey;
+}
+
+const std::shared_ptr<treesitter::PredicateCaches> &TreeSitterHelper::predicateCaches()
+{
+    if (!m_predicateCaches) {
+        m_predicateCaches = std::make_shared<treesitter::PredicateCaches>();
+    }
+    return m_predicateCaches;
+}
+
 std::shared_ptr<treesitter::Query> TreeSitterHelper::constructQuery(const QString &query)
 {
     std::shared_ptr<treesitter::Query> tsQuery;
@@ -88,10 +317,6 @@ QList<treesitter::Node> TreeSitterHelper::nodesInRange(const RangeMark &range)
         return {};
     }
 
-    QList<treesitter::Node> nodesToVisit;
-    QList<treesitter::Node> nodesInRange;
-    nodesToVisit.emplace_back(tree->rootNode());
-
     auto compareToRange = [&range](const treesitter::Node &node) {
         if (range.contains(node.startPosition()) && range.contains(node.endPosition() - 1))
             return RangeComparison::Contains;
@@ -101,19 +326,25 @@ QList<treesitter::Node> TreeSitterHelper::nodesInRange(const RangeMark &range)
         return RangeComparison::Disjoint;
     };
 
-    // Note: This could be improved performance-wise using the first_child_for_byte
-    // functions on either TSNode, or TSTreeCursor.
-    // However, these functions aren't currently wrapped and would make the search a bit more complex.
-    while (!nodesToVisit.isEmpty()) {
-        auto node = nodesToVisit.takeLast();
-        switch (compareToRange(node)) {
+    const auto root = tree->rootNode();
+    QList<treesitter::Node> nodesInRange;
+    if (compareToRange(root) == RangeComparison::Contains) {
+        nodesInRange.emplace_back(root);
+        return nodesInRange;
+    }
+
+    // Only descend into the nodes overlapping the range, the nodes are returned in document order.
+    treesitter::PreorderWalker walker(root);
+    while (const auto node = walker.next()) {
+        switch (compareToRange(*node)) {
         case RangeComparison::Contains:
-            nodesInRange.emplace_back(node);
+            nodesInRange.emplace_back(*node);
+            walker.skipChildren();
             break;
         case RangeComparison::Overlaps:
-            nodesToVisit.append(node.children());
             break;
         default:
+            walker.skipChildren();
             break;
         }
     }
@@ -144,26 +375,76 @@ treesitter::Node TreeSitterHelper::nodeCoveringRange(int start, int end)
     return coveringNode;
 }
 
+// The symbols are sorted so that a symbol always comes after the symbols surrounding it.
+// A single sweep with a stack of the currently open symbols is then enough to find the context of each symbol.
 void TreeSitterHelper::assignSymbolContexts()
 {
-    auto contextForSymbol = [this](Symbol *symbol) {
-        auto surroundsSymbol = [&symbol](const Symbol *otherSymbol) {
-            return symbol != otherSymbol && otherSymbol->range().contains(symbol->range());
-        };
-        auto surroundingSymbols = kdalgorithms::filtered(m_symbols, surroundsSymbol);
-
-        kdalgorithms::sort_by(
-            surroundingSymbols,
-            [](const auto &symbol) {
-                return symbol->range().length();
-            },
-            kdalgorithms::descending);
-        return surroundingSymbols;
+    QList<Symbol *> openSymbols;
+    for (auto *symbol : std::as_const(m_symbols)) {
+        const auto range = symbol->range();
+        while (!openSymbols.isEmpty() && !openSymbols.constLast()->range().contains(range)) {
+            openSymbols.removeLast();
+        }
+        if (!openSymbols.isEmpty()) {
+            symbol->assignContext(openSymbols.constLast());
+        }
+        openSymbols.append(symbol);
+    }
+}
+
+// Sort by start position, surrounding symbols first when starting at the same position.
+void TreeSitterHelper::sortSymbols()
+{
+    std::ranges::stable_sort(m_symbols, [](const Symbol *left, const Symbol *right) {
+        const auto leftStart = left->range().start();
+        const auto rightStart = right->range().start();
+        if (leftStart != rightStart)
+            return leftStart < rightStart;
+        return left->range().end() > right->range().end();
+    });
+}
+
+// Only the symbols intersecting the ranges changed since the last update are queried again, the other ones are kept
+// as is (their range marks followed the edits), with the data they already computed, like the function arguments.
+void TreeSitterHelper::updateSymbols()
+{
+    auto intersectsChanges = [this](const RangeMark &range) {
+        return std::ranges::any_of(m_symbolChanges, [&range](const RangeMark &change) {
+            return range.start() <= change.end() && change.start() <= range.end();
+        });
     };
 
-    for (const auto &symbol : m_symbols | std::views::reverse) {
-        symbol->assignContext(contextForSymbol(symbol));
+    QList<Symbol *> symbols;
+    symbols.reserve(m_symbols.size());
+    for (auto *symbol : std::as_const(m_symbols)) {
+        if (!intersectsChanges(symbol->range())) {
+            symbol->resetContext();
+            symbols.push_back(symbol);
+        }
     }
+
+    if (!m_symbolChanges.isEmpty()) {
+        QueryRange queryRange {.start = m_symbolChanges.first().start(), .end = m_symbolChanges.first().end()};
+        for (const auto &change : std::as_const(m_symbolChanges)) {
+            queryRange.start = std::min(queryRange.start, change.start());
+            queryRange.end = std::max(queryRange.end, change.end());
+        }
+        m_queryRange = queryRange;
+        const auto newSymbols = querySymbols(m_document);
+        m_queryRange.reset();
+
+        // The queries return all matches intersecting the range, some of them are outside of the changes.
+        for (auto *symbol : newSymbols) {
+            if (intersectsChanges(symbol->range())) {
+                symbols.push_back(symbol);
+            } else {
+                delete symbol;
+            }
+        }
+    }
+
+    m_symbols = std::move(symbols);
+    m_symbolChanges.clear();
 }
 
 const QList<Core::Symbol *> &TreeSitterHelper::symbols()
@@ -171,17 +452,41 @@ const QList<Core::Symbol *> &TreeSitterHelper::symbols()
     if (m_flags & HasSymbols)
         return m_symbols;
 
-    m_flags |= HasSymbols;
-
-    m_symbols = querySymbols(m_document);
+    // Only parse to know what changed since the symbols were computed, when there is a previous tree to compare to.
+    // Otherwise, the symbols are queried again, and the query cache can return them without parsing.
+    if (m_flags & OutdatedSymbols) {
+        if (m_previousTree)
+            syntaxTree();
+        else if (!m_tree)
+            m_flags &= ~OutdatedSymbols;
+    }
+    if (m_flags & OutdatedSymbols) {
+        updateSymbols();
+    } else {
+        m_symbols = querySymbols(m_document);
+    }
 
-    kdalgorithms::sort_by(m_symbols, [](const auto &symbol) {
-        return symbol->range().start();
-    });
+    m_flags = (m_flags & ~OutdatedSymbols) | HasSymbols;
+    m_symbolChanges.clear();
+    m_symbolIndex.reset();
 
+    sortSymbols();
     assignSymbolContexts();
 
     return m_symbols;
 }
 
+const SymbolIndex &TreeSitterHelper::symbolIndex()
+{
+    const auto &symbols = this->symbols();
+    if (!m_symbolIndex)
+        m_symbolIndex.emplace(symbols);
+    return *m_symbolIndex;
+}
+
+const std::optional<TreeSitterHelper::QueryRange> &TreeSitterHelper::queryRange() const
+{
+    return m_queryRange;
+}
+
 } // namespace Core
@@ -15,15 +15,54 @@
 #include "symbol.h"
 #include "treesitter/node.h"
 #include "treesitter/parser.h"
+#include "treesitter/predicates.h"
 #include "treesitter/query.h"
 #include "treesitter/tree.h"
 
+#include <QHash>
 #include <QList>
+#include <vector>
 
 namespace Core {
 
 class CodeDocument;
 
+// Index of the symbol names, for the lookups of CodeDocument::findSymbol.
+// Lookups return the first matching symbol in the list the index is built from, like a linear search would.
+class SymbolIndex
+{
+public:
+    explicit SymbolIndex(const QList<Core::Symbol *> &symbols);
+
+    // Exact name, or a suffix of the name if wholeName is false.
+    Core::Symbol *find(const QString &name, bool wholeName, Qt::CaseSensitivity caseSensitivity) const;
+
+private:
+    // Names are stored reversed and sorted, so all names ending with a suffix are next to each other.
+    struct Suffix
+    {
+        QString reversedName;
+        qsizetype index;
+    };
+    struct Suffixes
+    {
+        std::vector<Suffix> entries;
+        // Sparse table: minimumIndices[k][i] is the smallest symbol index in entries [i, i + 2^k), so the first symbol
+        // of any range of entries is found in constant time.
+        std::vector<std::vector<qsizetype>> minimumIndices;
+    };
+
+    static Suffixes buildSuffixes(const QList<QString> &names);
+    qsizetype findSuffix(const Suffixes &suffixes, const QString &name) const;
+    Core::Symbol *symbolAt(qsizetype index) const;
+
+    QList<Core::Symbol *> m_symbols;
+    QHash<QString, qsizetype> m_names;
+    QHash<QString, qsizetype> m_foldedNames;
+    Suffixes m_suffixes;
+    Suffixes m_foldedSuffixes;
+};
+
 class TreeSitterHelper
 {
 public:
@@ -36,28 +75,74 @@ public:
     explicit TreeSitterHelper(CodeDocument *document);
 
     void clear();
+    // Frees everything computed from the text when the document is unloaded, including the symbols.
+    void unload();
+    // Approximate memory used by the text snapshots, syntax trees and symbols, in bytes.
+    qint64 memoryUsage() const;
 
     treesitter::Parser &parser();
     std::optional<treesitter::Tree> &syntaxTree();
+    // Uses a tree already parsed from `text`, which must be the current text of the document.
+    void setSyntaxTree(QString text, treesitter::Tree tree);
+    // Number of times the document was parsed, a query cache hit doesn't parse it.
+    int parseCount() const;
+
+    // Immutable snapshot of the document text, the syntax tree is parsed from it.
+    // QString is implicitly shared, so predicates and nodes can keep or view it without copying the text.
+    const QString &text();
+
+    // Key identifying the content the syntax tree is parsed from, see QueryCache::documentKey.
+    const QByteArray &contentKey();
+
+    // Caches of the predicates for the current syntax tree, shared by all queries until the text changes.
+    const std::shared_ptr<treesitter::PredicateCaches> &predicateCaches();
 
     std::shared_ptr<treesitter::Query> constructQuery(const QString &query);
     QList<treesitter::Node> nodesInRange(const RangeMark &range);
     treesitter::Node nodeCoveringRange(int start, int end);
 
     const QList<Core::Symbol *> &symbols();
+    // Built on first use, until the symbols change.
+    const SymbolIndex &symbolIndex();
+
+    // While the symbols are updated, the queries only return the matches intersecting this range, in characters.
+    struct QueryRange
+    {
+        int start;
+        int end;
+    };
+    const std::optional<QueryRange> &queryRange() const;
 
 private:
     void assignSymbolContexts();
+    void sortSymbols();
+    void parseIncrementally();
+    void updateSymbols();
 
     enum Flags {
         HasSymbols = 0x01,
+        // The symbols were computed before the last edits, they can be updated from the changes since then.
+        OutdatedSymbols = 0x02,
     };
 
     CodeDocument *const m_document;
     std::optional<treesitter::Parser> m_parser;
     std::optional<treesitter::Tree> m_tree;
+    std::optional<QString> m_text;
+    std::optional<QByteArray> m_contentKey;
+    std::shared_ptr<treesitter::PredicateCaches> m_predicateCaches;
+
+    // Last parsed tree and text, kept after an edit until the next parse, to parse incrementally.
+    std::optional<treesitter::Tree> m_previousTree;
+    std::optional<QString> m_previousText;
+
     QList<Core::Symbol *> m_symbols;
+    // Ranges changed since the symbols were computed, following the edits.
+    QList<RangeMark> m_symbolChanges;
+    std::optional<QueryRange> m_queryRange;
+    std::optional<SymbolIndex> m_symbolIndex;
     int m_flags = 0;
+    int m_parseCount = 0;
 };
 
 } // namespace Core
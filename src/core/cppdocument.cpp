@@ -15,6 +15,7 @@
 #include "logger.h"
 #include "project.h"
 #include "settings.h"
+#include "treesitter/languages.h"
 #include "utils.h"
 #include "utils/log.h"
 
@@ -27,15 +28,41 @@
 #include <QVariantMap>
 #include <algorithm>
 #include <kdalgorithms.h>
+#include <mutex>
 
 namespace {
 using namespace Core;
 
+// Compiling a query is expensive, so the built-in queries are only compiled once and shared by all documents.
+// Names are never part of the query text, they are bound when executing the query, using query parameters.
+// Queries are also run on the threads of the global thread pool, the cache is protected by a mutex.
+std::shared_ptr<treesitter::Query> cppQuery(const QString &queryString)
+{
+    static QHash<QString, std::shared_ptr<treesitter::Query>> queries;
+    static std::mutex mutex;
+
+    std::lock_guard lock(mutex);
+    auto &query = queries[queryString];
+    if (!query) {
+        try {
+            query =
+                std::make_shared<treesitter::Query>(tree_sitter_cpp(), queryString, treesitter::Query::WithParameters);
+        } catch (treesitter::Query::Error &error) {
+            spdlog::error("{}: Failed to parse query `{}` error: {} at: {}", FUNCTION_NAME, queryString,
+                          error.description, error.utf8_offset);
+            queries.remove(queryString);
+            return {};
+        }
+    }
+    return query;
+}
+
 // We query for classes in queryClassSymbols and queryClassDefinition.
 // To make sure the results of both are consistent, share the actual query by using this function.
-static QString classQuery(std::optional<QString> className)
+// If `named` is true, the class name is bound to the `$className` parameter.
+static QString classQuery(bool named)
 {
-    auto like_predicate = className.has_value() ? QString("(#like? @name \"%1\")").arg(*className) : "";
+    auto like_predicate = named ? QString(R"EOF((#like? @name "$className"))EOF") : QString();
 
     return QString(R"EOF(
         ; query classes or structs
@@ -53,22 +80,31 @@ static QString classQuery(std::optional<QString> className)
         .arg(like_predicate);
 }
 
-static QString functionDeclaratorQuery(const QString &scope, std::optional<QString> name)
+enum class FunctionName {
+    // Any function, the name is captured as @name and @selectionRange
+    Any,
+    // Function named after the `$functionName` parameter
+    Named,
+    // Function named after the `$functionName` parameter, in the scope given by the `$scope` parameter
+    ScopedNamed,
+};
+
+static QString functionDeclaratorQuery(FunctionName name)
 {
     auto identifier = QString("");
-    if (name.has_value()) {
+    if (name != FunctionName::Any) {
         // clang-format off
-        identifier = QString(R"EOF(
-            [(identifier) (field_identifier)] @name (#eq? @name "%1")
-        )EOF").arg(*name);
+        identifier = R"EOF(
+            [(identifier) (field_identifier)] @name (#eq? @name "$functionName")
+        )EOF";
 
-        if (!scope.isEmpty()) {
+        if (name == FunctionName::ScopedNamed) {
             identifier = QString(R"EOF(
                 (qualified_identifier
-                    scope: (_) @scope (#like? @scope "%1")
-                    %2
+                    scope: (_) @scope (#like? @scope "$scope")
+                    %1
                 )
-            )EOF").arg(scope, identifier);
+            )EOF").arg(identifier);
         }
         // clang-format on
     } else {
@@ -151,14 +187,14 @@ static QString methodDeclarationQuery(const QString &declarator)
 
 auto queryFunctionSymbols(CodeDocument *const document) -> QList<Core::Symbol *>
 {
-    auto functionDeclarator = functionDeclaratorQuery("", std::nullopt);
+    auto functionDeclarator = functionDeclaratorQuery(FunctionName::Any);
     auto pointerDeclarator = pointerDeclaratorQuery(functionDeclarator, "@return");
 
     auto functionDefinition = methodDefinitionQuery(pointerDeclarator);
     auto memberFunctionDeclaration = methodDeclarationQuery(pointerDeclarator);
 
     // clang-format off
-    auto functions = document->query(QString(R"EOF(
+    auto functions = document->query(cppQuery(QString(R"EOF(
         [; Free function implementations
         %3
 
@@ -177,7 +213,7 @@ auto queryFunctionSymbols(CodeDocument *const document) -> QList<Core::Symbol *>
 
         ; Member functions
         %4
-    ])EOF").arg(functionDeclarator, pointerDeclarator, functionDefinition, memberFunctionDeclaration));
+    ])EOF").arg(functionDeclarator, pointerDeclarator, functionDefinition, memberFunctionDeclaration)));
     // clang-format on
 
     auto function_to_symbol = [document](const QueryMatch &match) {
@@ -200,7 +236,7 @@ auto queryFunctionSymbols(CodeDocument *const document) -> QList<Core::Symbol *>
 
 auto queryClassSymbols(CodeDocument *const document) -> QList<Core::Symbol *>
 {
-    auto classesAndStructs = document->query(classQuery(std::nullopt));
+    auto classesAndStructs = document->query(cppQuery(classQuery(false)));
     auto class_to_symbol = [document](const QueryMatch &match) {
         return Symbol::makeSymbol(document, match, Symbol::Kind::Class);
     };
@@ -208,12 +244,13 @@ auto queryClassSymbols(CodeDocument *const document) -> QList<Core::Symbol *>
     return kdalgorithms::transformed<QList<Symbol *>>(classesAndStructs, class_to_symbol);
 }
 
-static QString membersQuery(std::optional<QString> name)
+// If `named` is true, the member name is bound to the `$memberName` parameter.
+static QString membersQuery(bool named)
 {
     auto fieldIdentifier = "(field_identifier) @name @selectionRange";
     auto pointerDeclarator = pointerDeclaratorQuery(fieldIdentifier, "@type");
 
-    auto nameCheck = name.has_value() ? QString("(#eq? @name \"%1\")").arg(*name) : "";
+    auto nameCheck = named ? QString(R"EOF((#eq? @name "$memberName"))EOF") : QString();
 
     // clang-format off
     return QString(R"EOF(
@@ -233,7 +270,7 @@ static QString membersQuery(std::optional<QString> name)
 
 auto queryMemberSymbols(CodeDocument *const document) -> QList<Core::Symbol *>
 {
-    auto members = document->query(membersQuery(std::nullopt));
+    auto members = document->query(cppQuery(membersQuery(false)));
 
     auto member_to_symbol = [document](const QueryMatch &match) {
         return Symbol::makeSymbol(document, match, Symbol::Kind::Field);
@@ -243,20 +280,20 @@ auto queryMemberSymbols(CodeDocument *const document) -> QList<Core::Symbol *>
 }
 auto queryEnumSymbols(CodeDocument *const document) -> QList<Core::Symbol *>
 {
-    auto enums = document->query(R"EOF(
+    auto enums = document->query(cppQuery(R"EOF(
         (enum_specifier
           name: (_) @name @selectionRange) @range
-    )EOF");
+    )EOF"));
     auto enum_to_symbol = [document](const QueryMatch &match) {
         return Symbol::makeSymbol(document, match, Symbol::Kind::Enum);
     };
     auto result = kdalgorithms::transformed<QList<Symbol *>>(enums, enum_to_symbol);
 
-    auto enumerators = document->query(R"EOF(
+    auto enumerators = document->query(cppQuery(R"EOF(
         (enumerator
           name: (_) @name @selectionRange
           value: (_)? @value) @range
-    )EOF");
+    )EOF"));
     result.append(kdalgorithms::transformed<QList<Symbol *>>(enumerators, enum_to_symbol));
 
     return result;
@@ -291,6 +328,8 @@ CppDocument::CppDocument(QObject *parent)
 {
     // setup symbol query functions specific to c++
     helper()->querySymbols = ::queryAllSymbols;
+
+    connect(textEdit()->document(), &QTextDocument::contentsChange, this, &CppDocument::updateExcludedMacros);
 }
 CppDocument::~CppDocument() = default;
 
@@ -393,7 +432,7 @@ void CppDocument::commentSelection()
     textEdit()->setTextCursor(cursor);
 }
 
-static QStringList matchingSuffixes(bool header)
+QStringList CppDocument::fileSuffixes(bool headers)
 {
     static const auto mimeTypes =
         Settings::instance()->value<std::map<std::string, Document::Type>>(Settings::MimeTypes);
@@ -402,22 +441,13 @@ static QStringList matchingSuffixes(bool header)
     for (const auto &it : mimeTypes) {
         if (it.second == Document::Type::Cpp) {
             const QString suffix = QString::fromStdString(it.first);
-            if ((header && !isHeaderSuffix(suffix)) || (!header && isHeaderSuffix(suffix)))
+            if (isHeaderSuffix(suffix) == headers)
                 suffixes.push_back(suffix);
         }
     }
     return suffixes;
 }
 
-static QStringList candidateFileNames(const QString &baseName, const QStringList &suffixes)
-{
-    QStringList result;
-    result.reserve(suffixes.size());
-    for (const auto &suffix : suffixes)
-        result.push_back(baseName + '.' + suffix);
-    return result;
-}
-
 static int commonFilePathLength(const QString &s1, const QString &s2)
 {
     const qsizetype length = qMin(s1.length(), s2.length());
@@ -428,62 +458,63 @@ static int commonFilePathLength(const QString &s1, const QString &s2)
     return length;
 }
 
+QString CppDocument::findHeaderSource(const QString &fileName, const QStringList &candidates)
+{
+    const QStringList suffixes = fileSuffixes(!isHeaderSuffix(QFileInfo(fileName).suffix()));
+
+    // Find the file having the most common path with fileName, then the first suffix in the settings.
+    QString bestFileName;
+    int bestLength = -1;
+    qsizetype bestSuffixIndex = 0;
+    for (const auto &candidate : candidates) {
+        const QString suffix = QFileInfo(candidate).suffix();
+        const auto suffixIt = std::ranges::find_if(suffixes, [&suffix](const QString &s) {
+            return s.compare(suffix, Qt::CaseInsensitive) == 0;
+        });
+        if (suffixIt == suffixes.cend())
+            continue;
+        const int length = commonFilePathLength(candidate, fileName);
+        const auto suffixIndex = std::distance(suffixes.cbegin(), suffixIt);
+        if (length > bestLength || (length == bestLength && suffixIndex < bestSuffixIndex)) {
+            bestFileName = candidate;
+            bestLength = length;
+            bestSuffixIndex = suffixIndex;
+        }
+    }
+    return bestFileName;
+}
+
 /*!
  * \qmlmethod string CppDocument::correspondingHeaderSource()
  * Returns the corresponding source or header file path.
+ *
+ * The file with the same base name sharing the longest path with this document is returned, so a file in the same
+ * directory is preferred. Use `Project.headerSourcePairs()` to get the pairs of all the project files at once.
  */
 QString CppDocument::correspondingHeaderSource() const
 {
     LOG();
-    static QHash<QString, QString> cache;
-
-    QString cacheData = cache.value(fileName());
-    if (!cacheData.isEmpty())
-        return cacheData;
-
-    const bool header = isHeader();
-    const QStringList suffixes = matchingSuffixes(header);
 
     const QFileInfo fi(fileName());
-    const QStringList candidates = candidateFileNames(fi.completeBaseName(), suffixes);
-
-    // Search in the current directory
-    for (const auto &candidate : candidates) {
-        const QString testFileName = fi.absolutePath() + '/' + candidate;
-        if (QFile::exists(testFileName)) {
-            cache[fileName()] = testFileName;
-            cache[testFileName] = fileName();
-            spdlog::debug("{}: {} => {}", FUNCTION_NAME, fileName(), testFileName);
-            LOG_RETURN("path", testFileName);
-        }
-    }
-
-    // Search in the whole project, and find the possible files
-    QStringList fullPathNames = Project::instance()->allFilesWithExtensions(suffixes, Project::FullPath);
-    auto notCandidate = [&candidates](const QString &path) {
-        auto notInPath = [&path](const QString &candidate) {
-            return !path.endsWith(candidate, Qt::CaseInsensitive);
-        };
-        return kdalgorithms::all_of(candidates, notInPath);
-    };
-    kdalgorithms::erase_if(fullPathNames, notCandidate);
-
-    // Find the file having the most common path with fileName
-    QString bestFileName;
-    int compareValue = 0;
-    for (const auto &path : std::as_const(fullPathNames)) {
-        int value = commonFilePathLength(path, fileName());
-        if (value > compareValue) {
-            compareValue = value;
-            bestFileName = path;
+    // The project index gives the files with the same base name, only a few need to be compared.
+    QString result = findHeaderSource(
+        fileName(), Project::instance()->filesWithBaseName(fi.completeBaseName(), Project::FullPath));
+
+    // The document may be outside of the project, or ignored by it: search in the current directory
+    if (result.isEmpty()) {
+        const QStringList suffixes = fileSuffixes(!isHeader());
+        for (const auto &suffix : suffixes) {
+            const QString testFileName = fi.absolutePath() + '/' + fi.completeBaseName() + '.' + suffix;
+            if (QFile::exists(testFileName)) {
+                result = testFileName;
+                break;
+            }
         }
     }
 
-    if (!bestFileName.isEmpty()) {
-        cache[fileName()] = bestFileName;
-        cache[bestFileName] = fileName();
-        spdlog::debug("{}: {} => {}", FUNCTION_NAME, fileName(), bestFileName);
-        LOG_RETURN("path", bestFileName);
+    if (!result.isEmpty()) {
+        spdlog::debug("{}: {} => {}", FUNCTION_NAME, fileName(), result);
+        LOG_RETURN("path", result);
     }
 
     spdlog::warn("{}: {} - not found ", FUNCTION_NAME, fileName());
@@ -553,9 +584,7 @@ Core::QueryMatch CppDocument::queryClassDefinition(const QString &className)
 {
     LOG(LOG_ARG("className", className));
 
-    const auto classDefinitionQuery = classQuery({className});
-
-    auto matches = query(classDefinitionQuery);
+    auto matches = query(cppQuery(classQuery(true)), {{"className", className}});
     if (matches.isEmpty()) {
         spdlog::warn("{}: No class named `{}` found in `{}`", FUNCTION_NAME, className, fileName());
         return {};
@@ -591,24 +620,26 @@ Core::QueryMatchList CppDocument::queryMethodDefinition(const QString &scope, co
 {
     LOG(LOG_ARG("scope", scope), LOG_ARG("functionName", functionName));
 
-    const auto functionDeclarator = functionDeclaratorQuery(scope, {functionName});
+    const auto functionDeclarator =
+        functionDeclaratorQuery(scope.isEmpty() ? FunctionName::Named : FunctionName::ScopedNamed);
     const auto pointerDeclaration = pointerDeclaratorQuery(functionDeclarator, "@return");
-    return query(methodDefinitionQuery(pointerDeclaration));
+    return query(cppQuery(methodDefinitionQuery(pointerDeclaration)),
+                 {{"scope", scope}, {"functionName", functionName}});
 }
 
 QList<QueryMatch> CppDocument::internalQueryFunctionCall(const QString &functionName, const QString &argumentsQuery)
 {
     const auto queryString = QString(R"EOF(
                 (call_expression
-                    function: (_) @name (#eq? @name "%1")
+                    function: (_) @name (#eq? @name "$functionName")
                     arguments: (argument_list
-                            %2
+                            %1
                         ) @argument-list
                 ) @call
     )EOF")
-                                 .arg(functionName, argumentsQuery);
+                                 .arg(argumentsQuery);
 
-    return query(queryString);
+    return query(cppQuery(queryString), {{"functionName", functionName}});
 }
 
 /*!
@@ -852,7 +883,7 @@ DataExchange CppDocument::mfcExtractDDX(const QString &className)
  */
 MessageMap CppDocument::mfcExtractMessageMap(const QString &className /* = ""*/)
 {
-    auto checkClassName = className.isEmpty() ? "" : QString("(#eq? @class \"%1\")").arg(className);
+    auto checkClassName = className.isEmpty() ? QString() : QString(R"EOF((#eq? @class "$className"))EOF");
 
     // clang-format off
     const auto messageMapQueryString = QString(R"EOF(
@@ -902,7 +933,7 @@ MessageMap CppDocument::mfcExtractMessageMap(const QString &className /* = ""*/)
     // We assume there is at most one MessageMap per file.
     // This allows us to return immediately after the message map is found.
     // As the MessageMap query is quite complicated, this can significantly improve performance.
-    auto match = queryFirst(queryString);
+    auto match = queryFirst(cppQuery(queryString), {{"className", className}});
     if (match.isEmpty()) {
         spdlog::warn("{}: No message map found in `{}`", FUNCTION_NAME, fileName());
         return {};
@@ -941,17 +972,17 @@ Core::QueryMatchList CppDocument::queryMethodDeclaration(const QString &classNam
         return {};
     }
 
-    auto functionDeclarator = functionDeclaratorQuery("", {functionName});
+    auto functionDeclarator = functionDeclaratorQuery(FunctionName::Named);
 
     // clang-format off
     auto destructorDeclarator = QString(R"EOF(
         (function_declarator
-            declarator: (destructor_name) @name (#eq? @name "%1")
+            declarator: (destructor_name) @name (#eq? @name "$functionName")
 
              ; The parameter-list of a destructor must be empty.
              ; No point in capturing individual parameters
             parameters: (parameter_list) @parameter-list)
-    )EOF").arg(functionName);
+    )EOF");
 
     auto queryString = QString(R"EOF(
         [
@@ -970,7 +1001,7 @@ Core::QueryMatchList CppDocument::queryMethodDeclaration(const QString &classNam
                destructorDeclarator);
     // clang-format on
 
-    auto matches = classQuery.queryIn("body", queryString);
+    auto matches = classQuery.queryIn("body", cppQuery(queryString), {{"functionName", functionName}});
     if (matches.isEmpty()) {
         spdlog::warn("{}: No method named `{}` found in `{}`", FUNCTION_NAME, functionName, fileName());
     }
@@ -998,7 +1029,7 @@ Core::QueryMatch CppDocument::queryMember(const QString &className, const QStrin
 
     auto classQuery = queryClassDefinition(className);
 
-    auto matches = classQuery.queryIn("body", membersQuery(memberName));
+    auto matches = classQuery.queryIn("body", cppQuery(membersQuery(true)), {{"memberName", memberName}});
     if (matches.isEmpty()) {
         spdlog::warn("{}: No member named `{}` found in `{}`", FUNCTION_NAME, memberName, fileName());
         return {};
@@ -1775,32 +1806,127 @@ QStringList CppDocument::primitiveTypes() const
     return Utils::cppPrimitiveTypes();
 }
 
-QList<treesitter::Range> CppDocument::includedRanges() const
+// The regular expression matching the CppExcludedMacros, compiled once per revision of the settings.
+// Returns nullptr if there is no excluded macro, or if the expression is invalid.
+static const QRegularExpression *excludedMacrosRegex()
 {
-    auto macros = Settings::instance()->value<QStringList>(Settings::CppExcludedMacros);
-    if (macros.isEmpty()) {
-        return {};
+    static std::optional<quint64> revision;
+    static std::optional<QRegularExpression> regex;
+
+    const auto currentRevision = Settings::instance()->revision();
+    if (revision != currentRevision) {
+        revision = currentRevision;
+        regex.reset();
+
+        auto macros = Settings::instance()->value<QStringList>(Settings::CppExcludedMacros);
+        if (!macros.isEmpty()) {
+            QRegularExpression expression(macros.join("|"));
+            if (expression.isValid()) {
+                regex = std::move(expression);
+            } else {
+                spdlog::error("{}: Failed to create regex for excluded macros: {}", FUNCTION_NAME,
+                              expression.errorString());
+            }
+        }
     }
+    return regex.has_value() ? &regex.value() : nullptr;
+}
 
-    QRegularExpression regex(macros.join("|"));
-    if (!regex.isValid()) {
-        spdlog::error("{}: Failed to create regex for excluded macros: {}", FUNCTION_NAME, regex.errorString());
-        return {};
+QList<CppDocument::ExcludedMacro> CppDocument::findExcludedMacros(const QRegularExpression &regex,
+                                                                  const QTextBlock &first, const QTextBlock &last)
+{
+    QList<ExcludedMacro> macros;
+    for (auto block = first; block.isValid(); block = block.next()) {
+        const auto text = block.text();
+        // Run this in a loop to support multiple macros on the same line.
+        auto it = regex.globalMatchView(text);
+        while (it.hasNext()) {
+            const auto match = it.next();
+            if (match.capturedLength() == 0) {
+                continue;
+            }
+            macros.push_back({.position = block.position() + static_cast<int>(match.capturedStart()),
+                              .length = static_cast<int>(match.capturedLength())});
+        }
+        if (block == last) {
+            break;
+        }
+    }
+    return macros;
+}
+
+// Only rescan the blocks touched by the edit, the macros before are unchanged and the ones after are only moved.
+void CppDocument::updateExcludedMacros(int position, int charsRemoved, int charsAdded)
+{
+    if (!m_excludedMacrosPattern.has_value()) {
+        return;
+    }
+
+    const auto *regex = excludedMacrosRegex();
+    if (!regex || regex->pattern() != m_excludedMacrosPattern.value()) {
+        m_excludedMacrosPattern.reset();
+        return;
     }
 
     auto document = textEdit()->document();
+    const auto lastPosition = std::max(document->characterCount() - 1, 0);
+    const auto firstBlock = document->findBlock(std::clamp(position, 0, lastPosition));
+    const auto lastBlock = document->findBlock(std::clamp(position + charsAdded, 0, lastPosition));
+    if (!firstBlock.isValid() || !lastBlock.isValid()) {
+        m_excludedMacrosPattern.reset();
+        return;
+    }
 
-    QList<treesitter::Range> ranges;
-    treesitter::Point lastPoint {0, 0};
-    uint32_t lastByte = 0;
+    const auto delta = charsAdded - charsRemoved;
+    const auto rescanStart = firstBlock.position();
+    // End of the rescanned blocks, before the edit.
+    const auto rescanEnd = std::max(lastBlock.position() + lastBlock.length() - delta, rescanStart);
 
-    for (auto block = document->firstBlock(); block.isValid(); block = block.next()) {
-        QRegularExpressionMatch match;
-        auto searchFrom = 0;
-        auto index = block.text().indexOf(regex, searchFrom, &match);
+    const auto byPosition = [](const ExcludedMacro &macro, int position) {
+        return macro.position < position;
+    };
+    const auto begin = std::lower_bound(m_excludedMacros.cbegin(), m_excludedMacros.cend(), rescanStart, byPosition);
+    const auto end = std::lower_bound(begin, m_excludedMacros.cend(), rescanEnd, byPosition);
+
+    QList<ExcludedMacro> macros;
+    macros.reserve(m_excludedMacros.size());
+    macros.append(m_excludedMacros.first(std::distance(m_excludedMacros.cbegin(), begin)));
+    macros.append(findExcludedMacros(*regex, firstBlock, lastBlock));
+    for (auto it = end; it != m_excludedMacros.cend(); ++it) {
+        macros.push_back({.position = it->position + delta, .length = it->length});
+    }
 
-        // Run this in a loop to support multiple macros on the same line.
-        while (index != -1) {
+    if (!macros.isEmpty() && macros.constLast().position + macros.constLast().length > lastPosition) {
+        // The change doesn't match the macros found so far, start again from scratch.
+        m_excludedMacrosPattern.reset();
+        return;
+    }
+    m_excludedMacros = std::move(macros);
+}
+
+namespace {
+    // An excluded macro, with the line it is on.
+    struct MacroLocation
+    {
+        int position;
+        int length;
+        int line;
+        int column;
+        // Including the line separator.
+        int lineLength;
+    };
+
+    // Builds the ranges between the excluded `macros` of a text, the last line being `lastLine` with
+    // `lastLineLength` characters, out of `characterCount`. Both lengths include the final separator.
+    QList<treesitter::Range> rangesBetween(const QList<MacroLocation> &macros, int lastLine, int lastLineLength,
+                                           int characterCount)
+    {
+        QList<treesitter::Range> ranges;
+        ranges.reserve(macros.size() + 1);
+        treesitter::Point lastPoint {0, 0};
+        uint32_t lastByte = 0;
+
+        for (const auto &macro : macros) {
             // We need to construct a range from the end of the last match to the start of the current match.
             //
             // Note that the ranges have an inclusive start and an exclusive end..
@@ -1808,41 +1934,111 @@ QList<treesitter::Range> CppDocument::includedRanges() const
             // Also Note that the column seems to be in bytes, not characters.
             // This is why we multiply by sizeof(QChar) to get the correct column.
             // At least that's what the TreeSitterInspector shows us.
-            auto endPoint = treesitter::Point {.row = static_cast<uint32_t>(block.blockNumber()),
-                                               .column = static_cast<uint32_t>(index * sizeof(QChar))};
+            auto endPoint = treesitter::Point {.row = static_cast<uint32_t>(macro.line),
+                                               .column = static_cast<uint32_t>(macro.column * sizeof(QChar))};
             ranges.push_back({.start_point = lastPoint,
                               .end_point = endPoint,
                               .start_byte = lastByte,
                               // No need to add - 1 here, the ranges are exclusive at the end.
-                              .end_byte = static_cast<uint32_t>((block.position() + index) * sizeof(QChar))});
+                              .end_byte = static_cast<uint32_t>(macro.position * sizeof(QChar))});
 
-            auto matchLength = match.capturedLength();
-            lastByte = static_cast<uint32_t>((block.position() + index + matchLength) * sizeof(QChar));
-            lastPoint = {.row = static_cast<uint32_t>(block.blockNumber()),
-                         .column = static_cast<uint32_t>((index + matchLength) * sizeof(QChar))};
-            if (lastPoint.column == static_cast<uint32_t>(block.length())) {
+            lastByte = static_cast<uint32_t>((macro.position + macro.length) * sizeof(QChar));
+            lastPoint = {.row = static_cast<uint32_t>(macro.line),
+                         .column = static_cast<uint32_t>((macro.column + macro.length) * sizeof(QChar))};
+            if (lastPoint.column == static_cast<uint32_t>(macro.lineLength)) {
                 ++lastPoint.row;
                 lastPoint.column = 0;
             }
+        }
 
-            searchFrom = index + matchLength;
-            index = block.text().indexOf(regex, searchFrom, &match);
+        if (!ranges.isEmpty()) {
+            // Add the last range, up to the end of the document, but only if we have another range.
+            // Leaving the ranges empty will parse the entire document, so that's easiest.
+            auto endPoint = treesitter::Point {.row = static_cast<uint32_t>(lastLine),
+                                               .column = static_cast<uint32_t>(lastLineLength * sizeof(QChar))};
+            ranges.push_back({.start_point = lastPoint,
+                              .end_point = endPoint,
+                              .start_byte = lastByte,
+                              .end_byte = static_cast<uint32_t>(characterCount * sizeof(QChar))});
         }
+
+        return ranges;
     }
+}
 
-    if (!ranges.isEmpty()) {
-        // Add the last range, up to the end of the document, but only if we have another range.
-        // Leaving the ranges empty will parse the entire document, so that's easiest.
-        auto endPoint =
-            treesitter::Point {.row = static_cast<uint32_t>(document->blockCount() - 1),
-                               .column = static_cast<uint32_t>(document->lastBlock().length() * sizeof(QChar))};
-        ranges.push_back({.start_point = lastPoint,
-                          .end_point = endPoint,
-                          .start_byte = lastByte,
-                          .end_byte = static_cast<uint32_t>(document->characterCount() * sizeof(QChar))});
+QList<treesitter::Range> CppDocument::includedRanges() const
+{
+    const auto *regex = excludedMacrosRegex();
+    if (!regex) {
+        m_excludedMacros.clear();
+        m_excludedMacrosPattern.reset();
+        return {};
     }
 
-    return ranges;
+    auto document = textEdit()->document();
+
+    if (m_excludedMacrosPattern != regex->pattern()) {
+        m_excludedMacros = findExcludedMacros(*regex, document->firstBlock(), document->lastBlock());
+        m_excludedMacrosPattern = regex->pattern();
+    }
+
+    QList<MacroLocation> macros;
+    macros.reserve(m_excludedMacros.size());
+    for (const auto &macro : std::as_const(m_excludedMacros)) {
+        const auto block = document->findBlock(macro.position);
+        macros.push_back({.position = macro.position,
+                          .length = macro.length,
+                          .line = block.blockNumber(),
+                          .column = macro.position - block.position(),
+                          .lineLength = block.length()});
+    }
+
+    return rangesBetween(macros, document->blockCount() - 1, document->lastBlock().length(),
+                         document->characterCount());
+}
+
+QList<treesitter::Range> CppDocument::includedRanges(QStringView text, const QRegularExpression &regex)
+{
+    QList<MacroLocation> macros;
+    int line = 0;
+    qsizetype lineStart = 0;
+    qsizetype lineEnd = 0;
+    while (true) {
+        lineEnd = text.indexOf(u'\n', lineStart);
+        if (lineEnd == -1) {
+            lineEnd = text.size();
+        }
+
+        const auto lineText = text.sliced(lineStart, lineEnd - lineStart);
+        auto it = regex.globalMatchView(lineText);
+        while (it.hasNext()) {
+            const auto match = it.next();
+            if (match.capturedLength() == 0) {
+                continue;
+            }
+            macros.push_back({.position = static_cast<int>(lineStart + match.capturedStart()),
+                              .length = static_cast<int>(match.capturedLength()),
+                              .line = line,
+                              .column = static_cast<int>(match.capturedStart()),
+                              .lineLength = static_cast<int>(lineText.size() + 1)});
+        }
+
+        if (lineEnd == text.size()) {
+            break;
+        }
+        lineStart = lineEnd + 1;
+        ++line;
+    }
+
+    return rangesBetween(macros, line, static_cast<int>(lineEnd - lineStart + 1), static_cast<int>(text.size() + 1));
+}
+
+std::optional<QRegularExpression> CppDocument::excludedMacrosExpression()
+{
+    if (const auto *regex = excludedMacrosRegex()) {
+        return *regex;
+    }
+    return {};
 }
 
 } // namespace Core
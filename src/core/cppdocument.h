@@ -15,6 +15,14 @@
 #include "messagemap.h"
 #include "symbol.h"
 
+#include <QList>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringView>
+#include <optional>
+
+class QTextBlock;
+
 #ifndef Q_MOC_RUN
 #define API_EXECUTOR
 #endif
@@ -65,6 +73,16 @@ public:
 
     QList<treesitter::Range> includedRanges() const override;
 
+    // Same as includedRanges, for a text that isn't loaded in a document. Can be called from any thread.
+    static QList<treesitter::Range> includedRanges(QStringView text, const QRegularExpression &regex);
+    // Expression matching the CppExcludedMacros of the current settings, must be called from the main thread.
+    static std::optional<QRegularExpression> excludedMacrosExpression();
+    // Suffixes of the C++ headers if `headers` is true, of the C++ sources otherwise, from the mime types settings.
+    static QStringList fileSuffixes(bool headers);
+    // Returns the file of `candidates` corresponding to `fileName`: a source for a header, a header for a source. The
+    // candidates are expected to have the same base name as `fileName`, the one sharing the longest path wins.
+    static QString findHeaderSource(const QString &fileName, const QStringList &candidates);
+
 public slots:
     Core::CppDocument *openHeaderSource();
 
@@ -116,6 +134,20 @@ private:
                                const QString &newClassBaseName);
     void changeBaseClassForwardInclude(const QString &originalClassBaseName, const QString &newClassBaseName);
 
+    struct ExcludedMacro
+    {
+        int position;
+        int length;
+    };
+    static QList<ExcludedMacro> findExcludedMacros(const QRegularExpression &regex, const QTextBlock &first,
+                                                   const QTextBlock &last);
+    void updateExcludedMacros(int position, int charsRemoved, int charsAdded);
+
+    // Occurrences of the CppExcludedMacros in the document, sorted by position and updated while it's edited.
+    // The pattern is the one of the regular expression used to find them, empty if they are not computed yet.
+    mutable QList<ExcludedMacro> m_excludedMacros;
+    mutable std::optional<QString> m_excludedMacrosPattern;
+
     friend class IncludeHelper;
 };
 
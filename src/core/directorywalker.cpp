@@ -0,0 +1,519 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "directorywalker.h"
+
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace Core {
+
+static constexpr const char *IgnoreFileNames[] = {".gitignore", ".knutignore"};
+
+///////////////////////////////////////////////////////////////////////////////
+// IgnoreRules
+///////////////////////////////////////////////////////////////////////////////
+struct DirectoryWalker::IgnoreRules
+{
+    struct Pattern
+    {
+        QRegularExpression regexp;
+        bool negated = false;
+        bool directoryOnly = false;
+        // Anchored patterns match the path relative to the ignore file, the other ones only the file name.
+        bool anchored = false;
+    };
+
+    Rules parent;
+    QString path;
+    // Content of the ignore files, to know if they changed.
+    QStringList lines;
+    QList<Pattern> patterns;
+
+    bool isIgnored(const QString &filePath, const QString &fileName, bool isDirectory) const;
+};
+
+// Converts a gitignore glob to a regular expression: `*` and `?` don't match `/`, and `**` matches any number of
+// directories.
+static QString globToRegexp(QStringView glob)
+{
+    QString result;
+    for (qsizetype i = 0; i < glob.size(); ++i) {
+        const auto c = glob.at(i);
+        if (c == '*') {
+            if (i + 1 < glob.size() && glob.at(i + 1) == '*') {
+                const bool directoryStart = i == 0 || glob.at(i - 1) == '/';
+                if (directoryStart && i + 2 < glob.size() && glob.at(i + 2) == '/') {
+                    result += "(?:.*/)?";
+                    i += 2;
+                } else {
+                    result += ".*";
+                    ++i;
+                }
+            } else {
+                result += "[^/]*";
+            }
+        } else if (c == '?') {
+            result += "[^/]";
+        } else if (c == '[') {
+            const auto end = glob.indexOf(']', i + 1);
+            if (end == -1) {
+                result += "\\[";
+                continue;
+            }
+            auto range = glob.mid(i + 1, end - i - 1).toString();
+            if (range.startsWith('!'))
+                range[0] = '^';
+            result += '[' + range.replace('\\', "\\\\") + ']';
+            i = end;
+        } else if (c == '\\' && i + 1 < glob.size()) {
+            result += QRegularExpression::escape(glob.at(++i));
+        } else {
+            result += QRegularExpression::escape(c);
+        }
+    }
+    return result;
+}
+
+static QList<DirectoryWalker::IgnoreRules::Pattern> parsePatterns(const QStringList &lines)
+{
+    QList<DirectoryWalker::IgnoreRules::Pattern> patterns;
+    for (auto line : lines) {
+        if (line.endsWith('\r'))
+            line.chop(1);
+        // Trailing spaces are ignored, unless escaped.
+        while (line.endsWith(' ') && !line.endsWith("\\ "))
+            line.chop(1);
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        DirectoryWalker::IgnoreRules::Pattern pattern;
+        if (line.startsWith('!')) {
+            pattern.negated = true;
+            line.remove(0, 1);
+        } else if (line.startsWith("\\!") || line.startsWith("\\#")) {
+            line.remove(0, 1);
+        }
+        if (line.endsWith('/')) {
+            pattern.directoryOnly = true;
+            line.chop(1);
+        }
+        pattern.anchored = line.contains('/');
+        if (line.startsWith('/'))
+            line.remove(0, 1);
+        if (line.isEmpty())
+            continue;
+
+        pattern.regexp = QRegularExpression(QRegularExpression::anchoredPattern(globToRegexp(line)));
+        if (!pattern.regexp.isValid())
+            continue;
+        pattern.regexp.optimize();
+        patterns.push_back(std::move(pattern));
+    }
+    return patterns;
+}
+
+// Gitignore semantic: the last pattern matching wins, and the patterns of a directory win over the ones of its
+// parents.
+bool DirectoryWalker::IgnoreRules::isIgnored(const QString &filePath, const QString &fileName, bool isDirectory) const
+{
+    for (auto rules = this; rules; rules = rules->parent.get()) {
+        const auto relativePath =
+            rules->path.isEmpty() ? QStringView(filePath) : QStringView(filePath).mid(rules->path.size() + 1);
+        for (const auto &pattern : rules->patterns | std::views::reverse) {
+            if (pattern.directoryOnly && !isDirectory)
+                continue;
+            if (pattern.regexp.matchView(pattern.anchored ? relativePath : QStringView(fileName)).hasMatch())
+                return !pattern.negated;
+        }
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Directory listing
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+    struct DirectoryEntries
+    {
+        QStringList files;
+        QStringList directories;
+        bool hasIgnoreFiles = false;
+    };
+
+    bool isIgnoreFile(const QString &fileName)
+    {
+        return std::ranges::any_of(IgnoreFileNames, [&fileName](const char *name) {
+            return fileName == QLatin1String(name);
+        });
+    }
+
+    DirectoryEntries readDirectory(const QString &absolutePath)
+    {
+        DirectoryEntries entries;
+#ifdef Q_OS_UNIX
+        const auto encodedPath = QFile::encodeName(absolutePath);
+        DIR *dir = opendir(encodedPath.constData());
+        if (!dir)
+            return entries;
+        while (const auto *entry = readdir(dir)) {
+            const auto name = QFile::decodeName(entry->d_name);
+            if (name.startsWith('.')) {
+                entries.hasIgnoreFiles |= isIgnoreFile(name);
+                continue;
+            }
+
+            auto type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                // Symbolic links to files are listed, symbolic links to directories are not followed.
+                const auto entryPath = encodedPath + '/' + entry->d_name;
+                struct stat status;
+                if (lstat(entryPath.constData(), &status) != 0)
+                    continue;
+                if (S_ISLNK(status.st_mode))
+                    type = stat(entryPath.constData(), &status) == 0 && S_ISREG(status.st_mode) ? DT_REG : DT_UNKNOWN;
+                else
+                    type = S_ISDIR(status.st_mode) ? DT_DIR : (S_ISREG(status.st_mode) ? DT_REG : DT_UNKNOWN);
+            }
+            if (type == DT_DIR)
+                entries.directories.push_back(name);
+            else if (type == DT_REG)
+                entries.files.push_back(name);
+        }
+        closedir(dir);
+#else
+        QDirIterator it(absolutePath, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden);
+        while (it.hasNext()) {
+            it.next();
+            const auto fi = it.fileInfo();
+            const auto name = fi.fileName();
+            if (name.startsWith('.') || fi.isHidden()) {
+                entries.hasIgnoreFiles |= isIgnoreFile(name);
+                continue;
+            }
+            if (fi.isDir()) {
+                if (!fi.isSymLink())
+                    entries.directories.push_back(name);
+            } else if (fi.isFile()) {
+                entries.files.push_back(name);
+            }
+        }
+#endif
+        return entries;
+    }
+
+    QString childPath(const QString &path, const QString &name)
+    {
+        return path.isEmpty() ? name : path + '/' + name;
+    }
+
+    QString parentPath(const QString &path)
+    {
+        const auto slash = path.lastIndexOf('/');
+        return slash == -1 ? QString() : path.left(slash);
+    }
+
+    QStringList readIgnoreFiles(const QString &absolutePath)
+    {
+        QStringList lines;
+        for (const auto *fileName : IgnoreFileNames) {
+            QFile file(absolutePath + '/' + QLatin1String(fileName));
+            if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+                lines.append(QString::fromUtf8(file.readAll()).split('\n'));
+        }
+        return lines;
+    }
+
+    // Rules of `path`, the parent rules if it doesn't have ignore files.
+    DirectoryWalker::Rules makeRules(const QString &path, const QString &absolutePath,
+                                     const DirectoryWalker::Rules &parentRules)
+    {
+        auto lines = readIgnoreFiles(absolutePath);
+        if (lines.isEmpty())
+            return parentRules;
+        auto rules = std::make_shared<DirectoryWalker::IgnoreRules>();
+        rules->parent = parentRules;
+        rules->path = path;
+        rules->patterns = parsePatterns(lines);
+        rules->lines = std::move(lines);
+        return rules;
+    }
+
+    struct ListedDirectory
+    {
+        DirectoryWalker::Directory directory;
+        DirectoryWalker::Rules rules;
+    };
+
+    ListedDirectory listDirectory(const QString &root, const QString &path, const DirectoryWalker::Rules &parentRules)
+    {
+        const auto absolutePath = path.isEmpty() ? root : root + '/' + path;
+        ListedDirectory result;
+        result.directory.path = path;
+        result.directory.lastModified = QFileInfo(absolutePath).lastModified();
+        auto entries = readDirectory(absolutePath);
+
+        result.rules = entries.hasIgnoreFiles ? makeRules(path, absolutePath, parentRules) : parentRules;
+        const auto *rules = result.rules.get();
+        for (const auto &name : std::as_const(entries.files)) {
+            auto filePath = childPath(path, name);
+            if (!rules || !rules->isIgnored(filePath, name, false))
+                result.directory.files.push_back(std::move(filePath));
+        }
+        for (const auto &name : std::as_const(entries.directories)) {
+            auto directoryPath = childPath(path, name);
+            if (!rules || !rules->isIgnored(directoryPath, name, true))
+                result.directory.subDirectories.push_back(std::move(directoryPath));
+        }
+        return result;
+    }
+
+    // One queue per thread: a thread takes its own work from the back, and steals from the front of the others.
+    class WorkQueues
+    {
+    public:
+        struct Work
+        {
+            QString path;
+            DirectoryWalker::Rules parentRules;
+        };
+
+        explicit WorkQueues(int count)
+            : m_queues(count)
+        {
+        }
+
+        void push(int queue, Work work)
+        {
+            ++m_pending;
+            {
+                std::scoped_lock lock(m_queues[queue].mutex);
+                m_queues[queue].works.push_back(std::move(work));
+            }
+            wakeUp(false);
+        }
+
+        // Blocks until some work is available, returns nothing once all the directories are listed.
+        std::optional<Work> next(int queue)
+        {
+            std::unique_lock lock(m_waitMutex);
+            while (true) {
+                const auto wakeUps = m_wakeUps;
+                lock.unlock();
+                if (auto work = take(queue))
+                    return work;
+                lock.lock();
+                // A push done after reading `wakeUps` changes it, so its notification is not lost.
+                m_condition.wait(lock, [&] { return m_wakeUps != wakeUps || m_pending == 0; });
+                if (m_pending == 0)
+                    return {};
+            }
+        }
+
+        // Called once a directory is listed, after its sub-directories are pushed.
+        void done()
+        {
+            if (--m_pending == 0)
+                wakeUp(true);
+        }
+
+    private:
+        std::optional<Work> take(int queue)
+        {
+            const auto count = static_cast<int>(m_queues.size());
+            for (int i = 0; i < count; ++i) {
+                auto &current = m_queues[(queue + i) % count];
+                std::scoped_lock lock(current.mutex);
+                if (current.works.empty())
+                    continue;
+                Work work;
+                if (i == 0) {
+                    work = std::move(current.works.back());
+                    current.works.pop_back();
+                } else {
+                    work = std::move(current.works.front());
+                    current.works.pop_front();
+                }
+                return work;
+            }
+            return {};
+        }
+
+        void wakeUp(bool all)
+        {
+            {
+                std::scoped_lock lock(m_waitMutex);
+                ++m_wakeUps;
+            }
+            if (all)
+                m_condition.notify_all();
+            else
+                m_condition.notify_one();
+        }
+
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Work> works;
+        };
+        std::vector<Queue> m_queues;
+        std::atomic<int> m_pending = 0;
+        std::mutex m_waitMutex;
+        std::condition_variable m_condition;
+        quint64 m_wakeUps = 0;
+    };
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// DirectoryWalker
+///////////////////////////////////////////////////////////////////////////////
+DirectoryWalker::DirectoryWalker(QString root, const QStringList &excludes)
+    : m_root(std::move(root))
+{
+    setExcludes(excludes);
+}
+
+DirectoryWalker::~DirectoryWalker() = default;
+
+const QString &DirectoryWalker::root() const
+{
+    return m_root;
+}
+
+const QStringList &DirectoryWalker::excludes() const
+{
+    return m_excludes;
+}
+
+// The rules of all directories inherit the exclude rules, they are all read again.
+bool DirectoryWalker::setExcludes(const QStringList &excludes)
+{
+    if (excludes == m_excludes)
+        return false;
+
+    m_excludes = excludes;
+    m_excludeRules.reset();
+    m_rules.clear();
+    if (!excludes.isEmpty()) {
+        auto rules = std::make_shared<IgnoreRules>();
+        rules->patterns = parsePatterns(excludes);
+        rules->lines = excludes;
+        m_excludeRules = std::move(rules);
+    }
+    return true;
+}
+
+DirectoryWalker::Rules DirectoryWalker::parentRulesFor(const QString &path)
+{
+    return path.isEmpty() ? m_excludeRules : rulesFor(parentPath(path));
+}
+
+DirectoryWalker::Rules DirectoryWalker::rulesFor(const QString &path)
+{
+    const auto it = m_rules.constFind(path);
+    if (it != m_rules.cend())
+        return *it;
+
+    auto rules = makeRules(path, path.isEmpty() ? m_root : m_root + '/' + path, parentRulesFor(path));
+    m_rules.insert(path, rules);
+    return rules;
+}
+
+QList<DirectoryWalker::Directory> DirectoryWalker::walk(const QString &path)
+{
+    auto *pool = QThreadPool::globalInstance();
+    const auto threadCount = std::max(pool->maxThreadCount(), 1);
+
+    WorkQueues queues(threadCount);
+    std::vector<QList<ListedDirectory>> results(threadCount);
+    queues.push(0, {.path = path, .parentRules = parentRulesFor(path)});
+
+    auto work = [&](int index) {
+        while (auto next = queues.next(index)) {
+            auto listed = listDirectory(m_root, next->path, next->parentRules);
+            for (const auto &subDirectory : std::as_const(listed.directory.subDirectories))
+                queues.push(index, {.path = subDirectory, .parentRules = listed.rules});
+            results[index].push_back(std::move(listed));
+            queues.done();
+        }
+    };
+
+    // The calling thread works too, and workers are only started on idle threads of the pool: the walk doesn't wait for
+    // the jobs already running, and can be called from a thread of the pool. Queues without a worker stay empty.
+    QSemaphore finishedWorkers;
+    int workerCount = 0;
+    for (int i = 1; i < threadCount; ++i) {
+        const bool started = pool->tryStart([&work, &finishedWorkers, i]() {
+            work(i);
+            finishedWorkers.release();
+        });
+        if (!started)
+            break;
+        ++workerCount;
+    }
+    work(0);
+    finishedWorkers.acquire(workerCount);
+
+    QList<Directory> directories;
+    for (auto &threadResults : results) {
+        for (auto &listed : threadResults) {
+            m_rules.insert(listed.directory.path, std::move(listed.rules));
+            directories.push_back(std::move(listed.directory));
+        }
+    }
+    return directories;
+}
+
+DirectoryWalker::Directory DirectoryWalker::list(const QString &path)
+{
+    auto listed = listDirectory(m_root, path, parentRulesFor(path));
+    m_rules.insert(path, std::move(listed.rules));
+    return listed.directory;
+}
+
+bool DirectoryWalker::reloadIgnoreFiles(const QString &path)
+{
+    const auto it = m_rules.constFind(path);
+    if (it == m_rules.cend())
+        return false;
+
+    const auto &rules = *it;
+    const auto ownLines = rules && rules->path == path && rules != m_excludeRules ? rules->lines : QStringList();
+    const auto lines = readIgnoreFiles(path.isEmpty() ? m_root : m_root + '/' + path);
+    if (lines == ownLines)
+        return false;
+
+    m_rules.remove(path);
+    return true;
+}
+
+void DirectoryWalker::removeDirectory(const QString &path)
+{
+    m_rules.remove(path);
+}
+
+} // namespace Core
@@ -0,0 +1,82 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <memory>
+
+namespace Core {
+
+/**
+ * \brief Lists the files of a directory tree, honoring the ignore files
+ *
+ * The directories are listed in parallel on the global thread pool: each thread has its own queue of directories to
+ * list, and takes directories from the other queues when its own is empty. On Unix, directories are read with
+ * `readdir`, which gets the entries in batches with their types, so most entries are listed without a `stat`.
+ *
+ * Hidden files and directories are skipped, and symbolic links to directories are not followed, the same as a
+ * QDirIterator. Files and directories matching a pattern of a `.gitignore` or `.knutignore` file, or of the exclude
+ * list given, are skipped too. The patterns use the gitignore syntax, the exclude list applies from the root and has
+ * the lowest priority.
+ *
+ * All paths are relative to the root, the root itself is the empty string.
+ */
+class DirectoryWalker
+{
+public:
+    struct Directory
+    {
+        QString path;
+        QStringList files;
+        QStringList subDirectories;
+        // Read before listing the directory, so any later change gives a different value.
+        QDateTime lastModified;
+    };
+
+    explicit DirectoryWalker(QString root, const QStringList &excludes = {});
+    ~DirectoryWalker();
+
+    const QString &root() const;
+
+    const QStringList &excludes() const;
+    // Returns true if the exclude list changed: the directories already listed must be listed again.
+    bool setExcludes(const QStringList &excludes);
+
+    // Lists `path` and all its sub-directories, the directories are returned in no particular order.
+    // The walker itself is not thread-safe, it must only be used by one thread at a time.
+    QList<Directory> walk(const QString &path = {});
+    // Lists `path` only.
+    Directory list(const QString &path);
+
+    // Reads the ignore files of `path` again, returns true if they changed: its sub-directories must be listed again.
+    bool reloadIgnoreFiles(const QString &path);
+    // Forgets the ignore files read for `path`, when it's removed.
+    void removeDirectory(const QString &path);
+
+    struct IgnoreRules;
+    using Rules = std::shared_ptr<const IgnoreRules>;
+
+private:
+    Rules rulesFor(const QString &path);
+    Rules parentRulesFor(const QString &path);
+
+    const QString m_root;
+    QStringList m_excludes;
+    Rules m_excludeRules;
+    // Rules applying in each directory listed, directories without ignore files share the rules of their parent.
+    QHash<QString, Rules> m_rules;
+};
+
+} // namespace Core
@@ -152,6 +152,9 @@ void Document::clearChangedOnDisk()
 
 void Document::reload()
 {
+    // The file is read on the next access anyway.
+    if (!m_loaded)
+        return;
     doLoad(m_fileName);
     clearChangedOnDisk();
     emit fileUpdated();
@@ -205,6 +208,7 @@ bool Document::saveAs(const QString &fileName)
         spdlog::error("{}: fileName is empty", FUNCTION_NAME);
         return false;
     }
+    ensureLoaded();
 
     const bool isNewName = m_fileName != fileName;
     if (isNewName) {
@@ -242,12 +246,107 @@ void Document::close()
         return;
     if (m_hasChanged)
         save();
+    if (m_loaded) {
+        didClose();
+        m_fileName.clear();
+    } else {
+        // Nothing to free anymore, the document is empty. The file name is cleared first, so the change isn't taken for
+        // a reload.
+        m_fileName.clear();
+        m_loaded = true;
+        emit loadedChanged();
+    }
+}
+
+bool Document::isLoaded() const
+{
+    return m_loaded;
+}
+
+// Only documents without changes can be unloaded, as they are loaded again from the file. By default, documents can't
+// be unloaded, the ones supporting it reimplement canUnload and doUnload.
+bool Document::canUnload() const
+{
+    return false;
+}
+
+bool Document::unload()
+{
+    if (!m_loaded || !canUnload())
+        return false;
     didClose();
-    m_fileName.clear();
+    doUnload();
+    m_loaded = false;
+    emit loadedChanged();
+    return true;
+}
+
+bool Document::loadLater(const QString &fileName)
+{
+    if (fileName.isEmpty() || !m_fileName.isEmpty())
+        return false;
+    m_fileName = fileName;
+    if (!canUnload()) {
+        m_fileName.clear();
+        return false;
+    }
+    m_lastModified = QFileInfo(m_fileName).lastModified();
+    m_loaded = false;
+    emit fileNameChanged();
+    return true;
+}
+
+void Document::ensureLoaded()
+{
+    if (m_loaded)
+        return;
+    m_loaded = true;
+    doLoad(m_fileName);
+    clearChangedOnDisk();
+    didOpen();
+    emit loadedChanged();
+}
+
+qint64 Document::memoryUsage() const
+{
+    return 0;
+}
+
+std::optional<Document::SaveSnapshot> Document::saveSnapshot() const
+{
+    // An unloaded document has no changes to save.
+    if (m_fileName.isEmpty() || !m_loaded)
+        return {};
+    auto write = doSaveSnapshot(m_fileName);
+    if (!write)
+        return {};
+    return SaveSnapshot {.write = std::move(write), .changeCount = m_changeCount};
+}
+
+bool Document::finishSave(const SaveSnapshot &snapshot, const QString &errorString)
+{
+    if (!errorString.isEmpty()) {
+        setErrorString(errorString);
+        spdlog::error("{} - Can't save file {}: {}", FUNCTION_NAME, m_fileName, errorString);
+        return false;
+    }
+    if (snapshot.changeCount == m_changeCount)
+        setHasChanged(false);
+    const QFileInfo fi(m_fileName);
+    m_lastModified = fi.lastModified();
+    return true;
+}
+
+std::function<QString()> Document::doSaveSnapshot(const QString &fileName) const
+{
+    Q_UNUSED(fileName)
+    return {};
 }
 
 void Document::setHasChanged(bool newHasChanged)
 {
+    if (newHasChanged)
+        ++m_changeCount;
     if (m_hasChanged == newHasChanged)
         return;
     m_hasChanged = newHasChanged;
@@ -14,6 +14,8 @@
 
 #include <QDateTime>
 #include <QObject>
+#include <functional>
+#include <optional>
 
 namespace Core {
 
@@ -64,6 +66,32 @@ public:
     void clearChangedOnDisk();
     void reload();
 
+    // Unloading frees the content of an unchanged document, it is loaded again from the file on the next access.
+    // This is used by the project to stay within its memory budget.
+    bool isLoaded() const;
+    virtual bool canUnload() const;
+    bool unload();
+    void ensureLoaded();
+    // Opens `fileName` without reading it, the document is loaded on first access. Returns false if the document can't
+    // be unloaded.
+    bool loadLater(const QString &fileName);
+    // Approximate memory used by the content of the document, in bytes.
+    virtual qint64 memoryUsage() const;
+
+    // Saving in two steps, so many documents can be written in parallel, see Project::saveAllDocuments.
+    struct SaveSnapshot
+    {
+        // Writes the content the document had when the snapshot was taken, and returns an error message on failure.
+        // Can run on any thread.
+        std::function<QString()> write;
+        quint64 changeCount = 0;
+    };
+    // Returns nothing if the document can't be saved in the background, save() must be used instead.
+    std::optional<SaveSnapshot> saveSnapshot() const;
+    // Called on the main thread once the snapshot is written, with the error returned by `write`. The document is
+    // unchanged afterward only if it wasn't changed since the snapshot was taken.
+    bool finishSave(const SaveSnapshot &snapshot, const QString &errorString);
+
 public slots:
     bool load(const QString &fileName);
     bool save();
@@ -76,6 +104,8 @@ signals:
     void errorStringChanged();
     void hasChangedChanged();
     void fileUpdated();
+    // Emitted when the document is unloaded, and when it's loaded again.
+    void loadedChanged();
 
 protected:
     virtual bool doSave(const QString &fileName) = 0;
@@ -84,6 +114,12 @@ protected:
     virtual void didOpen() { }
     virtual void didClose() { }
 
+    // Frees the content of the document, called after didClose.
+    virtual void doUnload() { }
+
+    // Returns a function writing the current content to `fileName` from any thread, see saveSnapshot.
+    virtual std::function<QString()> doSaveSnapshot(const QString &fileName) const;
+
     void setHasChanged(bool newHasChanged);
     void setErrorString(const QString &error);
 
@@ -95,6 +131,9 @@ private:
     Type m_type;
     QString m_errorString;
     bool m_hasChanged = false;
+    bool m_loaded = true;
+    // Number of changes since the document was created, tells if it changed while saving.
+    quint64 m_changeCount = 0;
 
     // Members used for refreshing file after external changes
     QDateTime m_lastModified;
@@ -0,0 +1,141 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "documentloader.h"
+#include "cppdocument.h"
+#include "settings.h"
+#include "treesitter/parser.h"
+#include "treesitter/tree.h"
+
+#include <QFileInfo>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace Core {
+
+namespace {
+    DocumentLoader::File loadFile(const QString &fileName, std::optional<Document::Type> type,
+                                  QStringConverter::Encoding encoding,
+                                  const std::optional<QRegularExpression> &excludedMacros)
+    {
+        DocumentLoader::File file {.fileName = fileName,
+                                   .content = TextDocument::readFile(fileName, encoding),
+                                   .tree = std::nullopt};
+        if (!file.content.errorString.isEmpty() || !type || !treesitter::Parser::hasLanguage(*type))
+            return file;
+
+        // The document replaces the line endings when setting its text.
+        auto text = file.content.text;
+        text.replace("\r\n", "\n");
+
+        auto &parser = treesitter::Parser::threadParser(*type);
+        QList<treesitter::Range> includedRanges;
+        if (*type == Document::Type::Cpp && excludedMacros.has_value())
+            includedRanges = CppDocument::includedRanges(text, excludedMacros.value());
+        if (!parser.setIncludedRanges(includedRanges))
+            return file;
+
+        if (auto tree = parser.parseString(text)) {
+            file.tree = CodeDocument::PreloadedTree {
+                .text = std::move(text), .includedRanges = std::move(includedRanges), .tree = std::move(*tree)};
+        }
+        return file;
+    }
+}
+
+void DocumentLoader::setProgressCallback(std::function<void(int, int)> callback)
+{
+    m_progressCallback = std::move(callback);
+}
+
+void DocumentLoader::cancel()
+{
+    m_canceled = true;
+}
+
+void DocumentLoader::run(const QStringList &fileNames, const std::function<void(File &)> &loaded)
+{
+    m_canceled = false;
+
+    // The settings are only read on the main thread.
+    const auto mimeTypes = Settings::instance()->value<std::map<std::string, Document::Type>>(Settings::MimeTypes);
+    const auto encoding = static_cast<QStringConverter::Encoding>(DEFAULT_VALUE(TextDocument::Encoding, Encoding));
+    const auto excludedMacros = CppDocument::excludedMacrosExpression();
+
+    std::vector<std::optional<Document::Type>> types;
+    types.reserve(fileNames.size());
+    for (const auto &fileName : fileNames) {
+        const auto it = mimeTypes.find(QFileInfo(fileName).suffix().toStdString());
+        types.push_back(it == mimeTypes.end() ? std::nullopt : std::optional(it->second));
+    }
+
+    // Files are queued when ready, and taken by the main thread. The condition is also signaled when a worker is done,
+    // so the main thread knows when no file will come anymore.
+    std::mutex mutex;
+    std::condition_variable readyCondition;
+    std::vector<File> readyFiles;
+
+    std::atomic<int> nextFile = 0;
+    const auto fileCount = static_cast<int>(fileNames.size());
+    auto *pool = QThreadPool::globalInstance();
+    const auto workerCount = std::min(std::max(pool->maxThreadCount(), 1), fileCount);
+    int runningWorkers = workerCount;
+    QSemaphore finishedWorkers;
+    for (int i = 0; i < workerCount; ++i) {
+        pool->start([&]() {
+            for (int index = nextFile++; index < fileCount && !m_canceled; index = nextFile++) {
+                auto file = loadFile(fileNames.at(index), types[index], encoding, excludedMacros);
+                {
+                    std::lock_guard lock(mutex);
+                    readyFiles.push_back(std::move(file));
+                }
+                readyCondition.notify_one();
+            }
+            {
+                std::lock_guard lock(mutex);
+                --runningWorkers;
+                readyCondition.notify_one();
+            }
+            finishedWorkers.release();
+        });
+    }
+
+    int processedFiles = 0;
+    std::vector<File> files;
+    while (true) {
+        {
+            std::unique_lock lock(mutex);
+            readyCondition.wait(lock, [&readyFiles, &runningWorkers]() {
+                return !readyFiles.empty() || runningWorkers == 0;
+            });
+            if (readyFiles.empty())
+                break;
+            files.swap(readyFiles);
+        }
+        for (auto &file : files) {
+            if (m_canceled)
+                break;
+            loaded(file);
+            ++processedFiles;
+        }
+        files.clear();
+        if (m_progressCallback)
+            m_progressCallback(processedFiles, fileCount);
+    }
+    finishedWorkers.acquire(workerCount);
+}
+
+} // namespace Core
@@ -0,0 +1,60 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include "codedocument.h"
+#include "document.h"
+#include "textdocument.h"
+
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <functional>
+#include <optional>
+
+namespace Core {
+
+/**
+ * \brief Reads and parses files in parallel, so documents can be loaded without doing it on the main thread
+ *
+ * The files are read and decoded on the global thread pool, the same way a TextDocument reads them. The files with a
+ * tree-sitter grammar are parsed too, C++ files excluding the CppExcludedMacros, each thread of the pool keeping its
+ * own parsers.
+ *
+ * Files are handed to the main thread as soon as they are ready, so documents can be created while the other files are
+ * still read.
+ */
+class DocumentLoader
+{
+public:
+    struct File
+    {
+        QString fileName;
+        TextDocument::FileContent content;
+        // Only for the types with a grammar, if the file could be parsed.
+        std::optional<CodeDocument::PreloadedTree> tree;
+    };
+
+    // Called regularly on the calling thread while loading, with the number of files ready so far.
+    void setProgressCallback(std::function<void(int ready, int total)> callback);
+
+    // Blocks until all files are processed. `loaded` is called on the calling thread for each file, in no particular
+    // order, as soon as it's ready. Must be called from the main thread.
+    void run(const QStringList &fileNames, const std::function<void(File &file)> &loaded);
+    // Stops reading new files, can be called from `loaded`. The files not handed to `loaded` yet are dropped.
+    void cancel();
+
+private:
+    std::function<void(int, int)> m_progressCallback;
+    std::atomic<bool> m_canceled = false;
+};
+
+} // namespace Core
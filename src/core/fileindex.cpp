@@ -0,0 +1,303 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "fileindex.h"
+#include "utils/log.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSet>
+#include <algorithm>
+#include <utility>
+
+namespace Core {
+
+// Same as QFileInfo::suffix, without creating a QFileInfo.
+static QString fileExtension(const QString &path)
+{
+    const auto fileStart = path.lastIndexOf('/') + 1;
+    const auto dot = path.lastIndexOf('.');
+    return dot >= fileStart ? path.mid(dot + 1) : QString();
+}
+
+// Same as QFileInfo::completeBaseName, in lower case.
+static QString fileBaseNameKey(const QString &path)
+{
+    const auto fileStart = path.lastIndexOf('/') + 1;
+    const auto dot = path.lastIndexOf('.');
+    return (dot >= fileStart ? path.mid(fileStart, dot - fileStart) : path.mid(fileStart)).toLower();
+}
+
+FileIndex::FileIndex(QString root, const QStringList &excludes, QObject *parent)
+    : QObject(parent)
+    , m_walker(std::move(root), excludes)
+    , m_watcher(new QFileSystemWatcher(this))
+{
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, [this](const QString &path) {
+        m_changedDirectories.insert(path);
+    });
+}
+
+FileIndex::~FileIndex() = default;
+
+const QString &FileIndex::root() const
+{
+    return m_walker.root();
+}
+
+void FileIndex::setExcludes(const QStringList &excludes)
+{
+    if (m_walker.setExcludes(excludes))
+        m_indexed = false;
+}
+
+QString FileIndex::absolutePath(const QString &path) const
+{
+    return path.isEmpty() ? root() : root() + '/' + path;
+}
+
+void FileIndex::ensureIndexed()
+{
+    if (m_indexed && m_watched) {
+        updateChangedDirectories();
+        return;
+    }
+
+    if (m_watcher && !m_watcher->directories().isEmpty())
+        m_watcher->removePaths(m_watcher->directories());
+    m_directories.clear();
+    m_changedDirectories.clear();
+    m_filesByExtension.clear();
+    m_filesByBaseName.clear();
+    m_allFiles.reset();
+    addDirectory({});
+    m_indexed = true;
+    emit indexReset();
+}
+
+// The watcher notifications are only handled when the event loop runs, which may be after the running script or
+// C++ call: the modification times of the directories tell which ones changed since they were listed.
+void FileIndex::updateChangedDirectories()
+{
+    QSet<QString> changedDirectories = std::exchange(m_changedDirectories, {});
+    for (auto it = m_directories.cbegin(); it != m_directories.cend(); ++it) {
+        const auto path = absolutePath(it.key());
+        if (!it->lastModified.isValid() || QFileInfo(path).lastModified() != it->lastModified)
+            changedDirectories.insert(path);
+    }
+
+    // Parents first, a removed directory is handled once with all its sub-directories.
+    QStringList paths(changedDirectories.cbegin(), changedDirectories.cend());
+    std::ranges::sort(paths);
+    for (const auto &path : std::as_const(paths))
+        updateDirectory(path);
+
+    if (!paths.isEmpty()) {
+        const QDir rootDir(root());
+        for (auto &path : paths) {
+            path = rootDir.relativeFilePath(path);
+            if (path == ".")
+                path.clear();
+        }
+        emit directoriesChanged(paths);
+    }
+}
+
+void FileIndex::setDirectory(const QString &path, DirectoryWalker::Directory directory)
+{
+    // The file system only updates the modification time every few milliseconds: a directory modified just before it
+    // was listed could be modified again without changing it, it's listed again until its modification time is old
+    // enough.
+    constexpr qint64 TimestampResolution = 2000;
+    if (directory.lastModified.isValid()
+        && directory.lastModified.msecsTo(QDateTime::currentDateTime()) < TimestampResolution)
+        directory.lastModified = {};
+    m_directories.insert(path,
+                         {.files = std::move(directory.files),
+                          .subDirectories = std::move(directory.subDirectories),
+                          .lastModified = directory.lastModified});
+}
+
+// Lists `path` and all its sub-directories.
+void FileIndex::addDirectory(const QString &path)
+{
+    auto directories = m_walker.walk(path);
+    QStringList absolutePaths;
+    absolutePaths.reserve(directories.size());
+    for (auto &directory : directories) {
+        for (const auto &file : std::as_const(directory.files))
+            addFile(file);
+        absolutePaths.push_back(absolutePath(directory.path));
+        const auto directoryPath = directory.path;
+        setDirectory(directoryPath, std::move(directory));
+    }
+    watchDirectories(absolutePaths);
+}
+
+void FileIndex::watchDirectories(const QStringList &paths)
+{
+    if (!m_watched || paths.isEmpty())
+        return;
+
+    const auto failedPaths = m_watcher->addPaths(paths);
+    if (!failedPaths.isEmpty()) {
+        // Most likely the system limit of watched directories, changes can't be followed anymore.
+        spdlog::warn("{}: Can't watch {}, the project files will be listed on each use", FUNCTION_NAME,
+                     failedPaths.first());
+        m_watched = false;
+        m_watcher->deleteLater();
+        m_watcher = nullptr;
+    }
+}
+
+void FileIndex::removeDirectory(const QString &path)
+{
+    const auto directory = m_directories.take(path);
+    for (const auto &file : directory.files)
+        removeFile(file);
+    for (const auto &subDirectory : directory.subDirectories)
+        removeDirectory(subDirectory);
+    m_walker.removeDirectory(path);
+    if (m_watcher)
+        m_watcher->removePath(absolutePath(path));
+}
+
+// Only this directory is listed again, changes in its sub-directories are notified separately.
+void FileIndex::updateDirectory(const QString &absolutePath)
+{
+    const auto path = QDir(root()).relativeFilePath(absolutePath);
+    const auto key = path == "." ? QString() : path;
+    auto it = m_directories.find(key);
+    if (it == m_directories.end())
+        return;
+
+    if (!QFileInfo(absolutePath).isDir()) {
+        removeDirectory(key);
+        return;
+    }
+
+    // New ignore files can change what is ignored in all sub-directories.
+    if (m_walker.reloadIgnoreFiles(key)) {
+        removeDirectory(key);
+        addDirectory(key);
+        return;
+    }
+
+    const auto oldDirectory = *it;
+    auto listed = m_walker.list(key);
+    const auto oldFiles = QSet<QString>(oldDirectory.files.cbegin(), oldDirectory.files.cend());
+    const auto newFiles = QSet<QString>(listed.files.cbegin(), listed.files.cend());
+    for (const auto &file : oldDirectory.files) {
+        if (!newFiles.contains(file))
+            removeFile(file);
+    }
+    for (const auto &file : std::as_const(listed.files)) {
+        if (!oldFiles.contains(file))
+            addFile(file);
+    }
+
+    const auto subDirectories = listed.subDirectories;
+    setDirectory(key, std::move(listed));
+    for (const auto &subDirectory : oldDirectory.subDirectories) {
+        if (!subDirectories.contains(subDirectory))
+            removeDirectory(subDirectory);
+    }
+    for (const auto &subDirectory : subDirectories) {
+        if (!oldDirectory.subDirectories.contains(subDirectory))
+            addDirectory(subDirectory);
+    }
+}
+
+void FileIndex::addFile(const QString &path)
+{
+    auto &files = m_filesByExtension[fileExtension(path)];
+    files.paths.insert(path);
+    files.sorted.reset();
+    auto &baseNameFiles = m_filesByBaseName[fileBaseNameKey(path)];
+    baseNameFiles.paths.insert(path);
+    baseNameFiles.sorted.reset();
+    m_allFiles.reset();
+}
+
+void FileIndex::removeFromGroup(QHash<QString, Files> &groups, const QString &key, const QString &path)
+{
+    const auto it = groups.find(key);
+    if (it == groups.end())
+        return;
+    it->paths.remove(path);
+    if (it->paths.isEmpty())
+        groups.erase(it);
+    else
+        it->sorted.reset();
+}
+
+void FileIndex::removeFile(const QString &path)
+{
+    removeFromGroup(m_filesByExtension, fileExtension(path), path);
+    removeFromGroup(m_filesByBaseName, fileBaseNameKey(path), path);
+    m_allFiles.reset();
+}
+
+const QStringList &FileIndex::sortedFiles(Files &files)
+{
+    if (!files.sorted) {
+        QStringList paths(files.paths.cbegin(), files.paths.cend());
+        std::ranges::sort(paths);
+        files.sorted = std::move(paths);
+    }
+    return *files.sorted;
+}
+
+QStringList FileIndex::allFiles()
+{
+    ensureIndexed();
+
+    if (!m_allFiles) {
+        QStringList files;
+        for (const auto &extensionFiles : std::as_const(m_filesByExtension)) {
+            for (const auto &path : extensionFiles.paths)
+                files.push_back(path);
+        }
+        std::ranges::sort(files);
+        m_allFiles = std::move(files);
+    }
+    return *m_allFiles;
+}
+
+QStringList FileIndex::filesWithExtensions(const QStringList &extensions, Qt::CaseSensitivity caseSensitivity)
+{
+    ensureIndexed();
+
+    QStringList files;
+    int groupCount = 0;
+    for (auto it = m_filesByExtension.begin(); it != m_filesByExtension.end(); ++it) {
+        if (extensions.contains(it.key(), caseSensitivity)) {
+            files.append(sortedFiles(it.value()));
+            ++groupCount;
+        }
+    }
+    // Each group is already sorted.
+    if (groupCount > 1)
+        std::ranges::sort(files);
+    return files;
+}
+
+QStringList FileIndex::filesWithBaseName(const QString &baseName)
+{
+    ensureIndexed();
+
+    const auto it = m_filesByBaseName.find(baseName.toLower());
+    if (it == m_filesByBaseName.end())
+        return {};
+    return sortedFiles(it.value());
+}
+
+} // namespace Core
@@ -0,0 +1,104 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include "directorywalker.h"
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <optional>
+
+class QFileSystemWatcher;
+
+namespace Core {
+
+/**
+ * \brief In-memory index of all the files of a project, grouped by extension and by base name
+ *
+ * The index is built on first use, then kept up to date: each getter lists again the directories notified by the
+ * file system watcher, and the directories whose modification time changed, so changes not notified yet are taken
+ * into account without processing events. Files are listed by a DirectoryWalker, so the ignored files are not in the
+ * index.
+ *
+ * All paths are relative to the root, and the lists returned are sorted.
+ */
+class FileIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    FileIndex(QString root, const QStringList &excludes, QObject *parent = nullptr);
+    ~FileIndex() override;
+
+    const QString &root() const;
+    // The index is built again on next use if the exclude list changed.
+    void setExcludes(const QStringList &excludes);
+
+    QStringList allFiles();
+    QStringList filesWithExtensions(const QStringList &extensions, Qt::CaseSensitivity caseSensitivity);
+    // Files named `baseName` followed by any extension, the base name is compared case insensitively.
+    QStringList filesWithBaseName(const QString &baseName);
+
+signals:
+    // The files of `paths`, relative to the root, may have changed since they were last listed.
+    void directoriesChanged(const QStringList &paths);
+    // The index was built again, any file may have changed.
+    void indexReset();
+
+private:
+    struct Directory
+    {
+        QStringList files;
+        QStringList subDirectories;
+        // Invalid while the directory may still change without changing its modification time.
+        QDateTime lastModified;
+    };
+    struct Files
+    {
+        // A set, so removing a file from a large group is fast. The sorted list is built on first use.
+        QSet<QString> paths;
+        std::optional<QStringList> sorted;
+    };
+
+    void ensureIndexed();
+    void updateChangedDirectories();
+    void setDirectory(const QString &path, DirectoryWalker::Directory directory);
+    void addDirectory(const QString &path);
+    void removeDirectory(const QString &path);
+    void updateDirectory(const QString &absolutePath);
+    void watchDirectories(const QStringList &paths);
+
+    void addFile(const QString &path);
+    void removeFile(const QString &path);
+    static void removeFromGroup(QHash<QString, Files> &groups, const QString &key, const QString &path);
+    const QStringList &sortedFiles(Files &files);
+
+    QString absolutePath(const QString &path) const;
+
+    DirectoryWalker m_walker;
+    QFileSystemWatcher *m_watcher = nullptr;
+    bool m_indexed = false;
+    // Without the watcher (too many directories to watch), the index is built again on each use.
+    bool m_watched = true;
+
+    // Keys are the paths relative to the root, the root itself is the empty string.
+    QHash<QString, Directory> m_directories;
+    // Absolute paths of the directories notified by the watcher since the last update.
+    QSet<QString> m_changedDirectories;
+    QHash<QString, Files> m_filesByExtension;
+    // Keys are the base names in lower case, as in QFileInfo::completeBaseName.
+    QHash<QString, Files> m_filesByBaseName;
+    std::optional<QStringList> m_allFiles;
+};
+
+} // namespace Core
@@ -0,0 +1,332 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "findinfiles.h"
+
+#include <QFile>
+#include <QHash>
+#include <QPromise>
+#include <QStringDecoder>
+#include <QThreadPool>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace Core {
+
+namespace {
+    QList<FindInFiles::Match> searchFile(const QString &fileName, const QRegularExpression &regexp,
+                                         const QByteArray &requiredLiteral)
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return {};
+        const auto data = file.readAll();
+
+        QString text;
+        const auto encoding = QStringConverter::encodingForData(data);
+        if (encoding && encoding != QStringConverter::Utf8) {
+            // UTF-16 and UTF-32 files, with a byte order mark, contain null bytes: decode them before searching.
+            text = QStringDecoder(*encoding).decode(data);
+            if (!requiredLiteral.isEmpty() && !text.contains(QString::fromUtf8(requiredLiteral)))
+                return {};
+        } else {
+            // The prefilter runs on the raw content, most files are skipped without decoding them.
+            if (!requiredLiteral.isEmpty() && !data.contains(requiredLiteral))
+                return {};
+            if (data.contains('\0'))
+                return {};
+            // Same as in a document, the byte order mark is not part of the text.
+            text = QStringDecoder(QStringConverter::Utf8).decode(data);
+        }
+
+        QList<FindInFiles::Match> matches;
+        // Lines are counted incrementally, matches are returned in order.
+        int line = 1;
+        qsizetype lineStart = 0;
+        qsizetype position = 0;
+        auto it = regexp.globalMatch(text);
+        while (it.hasNext()) {
+            const auto match = it.next();
+            const auto start = match.capturedStart();
+            for (; position < start; ++position) {
+                if (text.at(position) == '\n') {
+                    ++line;
+                    lineStart = position + 1;
+                }
+            }
+            auto lineEnd = text.indexOf('\n', lineStart);
+            if (lineEnd == -1)
+                lineEnd = text.size();
+            if (lineEnd > lineStart && text.at(lineEnd - 1) == '\r')
+                --lineEnd;
+            matches.push_back({.fileName = fileName,
+                               .line = line,
+                               .column = static_cast<int>(start - lineStart) + 1,
+                               .text = match.captured(),
+                               .lineText = text.mid(lineStart, lineEnd - lineStart)});
+        }
+        return matches;
+    }
+
+    // State of a search, shared by its workers.
+    struct Search
+    {
+        QRegularExpression regexp;
+        QByteArray requiredLiteral;
+        QStringList fileNames;
+        QPromise<FindInFiles::Match> promise;
+        // No limit if 0.
+        int maxResults = 0;
+        int resultCount = 0;
+        std::mutex resultMutex;
+        std::atomic<bool> full = false;
+        std::atomic<int> nextFile = 0;
+        std::atomic<int> processedFiles = 0;
+        std::atomic<int> runningWorkers = 0;
+    };
+
+    // Returns false if the maximum number of results is reached before all `matches` are added, the file isn't counted
+    // as searched then. Once the maximum is reached, the workers stop.
+    bool addResults(Search &search, QList<FindInFiles::Match> matches)
+    {
+        std::lock_guard lock(search.resultMutex);
+        bool added = true;
+        if (search.maxResults > 0 && matches.size() > search.maxResults - search.resultCount) {
+            matches.resize(search.maxResults - search.resultCount);
+            added = false;
+        }
+        search.resultCount += static_cast<int>(matches.size());
+        if (!matches.isEmpty())
+            search.promise.addResults(matches);
+        if (search.resultCount == search.maxResults)
+            search.full = true;
+        return added;
+    }
+
+    // Each worker takes the next file until there are none left.
+    void startWorkers(const std::shared_ptr<Search> &search)
+    {
+        const auto fileCount = static_cast<int>(search->fileNames.size());
+        search->promise.setProgressRange(0, fileCount);
+        if (fileCount == 0 || search->promise.isCanceled()) {
+            search->promise.finish();
+            return;
+        }
+
+        auto *pool = QThreadPool::globalInstance();
+        const auto workerCount = std::min(std::max(pool->maxThreadCount(), 1), fileCount);
+        search->runningWorkers = workerCount;
+        for (int i = 0; i < workerCount; ++i) {
+            pool->start([search, fileCount]() {
+                for (int index = search->nextFile++;
+                     index < fileCount && !search->promise.isCanceled() && !search->full;
+                     index = search->nextFile++) {
+                    const auto matches =
+                        searchFile(search->fileNames.at(index), search->regexp, search->requiredLiteral);
+                    if (!matches.isEmpty() && !addResults(*search, matches))
+                        break;
+                    search->promise.setProgressValue(++search->processedFiles);
+                }
+                if (--search->runningWorkers == 0)
+                    search->promise.finish();
+            });
+        }
+    }
+}
+
+FindInFiles::FindInFiles(const QString &pattern)
+    : m_regexp(pattern, QRegularExpression::MultilineOption | QRegularExpression::DotMatchesEverythingOption)
+    , m_requiredLiteral(extractRequiredLiteral(pattern))
+{
+    // The expression is shared by all threads, compile it once.
+    m_regexp.optimize();
+}
+
+bool FindInFiles::isValid() const
+{
+    return m_regexp.isValid();
+}
+
+QString FindInFiles::errorString() const
+{
+    return m_regexp.errorString();
+}
+
+const QByteArray &FindInFiles::requiredLiteral() const
+{
+    return m_requiredLiteral;
+}
+
+// Conservative: any text returned is in all matches, but it's not always the longest one. Alternations, inline flags
+// and groups are not analyzed, a pattern using them may have no literal.
+QByteArray FindInFiles::extractRequiredLiteral(const QString &pattern)
+{
+    if (pattern.contains('|'))
+        return {};
+    for (auto index = pattern.indexOf("(?"); index != -1; index = pattern.indexOf("(?", index + 1)) {
+        if (pattern.mid(index + 2, 1) != ":")
+            return {};
+    }
+
+    QString best;
+    QString current;
+    auto flush = [&]() {
+        if (current.size() > best.size())
+            best = current;
+        current.clear();
+    };
+    auto skipTo = [&pattern](qsizetype index, QChar end) {
+        for (++index; index < pattern.size() && pattern.at(index) != end; ++index) {
+            if (pattern.at(index) == '\\')
+                ++index;
+        }
+        return index;
+    };
+
+    int groupDepth = 0;
+    for (qsizetype i = 0; i < pattern.size(); ++i) {
+        const auto c = pattern.at(i);
+        if (c == '\\') {
+            if (i + 1 >= pattern.size())
+                break;
+            const auto next = pattern.at(++i);
+            // Character classes (\s, \d...), anchors (\b...) and escape sequences (\n, \x41...) are not literals.
+            if (next.isLetterOrNumber())
+                flush();
+            else if (groupDepth == 0)
+                current += next;
+        } else if (c == '*' || c == '?' || c == '{') {
+            // The previous character is optional.
+            current.chop(1);
+            flush();
+            if (c == '{')
+                i = skipTo(i, '}');
+        } else if (c == '+') {
+            flush();
+        } else if (c == '[') {
+            flush();
+            // A `]` right after the `[` or `[^` is part of the set.
+            auto start = i + 1;
+            if (start < pattern.size() && pattern.at(start) == '^')
+                ++start;
+            if (start < pattern.size() && pattern.at(start) == ']')
+                ++start;
+            i = skipTo(start - 1, ']');
+        } else if (c == '(') {
+            flush();
+            ++groupDepth;
+        } else if (c == ')') {
+            flush();
+            groupDepth = std::max(groupDepth - 1, 0);
+        } else if (c == '.' || c == '^' || c == '$') {
+            flush();
+        } else if (groupDepth == 0) {
+            current += c;
+        }
+    }
+    flush();
+    return best.toUtf8();
+}
+
+void FindInFiles::setProgressCallback(std::function<void(int, int)> callback)
+{
+    m_progressCallback = std::move(callback);
+}
+
+void FindInFiles::setMaxResults(int maxResults)
+{
+    m_maxResults = std::max(maxResults, 0);
+}
+
+int FindInFiles::maxResults() const
+{
+    return m_maxResults;
+}
+
+void FindInFiles::cancel()
+{
+    m_canceled = true;
+}
+
+bool FindInFiles::isCanceled() const
+{
+    return m_canceled;
+}
+
+QList<FindInFiles::Match> FindInFiles::run(const QStringList &fileNames)
+{
+    if (!isValid())
+        return {};
+
+    auto future = start(fileNames);
+    while (!future.isFinished()) {
+        if (m_canceled)
+            future.cancel();
+        if (m_progressCallback)
+            m_progressCallback(future.progressValue(), static_cast<int>(fileNames.size()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (m_progressCallback)
+        m_progressCallback(future.progressValue(), static_cast<int>(fileNames.size()));
+
+    // Sort by file, the matches of each file are already sorted by position.
+    QHash<QString, qsizetype> fileIndexes;
+    for (qsizetype i = 0; i < fileNames.size(); ++i)
+        fileIndexes.insert(fileNames.at(i), i);
+    auto matches = future.results();
+    std::ranges::stable_sort(matches, {}, [&fileIndexes](const Match &match) {
+        return fileIndexes.value(match.fileName);
+    });
+    return matches;
+}
+
+QFuture<FindInFiles::Match> FindInFiles::start(const QStringList &fileNames) const
+{
+    auto search = std::make_shared<Search>();
+    search->regexp = m_regexp;
+    search->requiredLiteral = m_requiredLiteral;
+    search->maxResults = m_maxResults;
+    search->fileNames = fileNames;
+    auto future = search->promise.future();
+
+    search->promise.start();
+    if (!isValid()) {
+        search->promise.finish();
+        return future;
+    }
+    startWorkers(search);
+    return future;
+}
+
+QFuture<FindInFiles::Match> FindInFiles::start(std::function<QStringList()> fileNames) const
+{
+    auto search = std::make_shared<Search>();
+    search->regexp = m_regexp;
+    search->requiredLiteral = m_requiredLiteral;
+    search->maxResults = m_maxResults;
+    auto future = search->promise.future();
+
+    search->promise.start();
+    if (!isValid()) {
+        search->promise.finish();
+        return future;
+    }
+    QThreadPool::globalInstance()->start([search, fileNames = std::move(fileNames)]() {
+        if (!search->promise.isCanceled())
+            search->fileNames = fileNames();
+        startWorkers(search);
+    });
+    return future;
+}
+
+} // namespace Core
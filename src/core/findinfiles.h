@@ -0,0 +1,95 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QFuture>
+#include <QList>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <functional>
+
+namespace Core {
+
+/**
+ * \brief Searches a regular expression in many files in parallel
+ *
+ * The files are read and searched on the global thread pool. The search is multiline: the regular expression is run on
+ * the whole content of a file, `.` matches newlines, and `^` and `$` match at the start and end of each line.
+ *
+ * Before running the regular expression on a file, its content is searched for a literal text that any match must
+ * contain, extracted from the pattern. Most files don't contain it, and are skipped without decoding them or running
+ * the regular expression. Files containing a null byte are considered binary, and skipped.
+ *
+ * Files are read as UTF-8, except files starting with a UTF-16 or UTF-32 byte order mark, which are decoded first.
+ * Columns are counted in UTF-16 code units, like positions in a document, not in bytes.
+ */
+class FindInFiles
+{
+public:
+    struct Match
+    {
+        QString fileName;
+        // 1-based, column in UTF-16 code units (QChar), like in a document.
+        int line;
+        int column;
+        QString text;
+        // Text of the line where the match starts, for previews.
+        QString lineText;
+    };
+
+    explicit FindInFiles(const QString &pattern);
+
+    bool isValid() const;
+    QString errorString() const;
+
+    // Literal text any match contains, empty if none could be extracted from the pattern.
+    const QByteArray &requiredLiteral() const;
+
+    // Called regularly on the calling thread while searching, with the number of files processed so far.
+    void setProgressCallback(std::function<void(int processed, int total)> callback);
+
+    // The search stops once `maxResults` matches are found, the other matches are dropped. 0, the default, means no
+    // limit.
+    void setMaxResults(int maxResults);
+    int maxResults() const;
+
+    // Stops processing new files, can be called from any thread.
+    void cancel();
+    bool isCanceled() const;
+
+    // Blocks until all files are searched, or the search is canceled, then returns the matches, sorted by file in the
+    // order of `fileNames` and by position in each file.
+    QList<Match> run(const QStringList &fileNames);
+
+    // Searches in the background and returns immediately. The matches of each file are added to the future as soon as
+    // the file is searched, so the files are in no particular order. Canceling the future stops the search, the
+    // progress of the future is the number of files searched: if the search stopped at the maximum number of results,
+    // the progress stays below the progress maximum.
+    // The search doesn't depend on this object, which can be destroyed while it runs.
+    QFuture<Match> start(const QStringList &fileNames) const;
+    // Same as above, `fileNames` is called on a thread of the global thread pool to get the files to search, so it can
+    // take time without blocking the calling thread.
+    QFuture<Match> start(std::function<QStringList()> fileNames) const;
+
+    static QByteArray extractRequiredLiteral(const QString &pattern);
+
+private:
+    QRegularExpression m_regexp;
+    QByteArray m_requiredLiteral;
+    std::function<void(int, int)> m_progressCallback;
+    int m_maxResults = 0;
+    std::atomic<bool> m_canceled = false;
+};
+
+} // namespace Core
@@ -136,4 +136,11 @@ bool JsonDocument::doSave(const QString &fileName)
     return false;
 }
 
+std::function<QString()> JsonDocument::doSaveSnapshot(const QString &fileName) const
+{
+    // The json data is reloaded after saving, this needs the main thread.
+    Q_UNUSED(fileName)
+    return {};
+}
+
 } // namespace Core
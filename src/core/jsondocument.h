@@ -45,6 +45,7 @@ public slots:
 protected:
     bool doSave(const QString &fileName) override;
     bool doLoad(const QString &fileName) override;
+    std::function<QString()> doSaveSnapshot(const QString &fileName) const override;
 
 private:
     bool loadJsonData(const QString &fileName);
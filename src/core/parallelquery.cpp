@@ -0,0 +1,202 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "parallelquery.h"
+#include "cppdocument.h"
+#include "document.h"
+#include "settings.h"
+#include "textdocument.h"
+#include "treesitter/parser.h"
+#include "treesitter/predicates.h"
+#include "treesitter/query.h"
+#include "treesitter/tree.h"
+#include "utils/log.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSemaphore>
+#include <QTextStream>
+#include <QThreadPool>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace Core {
+
+namespace {
+    struct FileQuery
+    {
+        QString fileName;
+        Document::Type type;
+        std::shared_ptr<treesitter::Query> query;
+    };
+
+    struct FileResult
+    {
+        QList<ParallelQuery::Match> matches;
+        // Errors are reported by the calling thread once all files are queried, in the order of the files, and not in
+        // whatever order the threads finish.
+        QString error;
+    };
+
+    FileResult queryFile(const FileQuery &file, QStringConverter::Encoding encoding,
+                         const std::optional<QRegularExpression> &excludedMacros)
+    {
+        QFile qfile(file.fileName);
+        if (!qfile.open(QIODevice::ReadOnly)) {
+            return {.matches = {}, .error = qfile.errorString()};
+        }
+
+        // Read the text the same way TextDocument does, so the positions are the same as in a document.
+        const auto data = qfile.readAll();
+        QTextStream stream(data);
+        stream.setEncoding(encoding);
+        auto text = stream.readAll();
+        text.replace("\r\n", "\n");
+
+        auto &parser = treesitter::Parser::threadParser(file.type);
+        QList<treesitter::Range> includedRanges;
+        if (file.type == Document::Type::Cpp && excludedMacros.has_value()) {
+            includedRanges = CppDocument::includedRanges(text, excludedMacros.value());
+        }
+        parser.setIncludedRanges(includedRanges);
+
+        const auto tree = parser.parseString(text);
+        if (!tree.has_value()) {
+            return {.matches = {}, .error = "Failed to parse the file"};
+        }
+
+        treesitter::QueryCursor cursor;
+        cursor.execute(file.query, tree->rootNode(), std::make_unique<treesitter::Predicates>(text));
+
+        FileResult result;
+        while (const auto match = cursor.nextMatch()) {
+            ParallelQuery::Match fileMatch {.fileName = file.fileName, .captures = {}};
+            fileMatch.captures.reserve(match->captures().size());
+            for (const auto &capture : match->captures()) {
+                const auto &node = capture.node;
+                fileMatch.captures.push_back(
+                    {.name = file.query->captureAt(capture.id).name,
+                     .start = static_cast<int>(node.startPosition()),
+                     .end = static_cast<int>(node.endPosition()),
+                     .line = static_cast<int>(node.startPoint().row) + 1,
+                     .column = static_cast<int>(node.startPoint().column / sizeof(QChar)) + 1,
+                     .text = node.textIn(text)});
+            }
+            result.matches.push_back(std::move(fileMatch));
+        }
+        return result;
+    }
+}
+
+ParallelQuery::ParallelQuery(QString query)
+    : m_query(std::move(query))
+{
+}
+
+void ParallelQuery::setProgressCallback(std::function<void(int, int)> callback)
+{
+    m_progressCallback = std::move(callback);
+}
+
+void ParallelQuery::cancel()
+{
+    m_canceled = true;
+}
+
+bool ParallelQuery::isCanceled() const
+{
+    return m_canceled;
+}
+
+QList<ParallelQuery::Match> ParallelQuery::run(const QStringList &fileNames)
+{
+    // The settings are only read on the main thread.
+    const auto mimeTypes = Settings::instance()->value<std::map<std::string, Document::Type>>(Settings::MimeTypes);
+    const auto encoding = static_cast<QStringConverter::Encoding>(DEFAULT_VALUE(TextDocument::Encoding, Encoding));
+    const auto excludedMacros = CppDocument::excludedMacrosExpression();
+
+    // Compile the query once per language, it's then shared by all threads.
+    std::unordered_map<Document::Type, std::shared_ptr<treesitter::Query>> queries;
+    std::vector<FileQuery> files;
+    files.reserve(fileNames.size());
+    for (const auto &fileName : fileNames) {
+        const auto mimeType = mimeTypes.find(QFileInfo(fileName).suffix().toStdString());
+        if (mimeType == mimeTypes.end() || !treesitter::Parser::hasLanguage(mimeType->second)) {
+            continue;
+        }
+
+        const auto type = mimeType->second;
+        auto it = queries.find(type);
+        if (it == queries.end()) {
+            std::shared_ptr<treesitter::Query> query;
+            try {
+                query = std::make_shared<treesitter::Query>(treesitter::Parser::getLanguage(type), m_query);
+            } catch (treesitter::Query::Error &error) {
+                spdlog::error("{}: Failed to parse query `{}` error: {} at: {}", FUNCTION_NAME, m_query,
+                              error.description, error.utf8_offset);
+            }
+            if (query && !query->parameters().isEmpty()) {
+                spdlog::error("{}: Query parameters can't be bound in query `{}`", FUNCTION_NAME, m_query);
+                query.reset();
+            }
+            it = queries.emplace(type, std::move(query)).first;
+        }
+        if (it->second) {
+            files.push_back({.fileName = fileName, .type = type, .query = it->second});
+        }
+    }
+
+    // Each worker takes the next file until there are none left, the results are stored by file index.
+    std::vector<FileResult> results(files.size());
+    std::atomic<int> nextFile = 0;
+    std::atomic<int> processedFiles = 0;
+    const auto fileCount = static_cast<int>(files.size());
+
+    auto *pool = QThreadPool::globalInstance();
+    const auto workerCount = std::min(std::max(pool->maxThreadCount(), 1), fileCount);
+    QSemaphore finishedWorkers;
+    for (int i = 0; i < workerCount; ++i) {
+        pool->start([&]() {
+            for (int index = nextFile++; index < fileCount && !m_canceled; index = nextFile++) {
+                results[index] = queryFile(files[index], encoding, excludedMacros);
+                ++processedFiles;
+            }
+            finishedWorkers.release();
+        });
+    }
+
+    while (!finishedWorkers.tryAcquire(workerCount, 50)) {
+        if (m_progressCallback) {
+            m_progressCallback(processedFiles, fileCount);
+        }
+    }
+    if (m_progressCallback) {
+        m_progressCallback(processedFiles, fileCount);
+    }
+
+    QList<Match> matches;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!results[i].error.isEmpty()) {
+            spdlog::warn("{}: Can't query {}: {}", FUNCTION_NAME, files[i].fileName, results[i].error);
+        }
+        matches.append(std::move(results[i].matches));
+    }
+    if (m_canceled) {
+        spdlog::info("{}: Query canceled after {} files out of {}", FUNCTION_NAME, processedFiles.load(), fileCount);
+    }
+    return matches;
+}
+
+} // namespace Core
@@ -0,0 +1,69 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <functional>
+
+namespace Core {
+
+/**
+ * \brief Runs a tree-sitter query on many files in parallel, without creating documents
+ *
+ * The files are read and parsed on the global thread pool. Each thread keeps its own parsers, so they are reused
+ * between files and between runs. Only the query is shared between threads, tree-sitter queries being immutable.
+ *
+ * The files are read the same way as a TextDocument reads them, and C++ files exclude the CppExcludedMacros, so the
+ * positions are the same as in a document opened on the file.
+ */
+class ParallelQuery
+{
+public:
+    struct Capture
+    {
+        QString name;
+        int start;
+        int end;
+        // 1-based, column in characters.
+        int line;
+        int column;
+        QString text;
+    };
+
+    struct Match
+    {
+        QString fileName;
+        QList<Capture> captures;
+    };
+
+    explicit ParallelQuery(QString query);
+
+    // Called regularly on the calling thread while the query runs, with the number of files processed so far.
+    void setProgressCallback(std::function<void(int processed, int total)> callback);
+
+    // Stops processing new files, can be called from any thread.
+    void cancel();
+    bool isCanceled() const;
+
+    // Blocks until all files are processed, or the query is canceled, then returns the matches, sorted by file in the
+    // order of `fileNames` and by position in each file. Must be called from the main thread.
+    QList<Match> run(const QStringList &fileNames);
+
+private:
+    QString m_query;
+    std::function<void(int, int)> m_progressCallback;
+    std::atomic<bool> m_canceled = false;
+};
+
+} // namespace Core
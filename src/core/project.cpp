@@ -12,27 +12,36 @@
 #include "cppdocument.h"
 #include "csharpdocument.h"
 #include "dartdocument.h"
+#include "documentloader.h"
+#include "fileindex.h"
+#include "findinfiles.h"
 #include "imagedocument.h"
 #include "jsondocument.h"
 #include "logger.h"
 #include "lsp/client.h"
+#include "parallelquery.h"
 #include "project_p.h"
 #include "qmldocument.h"
 #include "qttsdocument.h"
+#include "querycache.h"
 #include "qtuidocument.h"
 #include "rcdocument.h"
 #include "rustdocument.h"
+#include "scriptdialogitem.h"
 #include "settings.h"
 #include "slintdocument.h"
 #include "textdocument.h"
+#include "trigramindex.h"
 #include "utils/log.h"
 
+#include <QCryptographicHash>
 #include <QDir>
-#include <QDirIterator>
 #include <QFileInfo>
 #include <QMetaEnum>
-#include <QProcess>
+#include <QRegularExpression>
+#include <QSet>
 #include <QStandardPaths>
+#include <QThreadPool>
 #include <algorithm>
 #include <kdalgorithms.h>
 #include <map>
@@ -103,6 +112,9 @@ bool Project::setRoot(const QString &newRoot)
     spdlog::info("{}: {}", FUNCTION_NAME, dir.absolutePath());
 
     m_root = dir.absolutePath();
+    m_queryCache.reset();
+    m_fileIndex.reset();
+    m_trigramIndex.reset();
     Settings::instance()->loadProjectSettings(m_root);
     for (auto client : m_lspClients | std::views::values)
         client->openProject(m_root);
@@ -111,6 +123,91 @@ bool Project::setRoot(const QString &newRoot)
     return true;
 }
 
+QueryCache *Project::queryCache()
+{
+    if (m_root.isEmpty() || !DEFAULT_VALUE(bool, QueryCacheEnabled))
+        return nullptr;
+
+    if (!m_queryCache) {
+        auto directory = DEFAULT_VALUE(QString, QueryCacheDirectory);
+        if (directory.isEmpty()) {
+            // One cache per project root, in the user cache location.
+            const auto rootKey = QCryptographicHash::hash(m_root.toUtf8(), QCryptographicHash::Sha1).toHex();
+            directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/queries/"
+                + QString::fromLatin1(rootKey);
+        } else {
+            directory = QDir(m_root).absoluteFilePath(directory);
+        }
+        spdlog::debug("{}: Using query cache in {}", FUNCTION_NAME, directory);
+        m_queryCache = std::make_unique<QueryCache>(directory);
+    }
+    return m_queryCache.get();
+}
+
+FileIndex *Project::fileIndex() const
+{
+    // The settings can change at any time, the exclude list is read again on each use.
+    const auto excludes = DEFAULT_VALUE(QStringList, ExcludedFiles);
+    if (!m_fileIndex)
+        m_fileIndex = std::make_unique<FileIndex>(m_root, excludes);
+    else
+        m_fileIndex->setExcludes(excludes);
+    return m_fileIndex.get();
+}
+
+QStringList Project::fromRelativePaths(QStringList paths, PathType type) const
+{
+    if (type == FullPath) {
+        const QDir dir(m_root);
+        for (auto &path : paths)
+            path = dir.filePath(path);
+    }
+    return paths;
+}
+
+std::function<QStringList()> Project::filesToSearch(const FindInFiles &findInFiles) const
+{
+    auto files = fileIndex()->allFiles();
+    if (!DEFAULT_VALUE(bool, SearchIndexEnabled)) {
+        return [files = fromRelativePaths(std::move(files), FullPath)]() {
+            return files;
+        };
+    }
+
+    if (!m_trigramIndex) {
+        auto directory = DEFAULT_VALUE(QString, SearchIndexDirectory);
+        if (directory.isEmpty()) {
+            // One index per project root, in the user cache location.
+            const auto rootKey = QCryptographicHash::hash(m_root.toUtf8(), QCryptographicHash::Sha1).toHex();
+            directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/search/"
+                + QString::fromLatin1(rootKey);
+        } else {
+            directory = QDir(m_root).absoluteFilePath(directory);
+        }
+        spdlog::debug("{}: Using search index in {}", FUNCTION_NAME, directory);
+        m_trigramIndex = std::make_shared<TrigramIndex>(m_root, directory + "/trigrams.idx");
+        // Only the files in the directories changed are checked before a search.
+        std::weak_ptr<TrigramIndex> weakIndex = m_trigramIndex;
+        connect(m_fileIndex.get(), &FileIndex::directoriesChanged, m_fileIndex.get(),
+                [weakIndex](const QStringList &paths) {
+                    if (auto index = weakIndex.lock())
+                        index->invalidate(paths);
+                });
+        connect(m_fileIndex.get(), &FileIndex::indexReset, m_fileIndex.get(), [weakIndex]() {
+            if (auto index = weakIndex.lock())
+                index->invalidateAll();
+        });
+    }
+    // Updating the index reads all the files changed since the last search, it's done when the function is called.
+    return [index = m_trigramIndex, files = std::move(files), literal = findInFiles.requiredLiteral(),
+            root = QDir(m_root)]() {
+        auto candidates = index->candidates(files, literal);
+        for (auto &path : candidates)
+            path = root.filePath(path);
+        return candidates;
+    };
+}
+
 /*!
  * \qmlmethod array<string> Project::allFiles(PathType type = RelativeToRoot)
  * Returns all files in the current project.
@@ -118,6 +215,9 @@ bool Project::setRoot(const QString &newRoot)
  *
  * - `Project.FullPath`
  * - `Project.RelativeToRoot`
+ *
+ * Files ignored by a `.gitignore` or `.knutignore` file, or by the `project/excluded_files` setting, are not
+ * returned. This applies to `allFilesWithExtension` and `allFilesWithExtensions` too.
  */
 QStringList Project::allFiles(PathType type) const
 {
@@ -126,17 +226,7 @@ QStringList Project::allFiles(PathType type) const
 
     LOG(type);
 
-    QDir dir(m_root);
-    QDirIterator it(m_root, QDirIterator::Subdirectories);
-    QStringList result;
-    while (it.hasNext()) {
-        it.next();
-        auto fi = it.fileInfo();
-        if (fi.isFile())
-            result.push_back(type == FullPath ? fi.absoluteFilePath() : dir.relativeFilePath(fi.absoluteFilePath()));
-    }
-    std::ranges::sort(result);
-    return result;
+    return fromRelativePaths(fileIndex()->allFiles(), type);
 }
 
 /*!
@@ -154,17 +244,7 @@ QStringList Project::allFilesWithExtension(const QString &extension, PathType ty
 
     LOG(extension, type);
 
-    QDir dir(m_root);
-    QDirIterator it(m_root, QDirIterator::Subdirectories);
-    QStringList result;
-    while (it.hasNext()) {
-        it.next();
-        auto fi = it.fileInfo();
-        if (fi.isFile() && fi.suffix() == extension)
-            result.push_back(type == FullPath ? fi.absoluteFilePath() : dir.relativeFilePath(fi.absoluteFilePath()));
-    }
-    std::ranges::sort(result);
-    return result;
+    return fromRelativePaths(fileIndex()->filesWithExtensions({extension}, Qt::CaseSensitive), type);
 }
 
 /*!
@@ -182,16 +262,55 @@ QStringList Project::allFilesWithExtensions(const QStringList &extensions, PathT
 
     LOG(extensions, type);
 
-    QDir dir(m_root);
-    QDirIterator it(m_root, QDirIterator::Subdirectories);
-    QStringList result;
-    while (it.hasNext()) {
-        it.next();
-        auto fi = it.fileInfo();
-        if (fi.isFile() && extensions.contains(fi.suffix(), Qt::CaseInsensitive))
-            result.push_back(type == FullPath ? fi.absoluteFilePath() : dir.relativeFilePath(fi.absoluteFilePath()));
+    return fromRelativePaths(fileIndex()->filesWithExtensions(extensions, Qt::CaseInsensitive), type);
+}
+
+QStringList Project::filesWithBaseName(const QString &baseName, PathType type) const
+{
+    if (m_root.isEmpty())
+        return {};
+
+    return fromRelativePaths(fileIndex()->filesWithBaseName(baseName), type);
+}
+
+/*!
+ * \qmlmethod array<object> Project::headerSourcePairs(PathType type = RelativeToRoot)
+ * Returns all C++ headers of the current project with their corresponding source, as objects with the `header` and
+ * `source` properties. Headers without a source are not returned.
+ * `type` defines the type of path, and can be one of those values:
+ *
+ * - `Project.FullPath`
+ * - `Project.RelativeToRoot`
+ *
+ * The pairs are the same as the ones returned by `CppDocument::correspondingHeaderSource`, but computed at once and
+ * without opening any document.
+ */
+QVariantList Project::headerSourcePairs(PathType type)
+{
+    if (m_root.isEmpty())
+        return {};
+
+    LOG(type);
+
+    auto *index = fileIndex();
+    QStringList headers;
+    QStringList sources;
+    const auto allHeaders = index->filesWithExtensions(CppDocument::fileSuffixes(true), Qt::CaseInsensitive);
+    for (const auto &header : allHeaders) {
+        const auto candidates = index->filesWithBaseName(QFileInfo(header).completeBaseName());
+        auto source = CppDocument::findHeaderSource(header, candidates);
+        if (!source.isEmpty()) {
+            headers.push_back(header);
+            sources.push_back(std::move(source));
+        }
     }
-    std::ranges::sort(result);
+    headers = fromRelativePaths(std::move(headers), type);
+    sources = fromRelativePaths(std::move(sources), type);
+
+    QVariantList result;
+    result.reserve(headers.size());
+    for (qsizetype i = 0; i < headers.size(); ++i)
+        result.append(QVariantMap {{"header", headers.at(i)}, {"source", sources.at(i)}});
     return result;
 }
 
@@ -264,43 +383,199 @@ Lsp::Client *Project::getClient(Document::Type type)
     return nullptr;
 }
 
-const QList<Document *> &Project::documents() const
+QList<Document *> Project::documents() const
 {
-    return m_documents;
+    return QList<Document *>(m_documents.cbegin(), m_documents.cend());
 }
 
-Document *Project::getDocument(QString fileName, bool moveToBack)
+// Paths are compared once cleaned (no `.`, `..` or duplicated separators), and case-insensitively on Windows.
+QString Project::documentKey(const QString &fileName)
 {
-    QFileInfo fi(fileName);
-    if (!fi.exists() && fi.isRelative())
-        fileName = m_root + '/' + fileName;
-    else
-        fileName = fi.absoluteFilePath();
+#if defined(Q_OS_WIN)
+    return QDir::cleanPath(fileName).toCaseFolded();
+#else
+    return QDir::cleanPath(fileName);
+#endif
+}
 
-    auto findIt = std::ranges::find_if(m_documents, [fileName](auto document) {
-        return document->fileName() == fileName;
+void Project::addDocument(Document *document)
+{
+    const auto it = m_documents.insert(m_documents.end(), document);
+    const auto key = documentKey(document->fileName());
+    m_documentsByPath.insert(key, it);
+    m_documentEntries.insert(document, {.it = it, .key = key});
+    if (document->isLoaded()) {
+        m_loadedDocuments.insert(document, m_documentUseCount);
+        ++m_documentLoadsSinceBudgetCheck;
+    }
+    connect(document, &Document::fileNameChanged, this, [this, document]() {
+        updateDocumentPath(document);
+    });
+    // Unloaded documents are loaded again on their next access, which may not go through the project.
+    connect(document, &Document::loadedChanged, this, [this, document]() {
+        if (document->fileName().isEmpty()) {
+            // The document is closed, it won't be loaded again.
+            m_loadedDocuments.remove(document);
+        } else if (document->isLoaded()) {
+            m_loadedDocuments.insert(document, m_documentUseCount);
+            ++m_documentLoadsSinceBudgetCheck;
+            ++m_reloadedDocumentCount;
+        } else {
+            m_loadedDocuments.remove(document);
+        }
     });
+}
+
+// Unloads the least recently used documents until the loaded documents fit in the memory budget. The current document,
+// the kept documents (the one being returned by getDocument, the ones being preloaded) and the documents with changes
+// are never unloaded.
+qint64 Project::applyMemoryBudget(const QSet<const Document *> &keptDocuments)
+{
+    m_documentLoadsSinceBudgetCheck = 0;
+    const auto budget = static_cast<qint64>(DEFAULT_VALUE(int, DocumentMemoryBudget)) * 1024 * 1024;
+    if (budget <= 0)
+        return 0;
+
+    struct Usage
+    {
+        Document *document;
+        quint64 lastUse;
+        qint64 memory;
+    };
+    std::vector<Usage> usages;
+    usages.reserve(m_loadedDocuments.size());
+    qint64 total = 0;
+    for (auto it = m_loadedDocuments.cbegin(); it != m_loadedDocuments.cend(); ++it) {
+        const auto memory = it.key()->memoryUsage();
+        total += memory;
+        usages.push_back({.document = it.key(), .lastUse = it.value(), .memory = memory});
+    }
+    if (total <= budget)
+        return total;
+
+    // Unload a bit more than needed, so the next documents don't unload one document each.
+    const auto target = budget - budget / 10;
+    std::ranges::sort(usages, {}, &Usage::lastUse);
+    int unloaded = 0;
+    for (const auto &usage : usages) {
+        if (total <= target)
+            break;
+        if (usage.document == m_current || keptDocuments.contains(usage.document))
+            continue;
+        if (usage.document->unload()) {
+            total -= usage.memory;
+            ++unloaded;
+        }
+    }
+    m_unloadedDocumentCount += unloaded;
+    spdlog::debug("{}: {} documents unloaded, {} MB used by the documents", FUNCTION_NAME, unloaded,
+                  total / (1024 * 1024));
+    return total;
+}
 
+void Project::updateDocumentPath(Document *document)
+{
+    auto documentEntryIt = m_documentEntries.find(document);
+    if (documentEntryIt == m_documentEntries.end())
+        return;
+    auto &entry = documentEntryIt.value();
+
+    const auto oldKey = std::exchange(entry.key, documentKey(document->fileName()));
+    const auto entryIt = entry.it;
+
+    // The old key may be used by another document, saved with the same name.
+    if (auto it = m_documentsByPath.find(oldKey); it != m_documentsByPath.end() && *it.value() == document) {
+        m_documentsByPath.erase(it);
+        if (m_sharedDocumentKeys.contains(oldKey)) {
+            // Another document with this name may still be open, it's found again.
+            for (auto other = m_documentEntries.cbegin(); other != m_documentEntries.cend(); ++other) {
+                if (other.key() != document && other->key == oldKey) {
+                    m_documentsByPath.insert(oldKey, other->it);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (auto it = m_documentsByPath.find(entry.key); it != m_documentsByPath.end() && *it.value() != document) {
+        // The renamed document overwrote the file of the other one, it's the one returned for this name.
+        spdlog::debug("{}: {} is opened twice", FUNCTION_NAME, document->fileName());
+        m_sharedDocumentKeys.insert(entry.key);
+    }
+    m_documentsByPath.insert(entry.key, entryIt);
+}
+
+// Relative paths are relative to the current directory if the file exists, otherwise to the root.
+QString Project::absoluteDocumentPath(const QString &fileName) const
+{
+    const QFileInfo fi(fileName);
+    if (!fi.exists() && fi.isRelative())
+        return m_root + '/' + fileName;
+    return fi.absoluteFilePath();
+}
+
+Document *Project::addNewDocument(const QString &fileName, const std::function<void(Document *)> &prepare,
+                                  bool loadLater)
+{
+    const auto suffix = QFileInfo(fileName).suffix();
+    auto *doc = createDocument(suffix);
+    if (!doc) {
+        spdlog::error("{}: {} - unknown document type", FUNCTION_NAME, suffix);
+        return nullptr;
+    }
+    if (auto codeDocument = qobject_cast<CodeDocument *>(doc))
+        codeDocument->setLspClient(getClient(doc->type()));
+    doc->setParent(this);
+    if (prepare)
+        prepare(doc);
+    if (!loadLater || !doc->loadLater(fileName))
+        doc->load(fileName);
+    addDocument(doc);
+    return doc;
+}
+
+std::optional<std::list<Document *>::iterator> Project::findDocument(QString &fileName)
+{
+    auto find = [this](const QString &path) {
+        auto it = m_documentsByPath.find(documentKey(path));
+        // A closed document keeps its entry, but doesn't have a file name anymore.
+        if (it != m_documentsByPath.end() && (*it.value())->fileName().isEmpty()) {
+            m_documentsByPath.erase(it);
+            return m_documentsByPath.end();
+        }
+        return it;
+    };
+
+    // Scripts mostly use absolute paths of files already opened, they are found without accessing the file system.
+    auto findIt = QDir::isAbsolutePath(fileName) ? find(fileName) : m_documentsByPath.end();
+    if (findIt == m_documentsByPath.end()) {
+        fileName = absoluteDocumentPath(fileName);
+        findIt = find(fileName);
+    }
+    if (findIt == m_documentsByPath.end())
+        return {};
+    return findIt.value();
+}
+
+Document *Project::getDocument(QString fileName, bool moveToBack)
+{
     Document *doc = nullptr;
 
-    if (findIt != m_documents.end()) {
-        doc = *findIt;
+    if (const auto documentIt = findDocument(fileName)) {
+        doc = **documentIt;
         if (moveToBack)
-            std::rotate(findIt, findIt + 1, m_documents.end());
+            m_documents.splice(m_documents.end(), m_documents, *documentIt);
+        doc->ensureLoaded();
     } else {
-        doc = createDocument(fi.suffix());
-        if (doc) {
-            if (auto codeDocument = qobject_cast<CodeDocument *>(doc))
-                codeDocument->setLspClient(getClient(doc->type()));
-            doc->setParent(this);
-            doc->load(fileName);
-            m_documents.push_back(doc);
-            emit documentsChanged();
-        } else {
-            spdlog::error("{}: {} - unknown document type", FUNCTION_NAME, fi.suffix());
+        doc = addNewDocument(fileName);
+        if (!doc)
             return nullptr;
-        }
+        emit documentsChanged();
     }
+    if (auto it = m_loadedDocuments.find(doc); it != m_loadedDocuments.end())
+        it.value() = ++m_documentUseCount;
+    if (m_documentLoadsSinceBudgetCheck > 0)
+        applyMemoryBudget({doc});
     return doc;
 }
 
@@ -342,6 +617,101 @@ Document *Project::open(const QString &fileName)
     LOG_RETURN("document", m_current);
 }
 
+/*!
+ * \qmlmethod array<Document> Project::preload(array<string> fileNames)
+ * Opens the documents for all `fileNames`, and returns them in the same order. The documents already opened are
+ * returned as is. Relative file names use the root path as the base, like `get`.
+ *
+ * This is a lot faster than calling `get` for each file: the files are read, and parsed for the languages supported by
+ * Tree-sitter, in parallel in the background. When a script is about to process many files, preloading them first
+ * leaves only the transformations to do in the script loop:
+ *
+ * ```js
+ * for (let document of Project.preload(Project.allFilesWithExtension("cpp"))) {
+ *     // ...
+ * }
+ * ```
+ *
+ * !!! note
+ *     This command does not change the current document. When the memory budget is set, see `memoryStatistics`, the
+ *     least recently used documents are unloaded to make room, and preloading stops once the preloaded documents fill
+ *     the budget: the remaining documents are returned unloaded, and loaded when used.
+ */
+QList<Core::Document *> Project::preload(const QStringList &fileNames)
+{
+    LOG(fileNames);
+
+    QStringList newFiles;
+    QSet<QString> newKeys;
+    for (const auto &fileName : fileNames) {
+        const auto path = absoluteDocumentPath(fileName);
+        const auto key = documentKey(path);
+        // Files not existing yet are created by getDocument, there is nothing to read.
+        if (!m_documentsByPath.contains(key) && !newKeys.contains(key) && QFileInfo(path).isFile()) {
+            newKeys.insert(key);
+            newFiles.push_back(path);
+        }
+    }
+
+    if (!newFiles.isEmpty()) {
+        // Loading stops once the documents preloaded fill the memory budget, after unloading the other documents.
+        // The remaining documents are opened without being loaded, they are loaded when used.
+        const auto budget = static_cast<qint64>(DEFAULT_VALUE(int, DocumentMemoryBudget)) * 1024 * 1024;
+        qint64 memoryUsage = 0;
+        if (budget > 0) {
+            for (auto it = m_loadedDocuments.keyBegin(); it != m_loadedDocuments.keyEnd(); ++it)
+                memoryUsage += (*it)->memoryUsage();
+        }
+
+        DocumentLoader loader;
+        loader.setProgressCallback([](int, int) {
+            ScriptDialogItem::updateProgress();
+        });
+        QSet<const Document *> preloadedDocuments;
+        loader.run(newFiles, [&](DocumentLoader::File &file) {
+            auto *document = addNewDocument(file.fileName, [&file](Document *document) {
+                if (auto *textDocument = qobject_cast<TextDocument *>(document))
+                    textDocument->setPreloadedContent(file.fileName, std::move(file.content));
+                if (auto *codeDocument = qobject_cast<CodeDocument *>(document); codeDocument && file.tree)
+                    codeDocument->setPreloadedTree(file.fileName, std::move(*file.tree));
+            });
+            if (!document || budget <= 0)
+                return;
+            preloadedDocuments.insert(document);
+            memoryUsage += document->memoryUsage();
+            if (memoryUsage > budget) {
+                memoryUsage = applyMemoryBudget(preloadedDocuments);
+                if (memoryUsage > budget)
+                    loader.cancel();
+            }
+        });
+        for (const auto &path : std::as_const(newFiles)) {
+            if (!m_documentsByPath.contains(documentKey(path)))
+                addNewDocument(path, {}, true);
+        }
+        emit documentsChanged();
+    }
+
+    QList<Document *> documents;
+    documents.reserve(fileNames.size());
+    for (auto fileName : fileNames) {
+        // The documents are returned as they are, the unloaded ones are loaded again when used.
+        if (const auto documentIt = findDocument(fileName))
+            documents.push_back(**documentIt);
+        else if (auto *document = getDocument(fileName))
+            documents.push_back(document);
+    }
+
+    // The first documents are used first by the script, they are the last ones unloaded.
+    for (auto it = documents.crbegin(); it != documents.crend(); ++it) {
+        if (auto useIt = m_loadedDocuments.find(*it); useIt != m_loadedDocuments.end())
+            useIt.value() = ++m_documentUseCount;
+    }
+    if (m_documentLoadsSinceBudgetCheck > 0)
+        applyMemoryBudget({});
+    return documents;
+}
+
 /*!
  * \qmlmethod Project::closeAll()
  * Close all documents. If the document has some changes, save the changes.
@@ -360,18 +730,56 @@ Core::Document *Project::currentDocument() const
 }
 
 /*!
- * \qmlmethod Project::saveAllDocuments()
- * Save all Documents opened in project.
+ * \qmlmethod bool Project::saveAllDocuments()
+ * Save all Documents opened in project, returns `false` if any of them couldn't be saved.
+ *
+ * The files are written in parallel, each one to a temporary file renamed once complete: a failure never leaves a
+ * truncated file. A document that couldn't be saved keeps its changes, and its `errorString` property is set.
  */
-void Project::saveAllDocuments()
+bool Project::saveAllDocuments()
 {
     LOG();
 
+    struct PendingSave
+    {
+        Document *document;
+        Document::SaveSnapshot snapshot;
+        QString errorString;
+    };
+    std::vector<PendingSave> pendingSaves;
+    int failureCount = 0;
     for (auto d : std::as_const(m_documents)) {
-        if (d->hasChanged()) {
-            d->save();
+        if (!d->hasChanged())
+            continue;
+        // Conflicts with changes on disk need the user, on the main thread.
+        auto snapshot = d->hasChangedOnDisk() ? std::nullopt : d->saveSnapshot();
+        if (snapshot)
+            pendingSaves.push_back({.document = d, .snapshot = std::move(*snapshot), .errorString = {}});
+        else if (!d->save())
+            ++failureCount;
+    }
+
+    if (!pendingSaves.empty()) {
+        // Writing is I/O bound, a few threads are enough: more would only compete for the disk.
+        QThreadPool pool;
+        pool.setMaxThreadCount(std::min(8, static_cast<int>(pendingSaves.size())));
+        for (auto &pendingSave : pendingSaves) {
+            pool.start([&pendingSave]() {
+                pendingSave.errorString = pendingSave.snapshot.write();
+            });
+        }
+        while (!pool.waitForDone(50))
+            ScriptDialogItem::updateProgress();
+
+        for (const auto &pendingSave : pendingSaves) {
+            if (!pendingSave.document->finishSave(pendingSave.snapshot, pendingSave.errorString))
+                ++failureCount;
         }
     }
+
+    if (failureCount > 0)
+        spdlog::error("{} - {} document(s) couldn't be saved", FUNCTION_NAME, failureCount);
+    LOG_RETURN("saved", failureCount == 0);
 }
 
 /*!
@@ -384,17 +792,17 @@ Document *Project::openPrevious(int index)
 {
     LOG(index);
 
-    Q_ASSERT(index < m_documents.size());
-    index = m_documents.size() - index - 1;
-    const QString &fileName = m_documents.at(index)->fileName();
+    Q_ASSERT(index < static_cast<int>(m_documents.size()));
+    const QString &fileName = (*std::next(m_documents.crbegin(), index))->fileName();
 
     LOG_RETURN("document", open(fileName));
 }
 
 /*!
  * \qmlmethod array<object> Project::findInFiles(const QString &pattern)
- * Search for a regex pattern in all files of the current project using ripgrep.
- * Returns a list of results (QVariantMaps) with the document name and position ("file", "line", "column").
+ * Search for a regex pattern in all files of the current project.
+ * Returns a list of results (QVariantMaps) with the document name and position ("file", "line", "column"), and the
+ * text matched ("text").
  *
  * Example usage in QML:
  *
@@ -407,22 +815,18 @@ Document *Project::openPrevious(int index)
  * }
  * ```
  *
- * Note: The method uses ripgrep (rg) for searching, which must be installed and accessible in PATH.
- * The `pattern` parameter should be a valid regular expression.
+ * The `pattern` parameter should be a valid regular expression. The search is multiline: `.` matches newlines, and
+ * `^` and `$` match at the start and end of each line. Files ignored by the project, and binary files (containing a
+ * null byte), are not searched. Files are read as UTF-8, or UTF-16 if they start with a byte order mark. The column
+ * is counted in characters, like in a document, not in bytes.
+ *
+ * On large projects, enable the `search_index` setting to only read the files that may contain the pattern.
  */
 QVariantList Project::findInFiles(const QString &pattern) const
 {
     LOG(pattern);
 
     QVariantList result;
-
-    const QString path = QStandardPaths::findExecutable("rg");
-    if (path.isEmpty()) {
-        spdlog::error("Ripgrep (rg) executable not found. Please ensure that ripgrep is installed and its location is "
-                      "included in the PATH environment variable.");
-        return result;
-    }
-
     if (pattern.trimmed().isEmpty()) {
         return result;
     }
@@ -430,63 +834,178 @@ QVariantList Project::findInFiles(const QString &pattern) const
         return result;
     }
 
-    QProcess process;
-
-    const QStringList arguments {"--vimgrep", "-U", "--multiline-dotall", pattern, m_root};
-
-    process.start(path, arguments);
-    if (!process.waitForFinished()) {
-        spdlog::error("The ripgrep process failed: {}", process.errorString());
+    FindInFiles findInFiles(pattern);
+    if (!findInFiles.isValid()) {
+        spdlog::error("{}: Invalid pattern `{}`: {}", FUNCTION_NAME, pattern, findInFiles.errorString());
         return result;
     }
+    findInFiles.setProgressCallback([](int, int) {
+        ScriptDialogItem::updateProgress();
+    });
+
+    const auto matches = findInFiles.run(filesToSearch(findInFiles)());
+    result.reserve(matches.size());
+    for (const auto &match : matches) {
+        result.append(QVariantMap {{"file", match.fileName},
+                                   {"line", match.line},
+                                   {"column", match.column},
+                                   {"text", match.text}});
+    }
+    return result;
+}
 
-    const QString output = process.readAllStandardOutput();
+QFuture<FindInFiles::Match> Project::findInFilesAsync(const QString &pattern, int maxResults) const
+{
+    if (pattern.trimmed().isEmpty() || m_root.isEmpty())
+        return {};
 
-    const QString errorOutput = process.readAllStandardError();
-    if (!errorOutput.isEmpty()) {
-        spdlog::error("Ripgrep error: {}", errorOutput);
+    FindInFiles findInFiles(pattern);
+    if (!findInFiles.isValid()) {
+        spdlog::error("{}: Invalid pattern `{}`: {}", FUNCTION_NAME, pattern, findInFiles.errorString());
+        return {};
     }
+    findInFiles.setMaxResults(maxResults);
+    // The search index is updated in the background too.
+    return findInFiles.start(filesToSearch(findInFiles));
+}
 
-    const auto lines = output.split('\n', Qt::SkipEmptyParts);
-    result.reserve(lines.count() * 3);
-    for (const QString &line : lines) {
-        QString currentLine = line;
-        currentLine.replace('\\', '/');
-        const auto parts = currentLine.split(':');
-
-        QString filePath;
-        int offset = 0;
-        if (parts.size() > 2 && parts[0].length() == 1 && parts[1].startsWith('/')) {
-            filePath = parts[0] + ':' + parts[1];
-            offset = 2;
+/*!
+ * \qmlmethod bool Project::isFindInFilesAvailable()
+ * Returns true if `findInFiles` can be used. Searching is built in Knut, so it's always available.
+ */
+bool Project::isFindInFilesAvailable() const
+{
+    return true;
+}
+
+/*!
+ * \qmlmethod array<object> Project::queryAll(array<string> filters, string query)
+ * Runs the Tree-sitter `query` on all files of the current project matching the `filters`, and returns all the
+ * matches.
+ *
+ * `filters` is a list of extensions (`"cpp"`) or wildcard patterns (`"*Dlg.cpp"`). A pattern containing a `/` is
+ * matched against the path relative to the project root, otherwise against the file name.
+ *
+ * The files are parsed in parallel, without opening documents, which is a lot faster than opening and querying each
+ * document. Each match is an object with:
+ *
+ * - `file`: the path of the file, relative to the project root
+ * - `captures`: an array of captures, each with `name`, `text`, `start` and `end` positions, `line` and `column`
+ *
+ * While the query runs, the `queryAllProgress(processed, total)` signal is emitted regularly, and the query can be
+ * stopped with `cancelQueryAll()`, in which case only the matches found so far are returned.
+ *
+ * ```js
+ * let matches = Project.queryAll(["cpp"], "(call_expression function: (identifier) @name (#eq? @name \"ON_COMMAND\"))");
+ * for (let match of matches)
+ *     Message.log(match.file + ":" + match.captures[0].line);
+ * ```
+ */
+QVariantList Project::queryAll(const QStringList &filters, const QString &query)
+{
+    LOG(filters, query);
+
+    if (m_root.isEmpty() || m_parallelQuery)
+        return {};
+
+    QStringList extensions;
+    QList<std::pair<QRegularExpression, bool>> patterns;
+    for (const auto &filter : filters) {
+        if (filter.contains('*') || filter.contains('?') || filter.contains('[')) {
+            patterns.emplace_back(QRegularExpression::fromWildcard(filter, Qt::CaseInsensitive), filter.contains('/'));
         } else {
-            filePath = parts[0];
-            offset = 1;
+            extensions.push_back(filter);
         }
+    }
+
+    QDir dir(m_root);
+    QStringList fileNames;
+    const auto files = fileIndex()->allFiles();
+    for (const auto &relativePath : files) {
+        const QFileInfo fi(relativePath);
+        const bool matches = extensions.contains(fi.suffix(), Qt::CaseInsensitive)
+            || std::ranges::any_of(patterns, [&](const auto &pattern) {
+                   return pattern.first.match(pattern.second ? relativePath : fi.fileName()).hasMatch();
+               });
+        if (matches)
+            fileNames.push_back(dir.filePath(relativePath));
+    }
+
+    ParallelQuery parallelQuery(query);
+    parallelQuery.setProgressCallback([this](int processed, int total) {
+        emit queryAllProgress(processed, total);
+        ScriptDialogItem::updateProgress();
+    });
+    m_parallelQuery = &parallelQuery;
+    const auto matches = parallelQuery.run(fileNames);
+    m_parallelQuery = nullptr;
 
-        if (parts.size() > offset + 1) {
-            QVariantMap matchResult;
-            matchResult.insert("file", filePath);
-            matchResult.insert("line", parts[offset].toInt());
-            matchResult.insert("column", parts[offset + 1].toInt());
-            result.append(matchResult);
+    QVariantList result;
+    result.reserve(matches.size());
+    for (const auto &match : matches) {
+        QVariantList captures;
+        captures.reserve(match.captures.size());
+        for (const auto &capture : match.captures) {
+            captures.push_back(QVariantMap {{"name", capture.name},
+                                            {"text", capture.text},
+                                            {"start", capture.start},
+                                            {"end", capture.end},
+                                            {"line", capture.line},
+                                            {"column", capture.column}});
         }
+        result.push_back(QVariantMap {{"file", dir.relativeFilePath(match.fileName)}, {"captures", captures}});
     }
     return result;
 }
 
 /*!
- * \qmlmethod bool Project::isFindInFilesAvailable()
- * Checks if the ripgrep (rg) command-line tool is available on the system.
+ * \qmlmethod object Project::memoryStatistics()
+ * Returns statistics on the memory used by the open documents.
+ *
+ * When the documents use more memory than the `project/memory_budget` setting (in MB), the least recently used ones are
+ * unloaded: their text, syntax tree and symbols are freed. An unloaded document stays open, and is loaded again from
+ * its file the next time it's used. Documents with unsaved changes, and the current document, are never unloaded.
+ *
+ * The object returned has these properties:
+ *
+ * - `budget`: the memory budget, in bytes (0 if there is no budget)
+ * - `memoryUsage`: an estimate of the memory used by the loaded documents, in bytes
+ * - `loadedDocuments`, `unloadedDocuments`: the number of open documents loaded and unloaded
+ * - `evictions`: the number of times a document was unloaded
+ * - `reloads`: the number of times an unloaded document was loaded again
  */
-bool Project::isFindInFilesAvailable() const
+QVariantMap Project::memoryStatistics() const
 {
-    QString rgPath = QStandardPaths::findExecutable("rg");
-    if (rgPath.isEmpty()) {
-        return false;
-    } else {
-        return true;
-    }
+    LOG();
+
+    qint64 memoryUsage = 0;
+    for (auto it = m_loadedDocuments.keyBegin(); it != m_loadedDocuments.keyEnd(); ++it)
+        memoryUsage += (*it)->memoryUsage();
+    const auto budget = static_cast<qint64>(std::max(DEFAULT_VALUE(int, DocumentMemoryBudget), 0)) * 1024 * 1024;
+    return {{"budget", budget},
+            {"memoryUsage", memoryUsage},
+            {"loadedDocuments", m_loadedDocuments.size()},
+            {"unloadedDocuments", static_cast<qsizetype>(m_documents.size()) - m_loadedDocuments.size()},
+            {"evictions", m_unloadedDocumentCount},
+            {"reloads", m_reloadedDocumentCount}};
+}
+
+/*!
+ * \qmlmethod Project::cancelQueryAll()
+ * Stops the `queryAll` call currently running, if any.
+ */
+void Project::cancelQueryAll()
+{
+    LOG();
+
+    if (m_parallelQuery)
+        m_parallelQuery->cancel();
 }
 
+/*!
+ * \qmlsignal Project::queryAllProgress(int processed, int total)
+ * This handler is called regularly while `queryAll` runs, `processed` is the number of files already queried out of
+ * `total`.
+ */
+
 } // namespace Core
@@ -11,8 +11,15 @@
 #pragma once
 
 #include "document.h"
+#include "findinfiles.h"
 
+#include <QHash>
 #include <QObject>
+#include <QSet>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
 #include <unordered_map>
 
 namespace Lsp {
@@ -21,6 +28,11 @@ class Client;
 
 namespace Core {
 
+class FileIndex;
+class ParallelQuery;
+class QueryCache;
+class TrigramIndex;
+
 class Project : public QObject
 {
     Q_OBJECT
@@ -46,7 +58,8 @@ public:
 
     Core::Document *currentDocument() const;
 
-    const QList<Document *> &documents() const;
+    // Open documents, the most recently opened last.
+    QList<Document *> documents() const;
 
     Q_INVOKABLE QStringList allFiles(Core::Project::PathType type = RelativeToRoot) const;
     Q_INVOKABLE QStringList allFilesWithExtension(const QString &extension,
@@ -54,34 +67,93 @@ public:
     Q_INVOKABLE QStringList allFilesWithExtensions(const QStringList &extensions,
                                                    Core::Project::PathType type = RelativeToRoot);
     Q_INVOKABLE QVariantList findInFiles(const QString &pattern) const;
+    Q_INVOKABLE QVariantList headerSourcePairs(Core::Project::PathType type = RelativeToRoot);
     Q_INVOKABLE bool isFindInFilesAvailable() const;
+    Q_INVOKABLE QVariantList queryAll(const QStringList &filters, const QString &query);
+    Q_INVOKABLE QVariantMap memoryStatistics() const;
+    Q_INVOKABLE QList<Core::Document *> preload(const QStringList &fileNames);
+
+    // Files named `baseName` followed by any extension, used to pair headers and sources.
+    QStringList filesWithBaseName(const QString &baseName, PathType type = RelativeToRoot) const;
+
+    // Asynchronous version of findInFiles, the matches are added to the future as they are found. The search stops
+    // once `maxResults` matches are found, if not 0, see FindInFiles::start.
+    // This is used by the GUI, it's not user-facing API.
+    QFuture<Core::FindInFiles::Match> findInFilesAsync(const QString &pattern, int maxResults = 0) const;
+
+    // Persistent cache of query results for this project, nullptr if disabled in the settings.
+    QueryCache *queryCache();
 
 public slots:
     Core::Document *get(const QString &fileName);
     Core::Document *open(const QString &fileName);
     void closeAll();
-    void saveAllDocuments();
+    bool saveAllDocuments();
     Core::Document *openPrevious(int index = 1);
+    void cancelQueryAll();
 
 signals:
     void rootChanged();
     void currentDocumentChanged(Core::Document *document);
     void documentsChanged();
+    void queryAllProgress(int processed, int total);
 
 private:
     friend class KnutCore;
     explicit Project(QObject *parent = nullptr);
 
     Core::Document *getDocument(QString fileName, bool moveToBack = false);
+    // Returns the position of the open document for `fileName`, which is made absolute if needed.
+    std::optional<std::list<Document *>::iterator> findDocument(QString &fileName);
+    QString absoluteDocumentPath(const QString &fileName) const;
+    // Creates and loads a new document, `prepare` is called before loading it. With `loadLater`, documents that can be
+    // unloaded are only loaded on first access.
+    Document *addNewDocument(const QString &fileName, const std::function<void(Document *)> &prepare = {},
+                             bool loadLater = false);
+    void addDocument(Document *document);
+    void updateDocumentPath(Document *document);
+    // Returns the memory used by the loaded documents afterward, in bytes.
+    qint64 applyMemoryBudget(const QSet<const Document *> &keptDocuments);
+    static QString documentKey(const QString &fileName);
     Lsp::Client *getClient(Document::Type type);
+    // Index of the project files, built on first use and kept up to date while the root doesn't change.
+    FileIndex *fileIndex() const;
+    QStringList fromRelativePaths(QStringList paths, PathType type) const;
+    // Returns a function giving the full paths of the files to search, narrowed by the search index when it's enabled.
+    // The function can be called from any thread.
+    std::function<QStringList()> filesToSearch(const FindInFiles &findInFiles) const;
 
 private:
     inline static Project *m_instance = nullptr;
 
     QString m_root;
-    QList<Document *> m_documents;
+    // Open documents, the most recently opened last. Documents are looked up by path in m_documentsByPath, and moved
+    // to the back in constant time.
+    std::list<Document *> m_documents;
+    QHash<QString, std::list<Document *>::iterator> m_documentsByPath;
+    // Position of each open document in m_documents, and its key in m_documentsByPath, updated when it's renamed.
+    struct DocumentEntry
+    {
+        std::list<Document *>::iterator it;
+        QString key;
+    };
+    QHash<Document *, DocumentEntry> m_documentEntries;
+    // Keys used by more than one document, after a document is saved with the name of another one.
+    QSet<QString> m_sharedDocumentKeys;
+    // Loaded documents, with the last time they were returned by getDocument, used to unload the least recently used
+    // ones when they use more memory than the budget.
+    QHash<Document *, quint64> m_loadedDocuments;
+    quint64 m_documentUseCount = 0;
+    int m_documentLoadsSinceBudgetCheck = 0;
+    int m_unloadedDocumentCount = 0;
+    int m_reloadedDocumentCount = 0;
     Core::Document *m_current = nullptr;
     std::unordered_map<Core::Document::Type, Lsp::Client *> m_lspClients;
+    std::unique_ptr<QueryCache> m_queryCache;
+    mutable std::unique_ptr<FileIndex> m_fileIndex;
+    // Shared with the searches running in the background.
+    mutable std::shared_ptr<TrigramIndex> m_trigramIndex;
+    ParallelQuery *m_parallelQuery = nullptr;
 };
 
 } // namespace Core
@@ -0,0 +1,281 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "querycache.h"
+#include "textdocument.h"
+#include "utils/log.h"
+#include "version.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <algorithm>
+#include <vector>
+#include <tree_sitter/api.h>
+
+namespace Core {
+
+namespace {
+    constexpr quint32 CacheMagic = 0x4b514331; // "KQC1"
+    constexpr quint16 CacheFormatVersion = 1;
+    // Entries stored longer ago are removed when the cache is opened.
+    constexpr qint64 MaxEntryAgeDays = 30;
+    // Stores the name of the file the entries of a document directory are for.
+    constexpr char SourceFileName[] = "source";
+
+    void addNumber(QCryptographicHash &hash, quint32 number)
+    {
+        hash.addData(QByteArrayView(reinterpret_cast<const char *>(&number), sizeof(number)));
+    }
+
+    void addString(QCryptographicHash &hash, QStringView string)
+    {
+        addNumber(hash, static_cast<quint32>(string.size()));
+        hash.addData(QByteArrayView(reinterpret_cast<const char *>(string.utf16()), string.size() * sizeof(QChar)));
+    }
+
+    // Document directories are named after the SHA-1 of the file name, other directories are left alone.
+    bool isDocumentDirectoryName(const QString &name)
+    {
+        auto isHexDigit = [](QChar c) {
+            return c.isDigit() || (c >= u'a' && c <= u'f');
+        };
+        return name.size() == 40 && std::ranges::all_of(name, isHexDigit);
+    }
+}
+
+QueryCache::QueryCache(QString directory, qint64 maxSize)
+    : m_directory(std::move(directory))
+    , m_maxSize(maxSize)
+{
+    removeStaleEntries();
+}
+
+const QString &QueryCache::directory() const
+{
+    return m_directory;
+}
+
+// The grammar is part of the key, as a grammar update can change the result of any query.
+// Knut ships its grammars, so its version identifies them, while the tree-sitter ABI version and the language
+// dimensions catch grammars updated during development.
+QByteArray QueryCache::documentKey(const QString &text, const QList<treesitter::Range> &includedRanges,
+                                   const TSLanguage *language)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    addString(hash, core::knut_version());
+    addString(hash, core::knut_build_date());
+    addNumber(hash, ts_language_version(language));
+    addNumber(hash, ts_language_symbol_count(language));
+    addNumber(hash, ts_language_field_count(language));
+
+    addNumber(hash, static_cast<quint32>(includedRanges.size()));
+    for (const auto &range : includedRanges) {
+        addNumber(hash, range.start_byte);
+        addNumber(hash, range.end_byte);
+    }
+
+    addString(hash, text);
+    return hash.result();
+}
+
+QByteArray QueryCache::queryKey(const treesitter::Query &query, const treesitter::Query::Parameters &parameters)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(query.utf8Text());
+
+    // Sort the parameters, the order of a QHash is not stable between runs.
+    auto names = parameters.keys();
+    std::ranges::sort(names);
+    for (const auto &name : std::as_const(names)) {
+        addString(hash, name);
+        addString(hash, parameters.value(name));
+    }
+    return hash.result();
+}
+
+QString QueryCache::documentDirectory(const TextDocument &document) const
+{
+    const auto fileKey = QCryptographicHash::hash(document.fileName().toUtf8(), QCryptographicHash::Sha1);
+    return m_directory + '/' + QString::fromLatin1(fileKey.toHex());
+}
+
+QString QueryCache::entryPath(const TextDocument &document, const QByteArray &documentKey,
+                              const QByteArray &queryKey) const
+{
+    return QString("%1/%2/%3.bin")
+        .arg(documentDirectory(document), QString::fromLatin1(documentKey.toHex()),
+             QString::fromLatin1(queryKey.toHex()));
+}
+
+// Entries for deleted or renamed files are never read again, and old entries are unlikely to be: they are removed,
+// then the least recently stored ones until the cache fits in its maximum size.
+void QueryCache::removeStaleEntries()
+{
+    struct DocumentEntries
+    {
+        QString path;
+        QDateTime lastModified;
+        qint64 size = 0;
+    };
+    std::vector<DocumentEntries> documents;
+    qint64 totalSize = 0;
+    const auto now = QDateTime::currentDateTime();
+
+    const auto directories = QDir(m_directory).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const auto &directory : directories) {
+        if (!isDocumentDirectoryName(directory.fileName()))
+            continue;
+
+        QFile source(directory.filePath() + '/' + SourceFileName);
+        const bool sourceExists =
+            source.open(QIODevice::ReadOnly) && QFileInfo::exists(QString::fromUtf8(source.readAll()));
+
+        DocumentEntries entries {.path = directory.filePath()};
+        QDirIterator it(directory.filePath(), QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            const auto fileInfo = it.nextFileInfo();
+            entries.size += fileInfo.size();
+            entries.lastModified = std::max(entries.lastModified, fileInfo.lastModified());
+        }
+
+        if (!sourceExists || entries.lastModified.daysTo(now) > MaxEntryAgeDays) {
+            QDir(entries.path).removeRecursively();
+            continue;
+        }
+        totalSize += entries.size;
+        documents.push_back(std::move(entries));
+    }
+
+    if (totalSize <= m_maxSize)
+        return;
+    std::ranges::sort(documents, {}, &DocumentEntries::lastModified);
+    for (const auto &entries : documents) {
+        if (totalSize <= m_maxSize)
+            break;
+        QDir(entries.path).removeRecursively();
+        totalSize -= entries.size;
+    }
+}
+
+std::optional<QueryMatchList> QueryCache::find(TextDocument &document, const QByteArray &documentKey,
+                                               const QByteArray &queryKey) const
+{
+    QFile file(entryPath(document, documentKey, queryKey));
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_5);
+
+    quint32 magic;
+    quint16 version;
+    stream >> magic >> version;
+    if (magic != CacheMagic || version != CacheFormatVersion)
+        return {};
+
+    QStringList names;
+    stream >> names;
+
+    quint32 matchCount;
+    stream >> matchCount;
+    QueryMatchList matches;
+    matches.reserve(matchCount);
+    for (quint32 i = 0; i < matchCount && stream.status() == QDataStream::Ok; ++i) {
+        quint32 captureCount;
+        stream >> captureCount;
+        QList<QueryCapture> captures;
+        captures.reserve(captureCount);
+        for (quint32 j = 0; j < captureCount && stream.status() == QDataStream::Ok; ++j) {
+            quint32 nameIndex;
+            qint32 start;
+            qint32 end;
+            stream >> nameIndex >> start >> end;
+            if (nameIndex >= static_cast<quint32>(names.size()))
+                return {};
+            captures.emplace_back(
+                QueryCapture {.name = names.at(nameIndex), .range = document.createRangeMark(start, end)});
+        }
+        matches.emplace_back(std::move(captures));
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        spdlog::warn("{}: Corrupted cache entry {}", FUNCTION_NAME, file.fileName());
+        return {};
+    }
+    return matches;
+}
+
+void QueryCache::insert(const TextDocument &document, const QByteArray &documentKey, const QByteArray &queryKey,
+                        const QueryMatchList &matches)
+{
+    // A new content for this file, the results for the previous content are outdated.
+    const QString directory = documentDirectory(document) + '/' + QString::fromLatin1(documentKey.toHex());
+    if (!QFileInfo::exists(directory)) {
+        QDir(documentDirectory(document)).removeRecursively();
+        if (!QDir().mkpath(directory)) {
+            spdlog::warn("{}: Can't create cache directory {}", FUNCTION_NAME, directory);
+            return;
+        }
+        // Used to remove the entries once the file doesn't exist anymore.
+        QFile source(documentDirectory(document) + '/' + SourceFileName);
+        if (!source.open(QIODevice::WriteOnly) || source.write(document.fileName().toUtf8()) == -1)
+            spdlog::warn("{}: Can't write cache entry {}", FUNCTION_NAME, source.fileName());
+    }
+
+    QSaveFile file(entryPath(document, documentKey, queryKey));
+    if (!file.open(QIODevice::WriteOnly)) {
+        spdlog::warn("{}: Can't write cache entry {}", FUNCTION_NAME, file.fileName());
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_5);
+    stream << CacheMagic << CacheFormatVersion;
+
+    // Capture names are repeated in every match, only store them once.
+    QStringList names;
+    QHash<QString, quint32> nameIndexes;
+    for (const auto &match : matches) {
+        for (const auto &capture : match.captures()) {
+            if (!nameIndexes.contains(capture.name)) {
+                nameIndexes.insert(capture.name, static_cast<quint32>(names.size()));
+                names.push_back(capture.name);
+            }
+        }
+    }
+    stream << names;
+
+    stream << static_cast<quint32>(matches.size());
+    for (const auto &match : matches) {
+        const auto &captures = match.captures();
+        stream << static_cast<quint32>(captures.size());
+        for (const auto &capture : captures) {
+            stream << nameIndexes.value(capture.name) << static_cast<qint32>(capture.range.start())
+                   << static_cast<qint32>(capture.range.end());
+        }
+    }
+
+    if (!file.commit())
+        spdlog::warn("{}: Can't write cache entry {}", FUNCTION_NAME, file.fileName());
+}
+
+void QueryCache::clear()
+{
+    QDir(m_directory).removeRecursively();
+}
+
+} // namespace Core
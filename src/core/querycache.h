@@ -0,0 +1,74 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include "querymatch.h"
+#include "treesitter/parser.h"
+#include "treesitter/query.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <optional>
+
+struct TSLanguage;
+
+namespace Core {
+
+class TextDocument;
+
+/**
+ * \brief Persistent cache of the results of queries run on an entire document
+ *
+ * Results are stored on disk as capture ranges, so they can be restored without parsing the document.
+ * As symbols and includes are extracted from query results, running a script again on an unchanged file doesn't
+ * need to parse it at all.
+ *
+ * Entries are keyed by:
+ * - the document content: its text, included ranges and the tree-sitter grammar used to parse it
+ * - the query: its text and the values bound to its parameters
+ *
+ * Any change to one of them results in a different key, so outdated entries are never read. Results for a previous
+ * content of a file are removed the first time new results are stored for it. When the cache is opened, the entries of
+ * files that don't exist anymore and the entries older than 30 days are removed, then the oldest entries until the
+ * cache fits in `maxSize` bytes.
+ */
+class QueryCache
+{
+public:
+    static constexpr qint64 DefaultMaxSize = 512 * 1024 * 1024;
+
+    explicit QueryCache(QString directory, qint64 maxSize = DefaultMaxSize);
+
+    const QString &directory() const;
+
+    static QByteArray documentKey(const QString &text, const QList<treesitter::Range> &includedRanges,
+                                  const TSLanguage *language);
+    static QByteArray queryKey(const treesitter::Query &query, const treesitter::Query::Parameters &parameters);
+
+    std::optional<QueryMatchList> find(TextDocument &document, const QByteArray &documentKey,
+                                       const QByteArray &queryKey) const;
+    void insert(const TextDocument &document, const QByteArray &documentKey, const QByteArray &queryKey,
+                const QueryMatchList &matches);
+
+    // Removes all entries from the cache.
+    void clear();
+
+private:
+    void removeStaleEntries();
+    QString documentDirectory(const TextDocument &document) const;
+    QString entryPath(const TextDocument &document, const QByteArray &documentKey, const QByteArray &queryKey) const;
+
+    QString m_directory;
+    qint64 m_maxSize;
+};
+
+} // namespace Core
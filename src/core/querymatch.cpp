@@ -95,6 +95,11 @@ QueryMatch::QueryMatch(TextDocument &document, const treesitter::QueryMatch &mat
     }
 }
 
+QueryMatch::QueryMatch(QList<QueryCapture> captures)
+    : m_captures(std::move(captures))
+{
+}
+
 const QList<QueryCapture> &QueryMatch::captures() const
 {
     return m_captures;
@@ -230,6 +235,24 @@ Core::QueryMatchList QueryMatch::queryIn(const QString &capture, const QString &
     return result;
 }
 
+Core::QueryMatchList QueryMatch::queryIn(const QString &capture, const std::shared_ptr<treesitter::Query> &query,
+                                         const QHash<QString, QString> &parameters /* = {} */) const
+{
+    Core::QueryMatchList result;
+
+    const auto ranges = getAll(capture);
+    for (const auto &range : ranges) {
+        auto document = qobject_cast<CodeDocument *>(range.document());
+        if (document) {
+            result.append(document->queryInRange(range, query, parameters));
+        } else {
+            spdlog::warn("{}: RangeMark is not backed by CodeDocument!", FUNCTION_NAME);
+        }
+    }
+
+    return result;
+}
+
 QString QueryMatch::toString() const
 {
     return QString("QueryMatch{%1}").arg(m_captures.size());
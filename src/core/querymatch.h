@@ -12,9 +12,12 @@
 
 #include "rangemark.h"
 
+#include <QHash>
 #include <QObject>
+#include <memory>
 
 namespace treesitter {
+class Query;
 class QueryMatch;
 }
 
@@ -47,6 +50,8 @@ public:
     // Default constructor is required for Q_DECLARE_METATYPE
     QueryMatch() = default;
     QueryMatch(TextDocument &document, const treesitter::QueryMatch &match);
+    // Used to restore matches without running the query, see QueryCache.
+    explicit QueryMatch(QList<QueryCapture> captures);
 
     const QList<QueryCapture> &captures() const;
     bool isEmpty() const;
@@ -71,6 +76,9 @@ public:
     // let matches = function.queryIn("body", ...);
     // ```
     Q_INVOKABLE QList<Core::QueryMatch> queryIn(const QString &capture, const QString &query) const;
+    // Overload reusing an already constructed query with bound parameters, see CodeDocument::query.
+    QList<Core::QueryMatch> queryIn(const QString &capture, const std::shared_ptr<treesitter::Query> &query,
+                                    const QHash<QString, QString> &parameters = {}) const;
 
     Q_INVOKABLE QString toString() const;
 
@@ -134,9 +134,13 @@ TextDocument *RangeMark::document() const
 
 QString RangeMark::text() const
 {
+    if (!isValid())
+        return {};
+
     // <= here instead of < because m_end is exclusive
-    if (isValid() && end() <= document()->text().size())
-        return document()->text().sliced(start(), end() - start());
+    const auto text = document()->text();
+    if (end() <= text.size())
+        return text.sliced(start(), end() - start());
     return {};
 }
 
@@ -84,6 +84,7 @@ void Settings::loadUserSettings()
     if (loadJsonDataStatus.jsonData) {
         m_userSettings = loadJsonDataStatus.jsonData.value();
         m_settings.merge_patch(m_userSettings);
+        ++m_revision;
         emit settingsLoaded();
     }
 }
@@ -103,6 +104,7 @@ void Settings::loadProjectSettings(const QString &rootDir)
     if (loadJsonDataStatus.jsonData) {
         m_projectSettings = loadJsonDataStatus.jsonData.value();
         m_settings.merge_patch(m_projectSettings);
+        ++m_revision;
         emit settingsLoaded();
     }
 }
@@ -183,6 +185,7 @@ bool Settings::setValue(const QString &path, const QJSValue &value)
 
     switch (status) {
     case Utils::SetJsonValueStatus::Success: {
+        ++m_revision;
         emit settingsChanged(path);
         // Asynchronous save
         m_saveTimer->start();
@@ -226,6 +229,11 @@ bool Settings::isTesting() const
     return (m_mode == Mode::Test);
 }
 
+quint64 Settings::revision() const
+{
+    return m_revision;
+}
+
 bool Settings::hasLsp() const
 {
     return m_mode == Mode::Test || (m_mode == Mode::Gui && DEFAULT_VALUE(bool, EnableLSP));
@@ -236,6 +244,7 @@ void Settings::loadKnutSettings()
     QFile file(":/core/settings.json");
     if (file.open(QIODevice::ReadOnly)) {
         m_settings = nlohmann::json::parse(file.readAll().constData());
+        ++m_revision;
         return;
     }
     spdlog::error("{}: {} - is missing from Qt Resources and thus settings cannot be initialized", FUNCTION_NAME,
@@ -307,6 +316,7 @@ void Settings::updatePaths(const QString &path, const std::string &json_path, bo
     }
     settings[nlohmann::json::json_pointer(json_path)] = paths;
     m_settings[nlohmann::json::json_pointer(json_path)] = globalPaths;
+    ++m_revision;
     saveSettings();
 }
 
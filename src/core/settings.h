@@ -50,6 +50,12 @@ public:
     static inline constexpr char RcAssetColors[] = "/rc/asset_transparent_colors";
     static inline constexpr char RcLanguageMap[] = "/rc/language_map";
     static inline constexpr char CppExcludedMacros[] = "/cpp/excluded_macros";
+    static inline constexpr char QueryCacheEnabled[] = "/query_cache/enabled";
+    static inline constexpr char QueryCacheDirectory[] = "/query_cache/directory";
+    static inline constexpr char SearchIndexEnabled[] = "/search_index/enabled";
+    static inline constexpr char SearchIndexDirectory[] = "/search_index/directory";
+    static inline constexpr char DocumentMemoryBudget[] = "/project/memory_budget";
+    static inline constexpr char ExcludedFiles[] = "/project/excluded_files";
     static inline constexpr char SaveLogsToFile[] = "/logs/saveToFile";
     static inline constexpr char ScriptPaths[] = "/script_paths";
     static inline constexpr char Tab[] = "/text_editor/tab";
@@ -93,6 +99,7 @@ public:
                 m_userSettings[pointer] = value;
             else
                 m_projectSettings[pointer] = value;
+            ++m_revision;
             emit settingsChanged(QString::fromStdString(path));
         } catch (...) {
             spdlog::error("Settings::setValue {} - error saving", path);
@@ -112,6 +119,9 @@ public:
     bool isTesting() const;
     bool hasLsp() const;
 
+    // Incremented each time a setting changes, allows caching values computed from the settings.
+    quint64 revision() const;
+
 public slots:
     bool setValue(const QString &path, const QJSValue &value);
 
@@ -149,6 +159,7 @@ private:
     QString m_projectPath;
     QTimer *m_saveTimer = nullptr;
     Mode m_mode = Mode::Test;
+    quint64 m_revision = 0;
 };
 
 } // namespace Core
@@ -89,6 +89,8 @@ Symbol::Symbol(QObject *parent, const QueryMatch &match, Kind kind)
     , m_range {match.get("range")}
     , m_selectionRange {match.get("selectionRange")}
     , m_queryMatch {match}
+    , m_localName {m_name}
+    , m_localKind {kind}
 {
 }
 
@@ -107,17 +109,29 @@ Symbol *Symbol::makeSymbol(QObject *parent, const QueryMatch &match, Kind kind)
     return new Symbol(parent, match, kind);
 }
 
-void Symbol::assignContext(const QList<Symbol *> &contexts)
+void Symbol::resetContext()
 {
-    auto names = kdalgorithms::transformed<QStringList>(contexts, &Symbol::name);
-    if (!names.isEmpty()) {
-        m_name = names.join("::") + "::" + m_name;
-    }
-    auto is_class = [](const auto &symbol) {
-        return symbol->kind() == Kind::Class;
-    };
-    if (m_kind == Kind::Function && kdalgorithms::any_of(contexts, is_class)) {
-        m_kind = Kind::Method;
+    m_context = nullptr;
+    m_children.clear();
+    m_name = m_localName;
+    m_kind = m_localKind;
+}
+
+// The context is the innermost symbol surrounding this one, its name is already fully qualified.
+void Symbol::assignContext(Symbol *context)
+{
+    m_context = context;
+    context->m_children.append(this);
+
+    m_name = context->name() + "::" + m_name;
+
+    if (m_kind == Kind::Function) {
+        for (auto symbol = context; symbol; symbol = symbol->m_context) {
+            if (symbol->kind() == Kind::Class) {
+                m_kind = Kind::Method;
+                break;
+            }
+        }
     }
 }
 
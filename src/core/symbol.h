@@ -71,6 +71,17 @@ protected:
     RangeMark m_selectionRange;
     QueryMatch m_queryMatch;
 
+    // Nesting of the symbols in the document, computed by TreeSitterHelper::assignSymbolContexts.
+    Symbol *m_context = nullptr;
+    QList<Symbol *> m_children;
+
+    // Name and kind from the query match, before the context qualifies them.
+    QString m_localName;
+    Kind m_localKind;
+
+    // Called before the contexts are assigned again, when the symbols are updated after an edit.
+    virtual void resetContext();
+
     CodeDocument *document() const;
 
 public:
@@ -98,10 +109,11 @@ public:
     bool operator==(const Symbol &) const;
 
 private:
-    void assignContext(const QList<Symbol *> &contexts);
+    void assignContext(Symbol *context);
 
     friend class CodeDocument;
     friend class TreeSitterHelper;
+    friend class ClassSymbol;
 };
 
 using SymbolList = QList<Core::Symbol *>;
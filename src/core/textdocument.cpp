@@ -22,6 +22,7 @@
 #include <QKeyEvent>
 #include <QPlainTextEdit>
 #include <QRegularExpression>
+#include <QSaveFile>
 #include <QSignalBlocker>
 #include <QTextBlock>
 #include <QTextStream>
@@ -240,53 +241,117 @@ bool TextDocument::doSave(const QString &fileName)
 {
     Q_ASSERT(!fileName.isEmpty());
 
-    QFile file(fileName);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        setErrorString(file.errorString());
+    const auto error = writeFile(fileName, content(),
+                                 static_cast<QStringConverter::Encoding>(DEFAULT_VALUE(TextDocument::Encoding, Encoding)));
+    if (!error.isEmpty()) {
+        setErrorString(error);
         spdlog::error("{} - Can't save file {}: {}", FUNCTION_NAME, fileName, errorString());
         return false;
     }
+    return true;
+}
+
+std::function<QString()> TextDocument::doSaveSnapshot(const QString &fileName) const
+{
+    // The settings are only read on the main thread.
+    const auto encoding = static_cast<QStringConverter::Encoding>(DEFAULT_VALUE(TextDocument::Encoding, Encoding));
+    return [fileName, content = content(), encoding]() {
+        return writeFile(fileName, content, encoding);
+    };
+}
 
-    if (m_utf8Bom)
+TextDocument::FileContent TextDocument::content() const
+{
+    return {.text = textEdit()->toPlainText(), .lineEnding = m_lineEnding, .utf8Bom = m_utf8Bom, .errorString = {}};
+}
+
+QString TextDocument::writeFile(const QString &fileName, FileContent content, QStringConverter::Encoding encoding)
+{
+    // A failure while writing never leaves a truncated file. If the temporary file can't be created next to the file
+    // (no permission on the directory), the file is written directly.
+    QSaveFile file(fileName);
+    file.setDirectWriteFallback(true);
+    if (!file.open(QIODevice::WriteOnly))
+        return file.errorString();
+
+    if (content.utf8Bom)
         file.write("\xef\xbb\xbf", 3);
 
-    QString plainText = m_document->toPlainText();
-    if (m_lineEnding == CRLFLineEnding)
-        plainText.replace('\n', "\r\n");
+    if (content.lineEnding == CRLFLineEnding)
+        content.text.replace('\n', "\r\n");
 
     QTextStream stream(&file);
-    stream.setEncoding(static_cast<QStringConverter::Encoding>(DEFAULT_VALUE(TextDocument::Encoding, Encoding)));
-    stream << plainText;
-    return true;
+    stream.setEncoding(encoding);
+    stream << content.text;
+    stream.flush();
+    if (!file.commit())
+        return file.errorString();
+    return {};
 }
 
-bool TextDocument::doLoad(const QString &fileName)
+TextDocument::FileContent TextDocument::readFile(const QString &fileName, QStringConverter::Encoding encoding)
 {
-    Q_ASSERT(!fileName.isEmpty());
-
+    FileContent content;
     QFile file(fileName);
     if (!file.open(QIODevice::ReadOnly)) {
-        setErrorString(file.errorString());
-        spdlog::warn("{} - Can't load file {}: {}", FUNCTION_NAME, fileName, errorString());
-        return false;
+        content.errorString = file.errorString();
+        return content;
     }
 
     QByteArray data = file.readAll();
-    detectFormat(data);
+    detectFormat(data, content);
     QTextStream stream(data);
-    stream.setEncoding(static_cast<QStringConverter::Encoding>(DEFAULT_VALUE(TextDocument::Encoding, Encoding)));
-    const QString text = stream.readAll();
+    stream.setEncoding(encoding);
+    content.text = stream.readAll();
+    return content;
+}
+
+void TextDocument::setPreloadedContent(const QString &fileName, FileContent content)
+{
+    m_preloadedContent.emplace(fileName, std::move(content));
+}
+
+bool TextDocument::doLoad(const QString &fileName)
+{
+    Q_ASSERT(!fileName.isEmpty());
+
+    FileContent content;
+    if (m_preloadedContent && m_preloadedContent->first == fileName) {
+        content = std::move(m_preloadedContent->second);
+    } else {
+        content = readFile(fileName,
+                           static_cast<QStringConverter::Encoding>(DEFAULT_VALUE(TextDocument::Encoding, Encoding)));
+    }
+    m_preloadedContent.reset();
+
+    if (!content.errorString.isEmpty()) {
+        setErrorString(content.errorString);
+        spdlog::warn("{} - Can't load file {}: {}", FUNCTION_NAME, fileName, errorString());
+        return false;
+    }
+    if (content.utf8Bom)
+        m_utf8Bom = true;
+    if (content.lineEnding)
+        setLineEnding(*content.lineEnding);
 
     QSignalBlocker sb(m_document->document());
     // This will replace '\r\n' with '\n'
-    m_document->setPlainText(text);
+    m_document->setPlainText(content.text);
     setHasChanged(false);
 
+    if (m_unloadedPosition != -1) {
+        QSignalBlocker editorBlocker(m_document);
+        auto cursor = m_document->textCursor();
+        cursor.setPosition(std::min(m_unloadedPosition, m_document->document()->characterCount() - 1));
+        m_document->setTextCursor(cursor);
+        m_unloadedPosition = -1;
+    }
+
     return true;
 }
 
 // This function is copied from TextFileFormat::detect from Qt Creator.
-void TextDocument::detectFormat(const QByteArray &data)
+void TextDocument::detectFormat(const QByteArray &data, FileContent &content)
 {
     if (data.isEmpty())
         return;
@@ -294,54 +359,54 @@ void TextDocument::detectFormat(const QByteArray &data)
     const auto buf = reinterpret_cast<const unsigned char *>(data.constData());
     // code taken from qtextstream
     if (bytesRead >= 3 && ((buf[0] == 0xef && buf[1] == 0xbb) && buf[2] == 0xbf))
-        m_utf8Bom = true;
+        content.utf8Bom = true;
 
     // end code taken from qtextstream
     const int newLinePos = data.indexOf('\n');
     if (newLinePos == -1)
-        setLineEnding(NativeLineEnding);
+        content.lineEnding = NativeLineEnding;
     else if (newLinePos == 0)
-        setLineEnding(LFLineEnding);
+        content.lineEnding = LFLineEnding;
     else
-        setLineEnding(data.at(newLinePos - 1) == '\r' ? CRLFLineEnding : LFLineEnding);
+        content.lineEnding = data.at(newLinePos - 1) == '\r' ? CRLFLineEnding : LFLineEnding;
 }
 
 int TextDocument::column() const
 {
     LOG();
-    const QTextCursor cursor = m_document->textCursor();
+    const QTextCursor cursor = textEdit()->textCursor();
     LOG_RETURN("column", cursor.positionInBlock() + 1);
 }
 
 int TextDocument::line() const
 {
     LOG();
-    const QTextCursor cursor = m_document->textCursor();
+    const QTextCursor cursor = textEdit()->textCursor();
     LOG_RETURN("line", cursor.blockNumber() + 1);
 }
 
 int TextDocument::lineCount() const
 {
     LOG();
-    return m_document->document()->lineCount();
+    return textEdit()->document()->lineCount();
 }
 
 int TextDocument::position() const
 {
     LOG();
-    LOG_RETURN("pos", m_document->textCursor().position());
+    LOG_RETURN("pos", textEdit()->textCursor().position());
 }
 
 int TextDocument::selectionStart() const
 {
     LOG();
-    LOG_RETURN("pos", m_document->textCursor().selectionStart());
+    LOG_RETURN("pos", textEdit()->textCursor().selectionStart());
 }
 
 int TextDocument::selectionEnd() const
 {
     LOG();
-    LOG_RETURN("pos", m_document->textCursor().selectionEnd());
+    LOG_RETURN("pos", textEdit()->textCursor().selectionEnd());
 }
 
 void TextDocument::setPosition(int newPosition)
@@ -350,16 +415,16 @@ void TextDocument::setPosition(int newPosition)
 
     if (position() == newPosition)
         return;
-    auto cursor = m_document->textCursor();
+    auto cursor = textEdit()->textCursor();
     cursor.setPosition(newPosition);
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
     emit positionChanged();
 }
 
 void TextDocument::convertPosition(int pos, int *line, int *column) const
 {
     Q_ASSERT(line && column);
-    const QTextBlock block = m_document->document()->findBlock(pos);
+    const QTextBlock block = textEdit()->document()->findBlock(pos);
     if (!block.isValid()) {
         (*line) = -1;
         (*column) = -1;
@@ -372,7 +437,7 @@ void TextDocument::convertPosition(int pos, int *line, int *column) const
 
 int TextDocument::position(QTextCursor::MoveOperation operation, int pos) const
 {
-    auto cursor = m_document->textCursor();
+    auto cursor = textEdit()->textCursor();
 
     if (pos != -1)
         cursor.setPosition(pos);
@@ -417,7 +482,7 @@ int TextDocument::columnAtPosition(int position)
 int TextDocument::positionAt(int line, int column)
 {
     LOG(LOG_ARG("line", line), LOG_ARG("column", column));
-    const QTextBlock block = m_document->document()->findBlockByLineNumber(line - 1);
+    const QTextBlock block = textEdit()->document()->findBlockByLineNumber(line - 1);
     if (!block.isValid()) {
         return -1;
     } else {
@@ -428,20 +493,20 @@ int TextDocument::positionAt(int line, int column)
 QString TextDocument::text() const
 {
     LOG();
-    LOG_RETURN("text", m_document->toPlainText());
+    LOG_RETURN("text", textEdit()->toPlainText());
 }
 
 void TextDocument::setText(const QString &newText)
 {
     LOG(LOG_ARG("text", newText));
 
-    m_document->setPlainText(newText);
+    textEdit()->setPlainText(newText);
 }
 
 QString TextDocument::currentLine() const
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.movePosition(QTextCursor::StartOfLine);
     cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
     LOG_RETURN("text", cursor.selectedText());
@@ -450,7 +515,7 @@ QString TextDocument::currentLine() const
 QString TextDocument::currentWord() const
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.movePosition(QTextCursor::StartOfWord);
     cursor.movePosition(QTextCursor::EndOfWord, QTextCursor::KeepAnchor);
     LOG_RETURN("text", cursor.selectedText());
@@ -460,7 +525,7 @@ QString TextDocument::selectedText() const
 {
     LOG();
     // Replace \u2029 with \n
-    const QString text = m_document->textCursor().selectedText().replace(QChar(8233), "\n");
+    const QString text = textEdit()->textCursor().selectedText().replace(QChar(8233), "\n");
     LOG_RETURN("text", text);
 }
 
@@ -476,9 +541,37 @@ bool TextDocument::hasUtf8Bom() const
 
 QPlainTextEdit *TextDocument::textEdit() const
 {
+    // Loading again doesn't change the content, it's part of accessing it.
+    const_cast<TextDocument *>(this)->ensureLoaded();
     return m_document;
 }
 
+// A document displayed in a view is never unloaded, its text edit is embedded in the view.
+bool TextDocument::canUnload() const
+{
+    return !hasChanged() && exists() && !m_document->parentWidget();
+}
+
+// QTextDocument stores the text in UTF-16, with a block and its layout for each line.
+qint64 TextDocument::memoryUsage() const
+{
+    if (!isLoaded())
+        return 0;
+    constexpr qint64 BytesPerBlock = 128;
+    const auto *document = m_document->document();
+    return document->characterCount() * static_cast<qint64>(sizeof(QChar)) + document->blockCount() * BytesPerBlock;
+}
+
+void TextDocument::doUnload()
+{
+    m_unloadedPosition = m_document->textCursor().position();
+    // Marks and range marks keep their positions: the text is cleared here, and set again by doLoad, with the document
+    // signals blocked.
+    QSignalBlocker documentBlocker(m_document->document());
+    QSignalBlocker editorBlocker(m_document);
+    m_document->clear();
+}
+
 /**
  * \brief Returns the string when pressing on the tab key
  */
@@ -498,7 +591,7 @@ void TextDocument::undo(int count)
 {
     LOG_AND_MERGE(count);
     while (count != 0) {
-        m_document->undo();
+        textEdit()->undo();
         --count;
     }
 }
@@ -511,16 +604,16 @@ void TextDocument::redo(int count)
 {
     LOG_AND_MERGE(count);
     while (count != 0) {
-        m_document->redo();
+        textEdit()->redo();
         --count;
     }
 }
 
 void TextDocument::movePosition(QTextCursor::MoveOperation operation, QTextCursor::MoveMode mode, int count)
 {
-    auto cursor = m_document->textCursor();
+    auto cursor = textEdit()->textCursor();
     cursor.movePosition(operation, mode, count);
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -533,7 +626,7 @@ void TextDocument::gotoLine(int line, int column)
 {
     LOG(LOG_ARG("line", line), LOG_ARG("column", column));
 
-    gotoLineInTextEdit(m_document, line, column);
+    gotoLineInTextEdit(textEdit(), line, column);
 }
 
 void gotoLineInTextEdit(QPlainTextEdit *textEdit, int line, int column)
@@ -678,9 +771,9 @@ void TextDocument::gotoEndOfDocument()
 void TextDocument::unselect()
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.clearSelection();
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -690,7 +783,7 @@ void TextDocument::unselect()
 bool TextDocument::hasSelection()
 {
     LOG();
-    return m_document->textCursor().hasSelection();
+    return textEdit()->textCursor().hasSelection();
 }
 
 /*!
@@ -700,7 +793,7 @@ bool TextDocument::hasSelection()
 void TextDocument::selectAll()
 {
     LOG();
-    m_document->selectAll();
+    textEdit()->selectAll();
 }
 
 /*!
@@ -710,9 +803,9 @@ void TextDocument::selectAll()
 void TextDocument::selectTo(int pos)
 {
     LOG(LOG_ARG("pos", pos));
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.setPosition(pos, QTextCursor::KeepAnchor);
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -822,10 +915,10 @@ void TextDocument::selectNextWord(int count)
 void TextDocument::selectRegion(int from, int to)
 {
     LOG(from, to);
-    QTextCursor cursor(m_document->document());
+    QTextCursor cursor(textEdit()->document());
     cursor.setPosition(from, QTextCursor::MoveAnchor);
     cursor.setPosition(to, QTextCursor::KeepAnchor);
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -849,7 +942,7 @@ void TextDocument::selectRange(const RangeMark &range)
 void TextDocument::copy()
 {
     LOG();
-    m_document->copy();
+    textEdit()->copy();
 }
 
 /*!
@@ -859,7 +952,7 @@ void TextDocument::copy()
 void TextDocument::paste()
 {
     LOG();
-    m_document->paste();
+    textEdit()->paste();
 }
 
 /*!
@@ -869,7 +962,7 @@ void TextDocument::paste()
 void TextDocument::cut()
 {
     LOG();
-    m_document->cut();
+    textEdit()->cut();
 }
 
 /*!
@@ -879,10 +972,10 @@ void TextDocument::cut()
 void TextDocument::remove(int length)
 {
     LOG(length);
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.setPosition(cursor.position() + length, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -892,7 +985,7 @@ void TextDocument::remove(int length)
 void TextDocument::insert(const QString &text)
 {
     LOG_AND_MERGE(LOG_ARG("text", text));
-    m_document->insertPlainText(text);
+    textEdit()->insertPlainText(text);
 }
 
 /*!
@@ -906,10 +999,10 @@ void TextDocument::insertAtLine(const QString &text, int line)
     else
         LOG(LOG_ARG("text", text), LOG_ARG("line", line));
 
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     if (line > 0) {
-        const int blockNumber = qMin(line, m_document->document()->blockCount()) - 1;
-        const QTextBlock &block = m_document->document()->findBlockByNumber(blockNumber);
+        const int blockNumber = qMin(line, textEdit()->document()->blockCount()) - 1;
+        const QTextBlock &block = textEdit()->document()->findBlockByNumber(blockNumber);
         if (block.isValid())
             cursor = QTextCursor(block);
     }
@@ -923,7 +1016,7 @@ void TextDocument::insertAtLine(const QString &text, int line)
 void TextDocument::insertAtPosition(const QString &text, int pos)
 {
     LOG(text, pos);
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.setPosition(pos);
     cursor.beginEditBlock();
     cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
@@ -938,10 +1031,10 @@ void TextDocument::insertAtPosition(const QString &text, int pos)
 void TextDocument::replace(int length, const QString &text)
 {
     LOG(length, text);
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.setPosition(cursor.position() + length, QTextCursor::KeepAnchor);
     cursor.insertText(text);
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -951,11 +1044,11 @@ void TextDocument::replace(int length, const QString &text)
 void TextDocument::replace(int from, int to, const QString &text)
 {
     LOG(from, to, text);
-    QTextCursor cursor(m_document->document());
+    QTextCursor cursor(textEdit()->document());
     cursor.setPosition(from);
     cursor.setPosition(to, QTextCursor::KeepAnchor);
     cursor.insertText(text);
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -979,10 +1072,10 @@ void TextDocument::deleteLine(int line)
     else
         LOG(LOG_ARG("line", line));
 
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     if (line > 0) {
-        const int blockNumber = qMin(line, m_document->document()->blockCount()) - 1;
-        const QTextBlock &block = m_document->document()->findBlockByNumber(blockNumber);
+        const int blockNumber = qMin(line, textEdit()->document()->blockCount()) - 1;
+        const QTextBlock &block = textEdit()->document()->findBlockByNumber(blockNumber);
         if (block.isValid())
             cursor = QTextCursor(block);
     } else {
@@ -999,7 +1092,7 @@ void TextDocument::deleteLine(int line)
 void TextDocument::deleteSelection()
 {
     LOG();
-    m_document->textCursor().removeSelectedText();
+    textEdit()->textCursor().removeSelectedText();
 }
 
 /*!
@@ -1009,11 +1102,11 @@ void TextDocument::deleteSelection()
 void TextDocument::deleteRegion(int from, int to)
 {
     LOG(from, to);
-    QTextCursor cursor(m_document->document());
+    QTextCursor cursor(textEdit()->document());
     cursor.setPosition(from);
     cursor.setPosition(to, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -1037,10 +1130,10 @@ void TextDocument::deleteRange(const RangeMark &range)
 void TextDocument::deleteEndOfLine()
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -1050,10 +1143,10 @@ void TextDocument::deleteEndOfLine()
 void TextDocument::deleteStartOfLine()
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.movePosition(QTextCursor::StartOfLine, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -1063,11 +1156,11 @@ void TextDocument::deleteStartOfLine()
 void TextDocument::deleteEndOfWord()
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     if (!cursor.hasSelection())
         cursor.movePosition(QTextCursor::NextWord, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -1077,11 +1170,11 @@ void TextDocument::deleteEndOfWord()
 void TextDocument::deleteStartOfWord()
 {
     LOG();
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     if (!cursor.hasSelection())
         cursor.movePosition(QTextCursor::PreviousWord, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -1091,10 +1184,10 @@ void TextDocument::deleteStartOfWord()
 void TextDocument::deletePreviousCharacter(int count)
 {
     LOG_AND_MERGE(count);
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.movePosition(QTextCursor::PreviousCharacter, QTextCursor::KeepAnchor, count);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -1104,10 +1197,10 @@ void TextDocument::deletePreviousCharacter(int count)
 void TextDocument::deleteNextCharacter(int count)
 {
     LOG_AND_MERGE(count);
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.movePosition(QTextCursor::NextCharacter, QTextCursor::KeepAnchor, count);
     cursor.removeSelectedText();
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -1136,9 +1229,9 @@ void TextDocument::gotoMark(const Mark &mark)
         return;
     }
 
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.setPosition(mark.position());
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /*!
@@ -1153,9 +1246,9 @@ void TextDocument::selectToMark(const Mark &mark)
         return;
     }
 
-    QTextCursor cursor = m_document->textCursor();
+    QTextCursor cursor = textEdit()->textCursor();
     cursor.setPosition(mark.position(), QTextCursor::KeepAnchor);
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 }
 
 /**
@@ -1181,7 +1274,7 @@ Core::RangeMark TextDocument::createRangeMark(int from, int to)
 Core::RangeMark TextDocument::createRangeMark()
 {
     LOG();
-    const auto cursor = m_document->textCursor();
+    const auto cursor = textEdit()->textCursor();
     const int start = cursor.selectionStart();
     const int end = cursor.selectionEnd();
 
@@ -1210,7 +1303,7 @@ bool TextDocument::find(const QString &text, FindFlags options)
     else if (options & FindWholeWords)
         return findRegexp(QRegularExpression::escape(text), options);
     else
-        return m_document->find(text, static_cast<QTextDocument::FindFlags>(static_cast<int>(options)));
+        return textEdit()->find(text, static_cast<QTextDocument::FindFlags>(static_cast<int>(options)));
 }
 
 /*!
@@ -1251,7 +1344,7 @@ auto TextDocument::selectRegexpMatch(
     else
         expression.setPatternOptions(expression.patternOptions() | QRegularExpression::CaseInsensitiveOption);
 
-    const QTextCursor startCursor = m_document->textCursor();
+    const QTextCursor startCursor = textEdit()->textCursor();
     QTextBlock block = startCursor.block();
     int blockOffset = startCursor.positionInBlock();
 
@@ -1260,7 +1353,7 @@ auto TextDocument::selectRegexpMatch(
         if (found.has_value()) {
             const auto &[match, newCursor] = *found;
             if (selectionFunction(expression, match, newCursor)) {
-                m_document->setTextCursor(newCursor);
+                textEdit()->setTextCursor(newCursor);
                 return found;
             }
 
@@ -1336,9 +1429,9 @@ bool TextDocument::replaceOne(const QString &before, const QString &after, FindF
 {
     LOG(LOG_ARG("text", before), after, options);
 
-    auto cursor = m_document->textCursor();
+    auto cursor = textEdit()->textCursor();
     cursor.movePosition(QTextCursor::Start);
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
 
     const bool usesRegExp = options & FindRegexp;
     const bool preserveCase = options & PreserveCase;
@@ -1346,7 +1439,7 @@ bool TextDocument::replaceOne(const QString &before, const QString &after, FindF
     const auto regexp = Utils::createRegularExpression(before, options, usesRegExp);
     if (find(before, options)) {
         cursor.beginEditBlock();
-        const auto found = m_document->textCursor();
+        const auto found = textEdit()->textCursor();
         cursor.setPosition(found.selectionStart());
         cursor.setPosition(found.selectionEnd(), QTextCursor::KeepAnchor);
         QString afterText = after;
@@ -1429,14 +1522,14 @@ int TextDocument::replaceAll(const QString &before, const QString &after, FindFl
     const bool preserveCase = options & PreserveCase;
 
     int count = 0;
-    auto cursor = m_document->textCursor();
+    auto cursor = textEdit()->textCursor();
     cursor.movePosition(backwards ? QTextCursor::End : QTextCursor::Start);
-    m_document->setTextCursor(cursor);
+    textEdit()->setTextCursor(cursor);
     cursor.beginEditBlock();
 
     const auto regexp = Utils::createRegularExpression(before, options, usesRegExp);
     while (find(before, options)) {
-        const auto found = m_document->textCursor();
+        const auto found = textEdit()->textCursor();
         cursor.setPosition(found.selectionStart());
         cursor.setPosition(found.selectionEnd(), QTextCursor::KeepAnchor);
         if (!filterAcceptsCursor(cursor)) {
@@ -1620,7 +1713,7 @@ void indentTextInTextEdit(QPlainTextEdit *textEdit, int tabCount, bool relative)
 void TextDocument::indent(int count)
 {
     LOG_AND_MERGE(count);
-    indentTextInTextEdit(m_document, count);
+    indentTextInTextEdit(textEdit(), count);
 }
 
 /*!
@@ -1633,7 +1726,7 @@ void TextDocument::indentLine(int count, int line)
 {
     LOG(LOG_ARG("count", count), LOG_ARG("line", line));
 
-    indentBlocksInTextEdit(m_document, line - 1, line - 1, count, true);
+    indentBlocksInTextEdit(textEdit(), line - 1, line - 1, count, true);
 }
 
 /*!
@@ -1647,7 +1740,7 @@ void TextDocument::setIndentation(int indent)
 {
     LOG(LOG_ARG("indent", indent));
 
-    indentTextInTextEdit(m_document, indent, false);
+    indentTextInTextEdit(textEdit(), indent, false);
 }
 
 /*!
@@ -1660,7 +1753,7 @@ void TextDocument::setIndentationAtLine(int indent, int line)
 {
     LOG(LOG_ARG("indent", indent), LOG_ARG("line", line));
 
-    indentBlocksInTextEdit(m_document, line - 1, line - 1, indent, false);
+    indentBlocksInTextEdit(textEdit(), line - 1, line - 1, indent, false);
 }
 
 void TextDocument::setLineEnding(LineEnding newLineEnding)
@@ -1683,7 +1776,7 @@ QString TextDocument::indentTextAtPosition(int pos) const
 {
     LOG(LOG_ARG("position", pos));
 
-    auto cursor = m_document->textCursor();
+    auto cursor = textEdit()->textCursor();
     cursor.setPosition(pos);
     cursor.movePosition(QTextCursor::StartOfLine);
     const QString line = cursor.block().text();
@@ -1711,7 +1804,7 @@ QString TextDocument::indentTextAtLine(int line /* = -1 */) const
     // API-wise the line numbers are 1-based, but internally they are 0-based
     auto blockNumber = line - 1;
 
-    const QTextBlock &block = m_document->document()->findBlockByNumber(blockNumber);
+    const QTextBlock &block = textEdit()->document()->findBlockByNumber(blockNumber);
     if (block.isValid()) {
         return indentTextAtPosition(block.position());
     }
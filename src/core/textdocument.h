@@ -19,6 +19,8 @@
 #include <QRegularExpressionMatch>
 #include <QTextCursor>
 #include <QTextDocument>
+#include <optional>
+#include <utility>
 
 class QPlainTextEdit;
 
@@ -78,6 +80,22 @@ public:
     };
     Q_ENUM(Encoding)
 
+    // Content of a file, read and decoded the way a document loads it.
+    struct FileContent
+    {
+        QString text;
+        // Not set when the file has no line to detect it from.
+        std::optional<LineEnding> lineEnding;
+        bool utf8Bom = false;
+        // Set if the file can't be read.
+        QString errorString;
+    };
+    // Can be called from any thread, the encoding is read from the settings on the main thread.
+    static FileContent readFile(const QString &fileName, QStringConverter::Encoding encoding);
+    // Writes to a temporary file renamed once complete, returns an error message on failure. Can be called from any
+    // thread.
+    static QString writeFile(const QString &fileName, FileContent content, QStringConverter::Encoding encoding);
+
     explicit TextDocument(QObject *parent = nullptr);
     ~TextDocument() override;
 
@@ -101,8 +119,15 @@ public:
 
     bool hasUtf8Bom() const;
 
+    // Loads the document again if it was unloaded, see Document::unload.
     QPlainTextEdit *textEdit() const;
 
+    bool canUnload() const override;
+    qint64 memoryUsage() const override;
+
+    // Content already read from `fileName` in the background, used instead of reading the file if it's loaded next.
+    void setPreloadedContent(const QString &fileName, FileContent content);
+
     QString tab() const;
 
 public slots:
@@ -224,6 +249,8 @@ protected:
 
     bool doSave(const QString &fileName) override;
     bool doLoad(const QString &fileName) override;
+    void doUnload() override;
+    std::function<QString()> doSaveSnapshot(const QString &fileName) const override;
 
     friend MarkPrivate;
     void convertPosition(int pos, int *line, int *column) const;
@@ -235,7 +262,8 @@ protected:
                          const std::function<bool(QTextCursor)> &filterAcceptsCursor);
 
 private:
-    void detectFormat(const QByteArray &data);
+    static void detectFormat(const QByteArray &data, FileContent &content);
+    FileContent content() const;
 
     void movePosition(QTextCursor::MoveOperation operation, QTextCursor::MoveMode mode = QTextCursor::MoveAnchor,
                       int count = 1);
@@ -252,6 +280,9 @@ private:
     QPointer<QPlainTextEdit> m_document;
     LineEnding m_lineEnding = NativeLineEnding;
     bool m_utf8Bom = false;
+    // Position of the cursor when the document was unloaded, restored when it's loaded again.
+    int m_unloadedPosition = -1;
+    std::optional<std::pair<QString, FileContent>> m_preloadedContent;
 };
 
 NLOHMANN_JSON_SERIALIZE_ENUM(TextDocument::Encoding,
@@ -0,0 +1,477 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "trigramindex.h"
+#include "utils/log.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QSet>
+#include <QStringDecoder>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <mutex>
+
+namespace Core {
+
+namespace {
+    constexpr quint32 IndexMagic = 0x4b544931; // "KTI1"
+    constexpr quint16 IndexFormatVersion = 1;
+
+    constexpr quint32 TrigramCount = 1 << 24;
+
+    // Number of threads used by parallelFor for `count` items.
+    int maxWorkers(int count)
+    {
+        return std::max(1, std::min(QThreadPool::globalInstance()->maxThreadCount(), count));
+    }
+
+    // Runs `function` for all indexes in [0, count[ on the calling thread and up to `workers - 1` idle threads of the
+    // global thread pool, and waits until they are all done. Workers are only started on idle threads, so this can be
+    // called from a thread of the pool without waiting for a worker that is never run. The function also gets the
+    // index of the worker running it, in [0, workers[.
+    void parallelFor(int count, int workers, const std::function<void(int, int)> &function)
+    {
+        auto *pool = QThreadPool::globalInstance();
+        std::atomic<int> next = 0;
+        auto work = [&](int worker) {
+            for (int index = next++; index < count; index = next++)
+                function(index, worker);
+        };
+        QSemaphore finishedWorkers;
+        int workerCount = 0;
+        for (int i = 1; i < std::min(workers, count); ++i) {
+            const bool started = pool->tryStart([&work, &finishedWorkers, i]() {
+                work(i);
+                finishedWorkers.release();
+            });
+            if (!started)
+                break;
+            ++workerCount;
+        }
+        work(0);
+        finishedWorkers.acquire(workerCount);
+    }
+
+    std::vector<quint32> decodeIds(const QByteArray &data, quint32 count)
+    {
+        std::vector<quint32> ids;
+        ids.reserve(count);
+        quint32 previous = 0;
+        quint32 delta = 0;
+        int shift = 0;
+        for (const auto c : data) {
+            const auto byte = static_cast<quint8>(c);
+            delta |= static_cast<quint32>(byte & 0x7f) << shift;
+            if (byte & 0x80) {
+                shift += 7;
+                continue;
+            }
+            previous += delta;
+            ids.push_back(previous);
+            delta = 0;
+            shift = 0;
+        }
+        return ids;
+    }
+
+    QString directoryPath(const QString &path)
+    {
+        const auto slash = path.lastIndexOf('/');
+        return slash < 0 ? QString() : path.left(slash);
+    }
+}
+
+TrigramIndex::TrigramIndex(QString root, QString fileName)
+    : m_root(std::move(root))
+    , m_fileName(std::move(fileName))
+{
+    if (QFileInfo::exists(m_fileName) && !load()) {
+        spdlog::warn("{}: Invalid trigram index {}, it will be built again", FUNCTION_NAME, m_fileName);
+        m_files.clear();
+        m_fileIds.clear();
+        m_postings.clear();
+    }
+}
+
+TrigramIndex::~TrigramIndex()
+{
+    if (m_changed)
+        save();
+}
+
+// Trigrams are sequences of 3 bytes, returned sorted and without duplicates.
+std::vector<quint32> TrigramIndex::trigrams(const QByteArray &data)
+{
+    std::vector<quint32> result;
+    for (qsizetype i = 2; i < data.size(); ++i) {
+        result.push_back((static_cast<quint32>(static_cast<quint8>(data[i - 2])) << 16)
+                         | (static_cast<quint32>(static_cast<quint8>(data[i - 1])) << 8)
+                         | static_cast<quint8>(data[i]));
+    }
+    std::ranges::sort(result);
+    const auto duplicates = std::ranges::unique(result);
+    result.erase(duplicates.begin(), duplicates.end());
+    return result;
+}
+
+// Same as trigrams, a bitmap of all possible trigrams is faster than sorting all the trigrams of a large file. The
+// bitmap is allocated by the caller for a whole update, only the bits set are cleared.
+std::vector<quint32> TrigramIndex::fileTrigrams(const QByteArray &data, std::vector<quint64> &seen)
+{
+    if (seen.empty())
+        seen.resize(TrigramCount / 64);
+
+    std::vector<quint32> result;
+    for (qsizetype i = 2; i < data.size(); ++i) {
+        const auto trigram = (static_cast<quint32>(static_cast<quint8>(data[i - 2])) << 16)
+            | (static_cast<quint32>(static_cast<quint8>(data[i - 1])) << 8) | static_cast<quint8>(data[i]);
+        auto &word = seen[trigram / 64];
+        const auto bit = quint64(1) << (trigram % 64);
+        if (!(word & bit)) {
+            word |= bit;
+            result.push_back(trigram);
+        }
+    }
+    for (const auto trigram : result)
+        seen[trigram / 64] = 0;
+    std::ranges::sort(result);
+    return result;
+}
+
+// Ids are appended in increasing order, the delta with the previous one is stored on 7 bits per byte, most ids take
+// a single byte.
+void TrigramIndex::appendId(Postings &postings, quint32 id)
+{
+    auto delta = id - postings.last;
+    while (delta >= 0x80) {
+        postings.data.append(static_cast<char>((delta & 0x7f) | 0x80));
+        delta >>= 7;
+    }
+    postings.data.append(static_cast<char>(delta));
+    postings.last = id;
+    ++postings.count;
+}
+
+void TrigramIndex::removeFile(quint32 id)
+{
+    auto &file = m_files[id];
+    m_fileIds.remove(file.path);
+    file.removed = true;
+    m_changed = true;
+}
+
+void TrigramIndex::update(const QStringList &files)
+{
+    std::lock_guard lock(m_mutex);
+    updateFiles(files);
+}
+
+void TrigramIndex::invalidate(const QStringList &directories)
+{
+    std::lock_guard lock(m_mutex);
+    for (const auto &directory : directories)
+        m_changedDirectories.insert(directory);
+}
+
+void TrigramIndex::invalidateAll()
+{
+    std::lock_guard lock(m_mutex);
+    m_checkAll = true;
+    m_changedDirectories.clear();
+}
+
+void TrigramIndex::updateFiles(const QStringList &files)
+{
+    const QDir root(m_root);
+    const auto fileCount = static_cast<int>(files.size());
+
+    // Only the new files and the ones in a changed directory may have changed since the last update, checking their
+    // modification time is enough to find the files changed.
+    std::vector<int> checkedFiles;
+    for (int i = 0; i < fileCount; ++i) {
+        const auto &path = files.at(i);
+        if (m_checkAll || !m_fileIds.contains(path)
+            || (!m_changedDirectories.isEmpty() && m_changedDirectories.contains(directoryPath(path))))
+            checkedFiles.push_back(i);
+    }
+    m_checkAll = false;
+    m_changedDirectories.clear();
+
+    struct Stat
+    {
+        qint64 modified = 0;
+        qint64 size = 0;
+        bool exists = false;
+    };
+    std::vector<Stat> stats(files.size());
+    const auto checkedCount = static_cast<int>(checkedFiles.size());
+    parallelFor(checkedCount, maxWorkers(checkedCount), [&](int index, int) {
+        const auto fileIndex = checkedFiles[index];
+        const QFileInfo fi(root.absoluteFilePath(files.at(fileIndex)));
+        if (fi.isFile())
+            stats[fileIndex] = {.modified = fi.lastModified().toMSecsSinceEpoch(), .size = fi.size(), .exists = true};
+    });
+
+    const QSet<QString> fileSet(files.cbegin(), files.cend());
+    std::vector<quint32> removedIds;
+    for (const auto id : std::as_const(m_fileIds)) {
+        if (!fileSet.contains(m_files[id].path))
+            removedIds.push_back(id);
+    }
+    for (const auto id : removedIds)
+        removeFile(id);
+
+    struct Update
+    {
+        int index;
+        QByteArray hash;
+        bool binary = false;
+        bool read = false;
+        std::vector<quint32> trigrams;
+    };
+    std::vector<Update> updates;
+    for (const auto i : checkedFiles) {
+        const auto &stat = stats[i];
+        const auto it = m_fileIds.constFind(files.at(i));
+        if (!stat.exists) {
+            if (it != m_fileIds.cend())
+                removeFile(it.value());
+            continue;
+        }
+        if (it == m_fileIds.cend() || m_files[it.value()].modified != stat.modified
+            || m_files[it.value()].size != stat.size)
+            updates.push_back({.index = i});
+    }
+
+    if (!updates.empty()) {
+        // One trigram bitmap per thread, only allocated for the duration of the update.
+        const auto updateCount = static_cast<int>(updates.size());
+        const auto workers = maxWorkers(updateCount);
+        std::vector<std::vector<quint64>> seen(workers);
+        parallelFor(updateCount, workers, [&](int index, int worker) {
+            auto &update = updates[index];
+            QFile file(root.absoluteFilePath(files.at(update.index)));
+            if (!file.open(QIODevice::ReadOnly))
+                return;
+            auto data = file.readAll();
+            update.read = true;
+            update.hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+            // Files with a UTF-16 or UTF-32 byte order mark are indexed as UTF-8, the encoding of the literals.
+            const auto encoding = QStringConverter::encodingForData(data);
+            if (encoding && encoding != QStringConverter::Utf8)
+                data = QString(QStringDecoder(*encoding).decode(data)).toUtf8();
+            update.binary = data.contains('\0');
+            if (!update.binary)
+                update.trigrams = fileTrigrams(data, seen[worker]);
+        });
+    }
+
+    for (auto &update : updates) {
+        const auto &path = files.at(update.index);
+        const auto &stat = stats[update.index];
+        const auto it = m_fileIds.constFind(path);
+        if (it != m_fileIds.cend()) {
+            auto &file = m_files[it.value()];
+            // Only the modification time changed (checkout, touch...), the trigrams are still valid.
+            if (update.read && file.hash == update.hash) {
+                file.modified = stat.modified;
+                file.size = stat.size;
+                m_changed = true;
+                continue;
+            }
+            removeFile(it.value());
+        }
+        // Unreadable files are not indexed, they are always candidates.
+        if (!update.read)
+            continue;
+
+        const auto id = static_cast<quint32>(m_files.size());
+        m_files.push_back({.path = path,
+                           .modified = stat.modified,
+                           .size = stat.size,
+                           .hash = std::move(update.hash),
+                           .binary = update.binary});
+        m_fileIds.insert(path, id);
+        for (const auto trigram : update.trigrams)
+            appendId(m_postings[trigram], id);
+        m_changed = true;
+    }
+    if (!updates.empty())
+        spdlog::debug("{}: {} files indexed again", FUNCTION_NAME, updates.size());
+
+    // Saved right away, so the work isn't lost if the application doesn't exit cleanly.
+    if (m_changed)
+        write();
+}
+
+QStringList TrigramIndex::candidates(const QStringList &files, const QByteArray &literal)
+{
+    std::lock_guard lock(m_mutex);
+    updateFiles(files);
+
+    const auto literalTrigrams = trigrams(literal);
+    std::vector<quint32> ids;
+    bool filtered = !literalTrigrams.empty();
+    if (filtered) {
+        // Intersect the posting lists, starting with the shortest one.
+        std::vector<const Postings *> lists;
+        for (const auto trigram : literalTrigrams) {
+            const auto it = m_postings.find(trigram);
+            if (it == m_postings.end()) {
+                lists.clear();
+                break;
+            }
+            lists.push_back(&it->second);
+        }
+        std::ranges::sort(lists, {}, &Postings::count);
+        if (!lists.empty()) {
+            ids = decodeIds(lists.front()->data, lists.front()->count);
+            for (size_t i = 1; i < lists.size() && !ids.empty(); ++i) {
+                const auto listIds = decodeIds(lists[i]->data, lists[i]->count);
+                std::vector<quint32> intersection;
+                std::ranges::set_intersection(ids, listIds, std::back_inserter(intersection));
+                ids = std::move(intersection);
+            }
+        }
+    }
+
+    std::vector<bool> matching(m_files.size(), !filtered);
+    for (const auto id : ids)
+        matching[id] = true;
+
+    QStringList result;
+    for (const auto &path : files) {
+        const auto it = m_fileIds.constFind(path);
+        if (it == m_fileIds.cend())
+            result.push_back(path);
+        else if (!m_files[it.value()].binary && matching[it.value()])
+            result.push_back(path);
+    }
+    return result;
+}
+
+bool TrigramIndex::load()
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_5);
+    quint32 magic = 0;
+    quint16 version = 0;
+    QString root;
+    stream >> magic >> version >> root;
+    if (magic != IndexMagic || version != IndexFormatVersion || root != m_root)
+        return false;
+
+    quint32 fileCount = 0;
+    stream >> fileCount;
+    m_files.resize(fileCount);
+    for (quint32 id = 0; id < fileCount; ++id) {
+        auto &indexFile = m_files[id];
+        stream >> indexFile.path >> indexFile.modified >> indexFile.size >> indexFile.hash >> indexFile.binary;
+        m_fileIds.insert(indexFile.path, id);
+    }
+
+    quint32 trigramCount = 0;
+    stream >> trigramCount;
+    for (quint32 i = 0; i < trigramCount && stream.status() == QDataStream::Ok; ++i) {
+        quint32 trigram = 0;
+        Postings postings;
+        stream >> trigram >> postings.count >> postings.data;
+        // The posting lists stay compressed, they are only decoded to check them.
+        const auto ids = decodeIds(postings.data, postings.count);
+        if (ids.size() != postings.count || (!ids.empty() && ids.back() >= fileCount))
+            return false;
+        postings.last = ids.empty() ? 0 : ids.back();
+        m_postings.emplace(trigram, std::move(postings));
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+bool TrigramIndex::save()
+{
+    std::lock_guard lock(m_mutex);
+    return write();
+}
+
+bool TrigramIndex::write()
+{
+    // Drop the outdated entries, renumbering the files keeps the posting lists sorted.
+    constexpr auto RemovedId = std::numeric_limits<quint32>::max();
+    std::vector<quint32> newIds(m_files.size(), RemovedId);
+    std::vector<File> files;
+    for (size_t id = 0; id < m_files.size(); ++id) {
+        if (m_files[id].removed)
+            continue;
+        newIds[id] = static_cast<quint32>(files.size());
+        files.push_back(std::move(m_files[id]));
+    }
+    if (files.size() != m_files.size()) {
+        for (auto it = m_postings.begin(); it != m_postings.end();) {
+            Postings postings;
+            for (const auto id : decodeIds(it->second.data, it->second.count)) {
+                if (newIds[id] != RemovedId)
+                    appendId(postings, newIds[id]);
+            }
+            if (postings.count == 0) {
+                it = m_postings.erase(it);
+            } else {
+                it->second = std::move(postings);
+                ++it;
+            }
+        }
+        m_fileIds.clear();
+        for (size_t id = 0; id < files.size(); ++id)
+            m_fileIds.insert(files[id].path, static_cast<quint32>(id));
+    }
+    m_files = std::move(files);
+
+    if (!QDir().mkpath(QFileInfo(m_fileName).absolutePath())) {
+        spdlog::warn("{}: Can't create directory for {}", FUNCTION_NAME, m_fileName);
+        return false;
+    }
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        spdlog::warn("{}: Can't write trigram index {}", FUNCTION_NAME, m_fileName);
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_5);
+    stream << IndexMagic << IndexFormatVersion << m_root;
+    stream << static_cast<quint32>(m_files.size());
+    for (const auto &indexFile : m_files)
+        stream << indexFile.path << indexFile.modified << indexFile.size << indexFile.hash << indexFile.binary;
+    stream << static_cast<quint32>(m_postings.size());
+    for (const auto &[trigram, postings] : m_postings)
+        stream << trigram << postings.count << postings.data;
+
+    if (!file.commit()) {
+        spdlog::warn("{}: Can't write trigram index {}", FUNCTION_NAME, m_fileName);
+        return false;
+    }
+    m_changed = false;
+    return true;
+}
+
+} // namespace Core
@@ -0,0 +1,102 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Core {
+
+/**
+ * \brief Persistent trigram index of the content of the project files
+ *
+ * For each sequence of 3 bytes found in the project, the index knows the files containing it. The files that may
+ * contain a literal text are the ones containing all of its trigrams, so a search only needs to read a few files.
+ *
+ * The index is saved to a file after each update, and updated incrementally: only the files added, or whose
+ * modification time or size changed, are read again. A file whose content didn't change (same hash) is not indexed
+ * again. Once the index has been checked against the disk, only the files of the directories passed to `invalidate`
+ * are checked again: a file modified in place, without changing its directory, is only found after `invalidateAll`.
+ *
+ * The posting lists are kept compressed in memory, in the same format as in the file.
+ *
+ * All paths are relative to the root. The index can be used from any thread, calls are serialized.
+ */
+class TrigramIndex
+{
+public:
+    TrigramIndex(QString root, QString fileName);
+    // Saves the index if it changed since it was loaded.
+    ~TrigramIndex();
+
+    // Updates the index for `files`, then returns the ones that may contain `literal`, in the same order.
+    // Binary files are never returned. If `literal` is shorter than a trigram, all text files are returned.
+    QStringList candidates(const QStringList &files, const QByteArray &literal);
+
+    // Brings the index up to date with `files`, the files not in the list are removed from the index.
+    void update(const QStringList &files);
+
+    // The files of `directories` are checked again on next update.
+    void invalidate(const QStringList &directories);
+    // All files are checked again on next update.
+    void invalidateAll();
+
+    bool save();
+
+    static std::vector<quint32> trigrams(const QByteArray &data);
+
+private:
+    struct File
+    {
+        QString path;
+        qint64 modified = 0;
+        qint64 size = 0;
+        QByteArray hash;
+        bool binary = false;
+        // Outdated entries stay in the posting lists until the index is saved.
+        bool removed = false;
+    };
+    // Sorted file ids, stored as variable-length deltas.
+    struct Postings
+    {
+        QByteArray data;
+        quint32 count = 0;
+        quint32 last = 0;
+    };
+
+    bool load();
+    bool write();
+    void updateFiles(const QStringList &files);
+    void removeFile(quint32 id);
+    static void appendId(Postings &postings, quint32 id);
+    static std::vector<quint32> fileTrigrams(const QByteArray &data, std::vector<quint64> &seen);
+
+    QString m_root;
+    QString m_fileName;
+
+    // Indexed by file id. Ids only grow while the index is loaded, so posting lists stay sorted.
+    std::vector<File> m_files;
+    QHash<QString, quint32> m_fileIds;
+    std::unordered_map<quint32, Postings> m_postings;
+    bool m_changed = false;
+    // Set when the index may not match the disk anymore, all files are checked on next update.
+    bool m_checkAll = true;
+    QSet<QString> m_changedDirectories;
+    std::mutex m_mutex;
+};
+
+} // namespace Core
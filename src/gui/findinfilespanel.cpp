@@ -11,37 +11,28 @@ Contact KDAB at <info@kdab.com> for commercial licensing options.
 #include "findinfilespanel.h"
 #include "core/project.h"
 #include "core/textdocument.h"
-#include <QFile>
 #include <QHBoxLayout>
 #include <QHeaderView>
+#include <QLabel>
 #include <QLineEdit>
-#include <QPainter>
+#include <QRegularExpression>
 #include <QToolButton>
 #include <QTreeWidget>
 #include <QTreeWidgetItem>
 #include <QVBoxLayout>
+#include <algorithm>
 
 namespace Gui {
 
 enum { LineRole = Qt::UserRole + 1, ColumnRole };
 
-class FindInFilesTreeWidget : public QTreeWidget
-{
-    Q_OBJECT
-public:
-    explicit FindInFilesTreeWidget(QWidget *parent = nullptr);
-
-protected:
-    void paintEvent(QPaintEvent *) override;
-
-private:
-    const bool m_findInFilesAvailable;
-};
+// The results are shown as they are found, the search stops after the first ones to keep the view responsive.
+static constexpr int MaxResults = 10000;
 
 FindInFilesPanel::FindInFilesPanel(QWidget *parent)
     : QWidget(parent)
     , m_toolBar(new QWidget(this))
-    , m_resultsDisplay(new FindInFilesTreeWidget(this))
+    , m_resultsDisplay(new QTreeWidget(this))
 {
     setWindowTitle(tr("Find in Files"));
     setObjectName("FindInFilesPanel");
@@ -59,8 +50,13 @@ FindInFilesPanel::FindInFilesPanel(QWidget *parent)
     connect(m_resultsDisplay, &QTreeWidget::itemActivated, this, [this](QTreeWidgetItem *item, int) {
         openFileAtItem(item);
     });
-    const bool available = Core::Project::instance()->isFindInFilesAvailable();
-    m_searchInput->setEnabled(available);
+    connect(&m_searchWatcher, &QFutureWatcherBase::resultsReadyAt, this, &FindInFilesPanel::addResults);
+    connect(&m_searchWatcher, &QFutureWatcherBase::finished, this, &FindInFilesPanel::updateStatus);
+}
+
+FindInFilesPanel::~FindInFilesPanel()
+{
+    m_searchWatcher.cancel();
 }
 
 QWidget *FindInFilesPanel::toolBar() const
@@ -83,6 +79,10 @@ void FindInFilesPanel::setupToolBar()
     searchButton->setEnabled(false);
     layout->addWidget(searchButton);
 
+    m_statusLabel = new QLabel(m_toolBar);
+    m_statusLabel->setContentsMargins(6, 0, 6, 0);
+    layout->addWidget(m_statusLabel);
+
     connect(m_searchInput, &QLineEdit::textChanged, this, [searchButton, this]() {
         searchButton->setEnabled(!m_searchInput->text().isEmpty());
     });
@@ -93,54 +93,70 @@ void FindInFilesPanel::setupToolBar()
 
 void FindInFilesPanel::findInFiles()
 {
-    auto results = Core::Project::instance()->findInFiles(m_searchInput->text());
-
-    for (auto &resultVariant : results) {
-        auto result = resultVariant.toMap();
-
-        QFile file(result["file"].toString());
-        if (file.open(QFile::ReadOnly)) {
-            QTextStream stream(&file);
-            int currentLine = 0;
-            const int line = result["line"].toInt();
-            while (!stream.atEnd()) {
-                const QString lineText = stream.readLine();
-                ++currentLine;
-                if (currentLine == line) {
-                    result["text"] = lineText;
-                    break;
-                }
-            }
-        }
-        resultVariant = result;
+    m_searchWatcher.cancel();
+    m_resultsDisplay->clear();
+    m_fileItems.clear();
+    m_resultCount = 0;
+
+    const QString pattern = m_searchInput->text();
+    const QRegularExpression regexp(pattern);
+    if (!regexp.isValid()) {
+        m_statusLabel->setText(tr("Invalid pattern: %1").arg(regexp.errorString()));
+        return;
     }
 
-    displayResults(results);
+    m_searchWatcher.setFuture(Core::Project::instance()->findInFilesAsync(pattern, MaxResults));
+    updateStatus();
 }
 
-void FindInFilesPanel::displayResults(const QVariantList &results) const
+void FindInFilesPanel::addResults(int begin, int end)
 {
-    m_resultsDisplay->clear();
-    QMap<QString, QTreeWidgetItem *> fileItems;
-
-    for (const auto &result : results) {
-        const auto map = result.toMap();
-        const QString filePath = map["file"].toString();
-        const int line = map["line"].toInt();
-        const int column = map["column"].toInt();
-        const QString text = map["text"].toString();
-
-        auto it = fileItems.find(filePath);
-        if (it == fileItems.end()) {
-            auto fileItem = new QTreeWidgetItem(m_resultsDisplay);
-            fileItem->setText(0, filePath);
-            it = fileItems.insert(filePath, fileItem);
+    m_resultsDisplay->setUpdatesEnabled(false);
+    for (int i = begin; i < end; ++i)
+        addResult(m_searchWatcher.resultAt(i));
+    m_resultsDisplay->setUpdatesEnabled(true);
+    updateStatus();
+}
+
+void FindInFilesPanel::addResult(const Core::FindInFiles::Match &match)
+{
+    auto it = m_fileItems.find(match.fileName);
+    if (it == m_fileItems.end()) {
+        // Files are searched in parallel, keep them sorted as they arrive.
+        int index = 0;
+        int count = m_resultsDisplay->topLevelItemCount();
+        while (count > 0) {
+            const int step = count / 2;
+            if (m_resultsDisplay->topLevelItem(index + step)->text(0) < match.fileName) {
+                index += step + 1;
+                count -= step + 1;
+            } else {
+                count = step;
+            }
         }
+        auto fileItem = new QTreeWidgetItem();
+        fileItem->setText(0, match.fileName);
+        m_resultsDisplay->insertTopLevelItem(index, fileItem);
+        it = m_fileItems.insert(match.fileName, fileItem);
+    }
+
+    auto lineItem = new QTreeWidgetItem(it.value());
+    lineItem->setText(0, QString("%1        %2").arg(match.line).arg(match.lineText));
+    lineItem->setData(0, LineRole, match.line);
+    lineItem->setData(0, ColumnRole, match.column);
+    ++m_resultCount;
+}
 
-        auto lineItem = new QTreeWidgetItem(it.value());
-        lineItem->setText(0, QString("%1        %2").arg(line).arg(text));
-        lineItem->setData(0, LineRole, line);
-        lineItem->setData(0, ColumnRole, column);
+void FindInFilesPanel::updateStatus()
+{
+    if (m_searchWatcher.isRunning()) {
+        m_statusLabel->setText(tr("Searching... %1 results").arg(m_resultCount));
+    } else if (!m_searchWatcher.isCanceled()
+               && m_searchWatcher.progressValue() < m_searchWatcher.progressMaximum()) {
+        // The search stopped at the maximum number of results, some files were not searched.
+        m_statusLabel->setText(tr("%1 results (truncated, the search stopped)").arg(m_resultCount));
+    } else {
+        m_statusLabel->setText(tr("%1 results").arg(m_resultCount));
     }
 }
 
@@ -162,28 +178,4 @@ void FindInFilesPanel::openFileAtItem(QTreeWidgetItem *item)
     }
 }
 
-FindInFilesTreeWidget::FindInFilesTreeWidget(QWidget *parent)
-    : QTreeWidget(parent)
-    , m_findInFilesAvailable(Core::Project::instance()->isFindInFilesAvailable())
-{
-}
-
-void FindInFilesTreeWidget::paintEvent(QPaintEvent *event)
-{
-    if (!m_findInFilesAvailable) {
-        QPainter p(viewport());
-
-        QFont font = p.font();
-        font.setItalic(true);
-        p.setFont(font);
-
-        p.drawText(QRect(0, 0, width(), height()), Qt::AlignCenter,
-                   tr("Ripgrep (rg) executable not found.\nPlease ensure that ripgrep is installed and its location is "
-                      "included in the PATH environment variable."));
-    } else {
-        QTreeWidget::paintEvent(event);
-    }
-}
-
 } // namespace Gui
-#include "findinfilespanel.moc"
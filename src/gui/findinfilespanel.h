@@ -10,10 +10,15 @@ Contact KDAB at <info@kdab.com> for commercial licensing options.
 
 #pragma once
 
+class QLabel;
 class QLineEdit;
 class QToolButton;
 class QTreeWidgetItem;
 
+#include "core/findinfiles.h"
+
+#include <QFutureWatcher>
+#include <QHash>
 #include <QTreeWidget>
 
 namespace Gui {
@@ -24,18 +29,27 @@ class FindInFilesPanel : public QWidget
 
 public:
     explicit FindInFilesPanel(QWidget *parent = nullptr);
+    ~FindInFilesPanel() override;
 
     QWidget *toolBar() const;
 
 private:
-    void displayResults(const QVariantList &results) const;
+    void addResults(int begin, int end);
+    void addResult(const Core::FindInFiles::Match &match);
     void findInFiles();
     void openFileAtItem(QTreeWidgetItem *item);
     void setupToolBar();
+    void updateStatus();
 
     QWidget *const m_toolBar;
     QTreeWidget *m_resultsDisplay = nullptr;
     QLineEdit *m_searchInput;
+    QLabel *m_statusLabel;
+
+    // Results of the current search, a new search cancels the previous one.
+    QFutureWatcher<Core::FindInFiles::Match> m_searchWatcher;
+    QHash<QString, QTreeWidgetItem *> m_fileItems;
+    int m_resultCount = 0;
 };
 
 } // namespace Gui
@@ -22,7 +22,7 @@
 
 #include <QAbstractTableModel>
 #include <QAction>
-#include <QDirIterator>
+#include <QDir>
 #include <QFileInfo>
 #include <QHeaderView>
 #include <QKeyEvent>
@@ -85,7 +85,7 @@ public:
 
         beginResetModel();
 
-        m_files = allFilesInDirectory(Core::Project::instance()->root());
+        m_files = allProjectFiles();
 
         auto byFileName = [](const auto &fi1, const auto &fi2) {
             return fi1.fileName < fi2.fileName;
@@ -102,20 +102,15 @@ private:
         QString path;
     };
 
-    // Returns the list of all files recursively, without the hidden files or directories (starting with '.')
-    QList<FileInfo> allFilesInDirectory(const QString &path)
+    // Returns the list of all project files, without the hidden and ignored files.
+    static QList<FileInfo> allProjectFiles()
     {
+        Core::LoggerDisabler ld;
+        const auto fileNames = Core::Project::instance()->allFiles(Core::Project::FullPath);
         QList<FileInfo> result;
-        QDir dir(path);
-        const auto fiList = dir.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
-        for (const auto &fi : fiList) {
-            if (fi.fileName().startsWith('.'))
-                continue;
-            if (fi.isFile())
-                result.push_back({fi.fileName(), fi.absoluteFilePath()});
-            else if (fi.isDir())
-                result.append(allFilesInDirectory(fi.absoluteFilePath()));
-        }
+        result.reserve(fileNames.size());
+        for (const auto &fileName : fileNames)
+            result.push_back({fileName.mid(fileName.lastIndexOf('/') + 1), fileName});
         return result;
     }
     QList<FileInfo> m_files;
@@ -24,6 +24,7 @@
 #include <QMessageBox>
 #include <QPalette>
 #include <QTextEdit>
+#include <algorithm>
 
 namespace Gui {
 
@@ -194,14 +195,44 @@ void TreeSitterInspector::changeQueryState()
 
         const QColor col = palette().color(QPalette::ColorGroup::Normal, QPalette::Highlight);
 
-        ui->queryInfo->setText(tr("<span style='color:%1'>%2 Patterns - %3 Matches - %4 Captures</span>")
+        const auto *profile = m_treemodel.queryProfile();
+        const double totalMsecs = profile ? profile->totalNsecs / 1'000'000.0 : 0.0;
+
+        ui->queryInfo->setText(tr("<span style='color:%1'>%2 Patterns - %3 Matches - %4 Captures - %5 ms</span>")
                                    .arg(patternCount == 0 || matchCount == 0 ? col.name() : "green")
                                    .arg(patternCount)
                                    .arg(matchCount)
-                                   .arg(m_treemodel.captureCount()));
+                                   .arg(m_treemodel.captureCount())
+                                   .arg(totalMsecs, 0, 'f', 2));
+        ui->queryInfo->setToolTip(profile ? profileToolTip(*profile) : QString());
     }
 }
 
+// Details the candidates and predicates of each pattern, to find out which one makes the query slow.
+QString TreeSitterInspector::profileToolTip(const treesitter::QueryProfile &profile) const
+{
+    QString toolTip = QString("<table><tr><th>%1</th><th>%2</th><th>%3</th><th>%4</th></tr>")
+                          .arg(tr("Pattern"), tr("Candidates"), tr("Rejections"), tr("Predicates"));
+    for (int i = 0; i < profile.patterns.size(); ++i) {
+        const auto &pattern = profile.patterns.at(i);
+        QStringList predicates;
+        for (const auto &predicate : pattern.predicates) {
+            predicates.push_back(tr("#%1 %2 calls, %3 rejections, %4 ms")
+                                     .arg(predicate.name)
+                                     .arg(predicate.calls)
+                                     .arg(predicate.rejections)
+                                     .arg(predicate.nsecs / 1'000'000.0, 0, 'f', 2));
+        }
+        toolTip += QString("<tr><td>%1</td><td>%2</td><td>%3</td><td>%4</td></tr>")
+                       .arg(i)
+                       .arg(pattern.candidates)
+                       .arg(pattern.rejections)
+                       .arg(predicates.join("<br/>"));
+    }
+    toolTip += "</table>";
+    return toolTip;
+}
+
 void TreeSitterInspector::changeCurrentDocument(Core::Document *document)
 {
     setDocument(qobject_cast<Core::CodeDocument *>(document));
@@ -248,18 +279,50 @@ void TreeSitterInspector::showUnnamedChanged()
 {
     // technically the text didn't change, but this will force
     // a complete re-parse and re-build of the entire tree.
+    m_treemodel.clear();
     changeText();
 }
 
+static bool sameRanges(const QList<treesitter::Range> &ranges, const QList<treesitter::Range> &otherRanges)
+{
+    return std::ranges::equal(ranges, otherRanges, [](const treesitter::Range &range, const treesitter::Range &other) {
+        return range.start_byte == other.start_byte && range.end_byte == other.end_byte;
+    });
+}
+
 void TreeSitterInspector::changeText()
 {
-    QString text;
+    const auto oldText = m_text;
     {
         Core::LoggerDisabler disableLogging;
-        text = m_document->text();
+        m_text = m_document->text();
     }
-    m_parser.setIncludedRanges(m_document->includedRanges());
-    auto tree = m_parser.parseString(text);
+    auto includedRanges = m_document->includedRanges();
+
+    // Reparse incrementally from the tree displayed, so the rows of the nodes not affected by the edit are kept,
+    // with their expanded and selected state.
+    // Changing the included ranges changes the whole tree, in that case start again from scratch.
+    const auto *oldTree = m_treemodel.tree();
+    if (oldTree && sameRanges(includedRanges, m_includedRanges)) {
+        const auto edit = treesitter::inputEdit(oldText, m_text);
+        if (!edit.has_value()) {
+            return;
+        }
+
+        auto editedTree = oldTree->copy();
+        editedTree.edit(edit.value());
+        auto tree = m_parser.parseString(m_text, &editedTree);
+        if (tree.has_value()) {
+            const auto changedRanges = editedTree.changedRanges(tree.value());
+            m_treemodel.updateTree(std::move(tree.value()), edit.value(), changedRanges, makePredicates());
+            changeQueryState();
+            return;
+        }
+    }
+
+    m_includedRanges = std::move(includedRanges);
+    m_parser.setIncludedRanges(m_includedRanges);
+    auto tree = m_parser.parseString(m_text);
     if (tree.has_value()) {
         m_treemodel.setTree(std::move(tree.value()), makePredicates(), ui->enableUnnamed->isChecked());
         ui->treeInspector->expandAll();
@@ -294,10 +357,14 @@ void TreeSitterInspector::setDocument(Core::CodeDocument *document)
         connect(m_document, &Core::CodeDocument::textChanged, this, &TreeSitterInspector::changeText);
         connect(m_document, &Core::CodeDocument::positionChanged, this, &TreeSitterInspector::changeCursor);
 
+        // The tree displayed belongs to the previous document, it can't be updated incrementally.
+        m_treemodel.clear();
         changeCursor();
         changeText();
     } else {
         m_parser = {nullptr};
+        m_text.clear();
+        m_includedRanges.clear();
         m_treemodel.clear();
     }
 }
@@ -325,9 +392,8 @@ QString TreeSitterInspector::highlightQueryError(const treesitter::Query::Error
 std::unique_ptr<treesitter::Predicates> TreeSitterInspector::makePredicates()
 {
     if (m_document) {
-        // No need to always log the call to TextDocument::text
-        Core::LoggerDisabler disabler;
-        return std::make_unique<treesitter::Predicates>(m_document->text());
+        // Share the text the tree was parsed from, no need to copy the document again.
+        return std::make_unique<treesitter::Predicates>(m_text);
     } else {
         return nullptr;
     }
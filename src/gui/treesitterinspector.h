@@ -72,6 +72,7 @@ private:
     void changeTreeSelection(const QModelIndex &current, const QModelIndex &previous);
 
     QString highlightQueryError(const treesitter::Query::Error &error) const;
+    QString profileToolTip(const treesitter::QueryProfile &profile) const;
 
     Ui::TreeSitterInspector *ui;
 
@@ -80,6 +81,9 @@ private:
     QueryErrorHighlighter *m_errorHighlighter;
 
     Core::CodeDocument *m_document;
+    // Text the current tree was parsed from, shared with the predicates.
+    QString m_text;
+    QList<treesitter::Range> m_includedRanges;
 
     QString m_queryText;
 };
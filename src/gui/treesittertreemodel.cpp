@@ -12,14 +12,18 @@
 #include "utils/log.h"
 
 #include <QBrush>
+#include <QByteArray>
 #include <QColor>
+#include <algorithm>
 
 namespace Gui {
 
-TreeSitterTreeModel::TreeNode::TreeNode(const treesitter::Node &node, const TreeNode *parent, bool enableUnnamed)
+TreeSitterTreeModel::TreeNode::TreeNode(const treesitter::Node &node, const TreeNode *parent, bool enableUnnamed,
+                                        QString fieldName /* = {} */)
     : m_parent(parent)
     , m_node(node)
     , m_enableUnnamed(enableUnnamed)
+    , m_fieldName(std::move(fieldName))
 {
 }
 
@@ -34,9 +38,10 @@ std::vector<std::unique_ptr<TreeSitterTreeModel::TreeNode>> &TreeSitterTreeModel
 {
 
     if (m_children.empty() && childCount() > 0) {
-        auto children = m_enableUnnamed ? m_node.children() : m_node.namedChildren();
-        for (const auto &child : children) {
-            m_children.emplace_back(new TreeNode(child, this, m_enableUnnamed));
+        m_children.reserve(childCount());
+        const auto range = m_enableUnnamed ? m_node.childRange() : m_node.namedChildRange();
+        for (auto it = range.begin(); it != range.end(); ++it) {
+            m_children.emplace_back(new TreeNode(*it, this, m_enableUnnamed, it.fieldName()));
         }
     }
 
@@ -45,6 +50,10 @@ std::vector<std::unique_ptr<TreeSitterTreeModel::TreeNode>> &TreeSitterTreeModel
 
 int TreeSitterTreeModel::TreeNode::childCount() const
 {
+    // Once created, the children are the rows known by the views, even while the node is updated.
+    if (!m_children.empty()) {
+        return static_cast<int>(m_children.size());
+    }
     return static_cast<int>(m_enableUnnamed ? m_node.childCount() : m_node.namedChildCount());
 }
 
@@ -58,20 +67,16 @@ const TreeSitterTreeModel::TreeNode *TreeSitterTreeModel::TreeNode::child(int ro
 
 QVariant TreeSitterTreeModel::TreeNode::data(int column) const
 {
-    auto fieldName = QString();
-    if (parent()) {
-        fieldName = parent()->m_node.fieldNameForChild(m_node);
-    }
     switch (column) {
     case 0:
-        if (fieldName.isEmpty()) {
+        if (m_fieldName.isEmpty()) {
             auto type = m_node.type();
             // Some anonymous nodes actually cover a newline, so we need to escape it.
             // This is usually for C preprocessor directives.
             type.replace("\n", "\\n");
             return type;
         } else {
-            return QString("%1: %2").arg(fieldName, m_node.type());
+            return QString("%1: %2").arg(m_fieldName, m_node.type());
         }
     case 1:
         return QString("[%1:%2](%3) - [%4:%5](%6)")
@@ -266,6 +271,26 @@ void TreeSitterTreeModel::setTree(treesitter::Tree &&tree, std::unique_ptr<trees
     endResetModel();
 }
 
+void TreeSitterTreeModel::updateTree(treesitter::Tree &&tree, const TSInputEdit &edit,
+                                     const QList<TSRange> &changedRanges,
+                                     std::unique_ptr<treesitter::Predicates> &&predicates)
+{
+    Q_ASSERT(m_rootNode);
+
+    // All nodes are bound to the new tree before the old one is released.
+    updateNode(*m_rootNode, tree.rootNode(), TreeUpdate {.edit = edit, .changedRanges = changedRanges});
+    emit dataChanged(indexFor(*m_rootNode, 0), indexFor(*m_rootNode, 1));
+    m_tree = std::move(tree);
+
+    // Captures are keyed by nodes of the previous tree, so all of them may have changed.
+    const bool hadQuery = m_query.has_value();
+    executeQuery(std::move(predicates));
+    if (hadQuery) {
+        emit dataChanged(indexFor(*m_rootNode, 2), indexFor(*m_rootNode, 2));
+        allCapturesChanged(*m_rootNode);
+    }
+}
+
 void TreeSitterTreeModel::clear()
 {
     beginResetModel();
@@ -275,6 +300,177 @@ void TreeSitterTreeModel::clear()
     endResetModel();
 }
 
+const treesitter::Tree *TreeSitterTreeModel::tree() const
+{
+    return m_tree.has_value() ? &m_tree.value() : nullptr;
+}
+
+namespace {
+    // Maps a position in the text before the edit to the text after it, or returns -1 if the position was removed.
+    qint64 mapPosition(uint32_t position, const TSInputEdit &edit)
+    {
+        const auto start = edit.start_byte / sizeof(QChar);
+        const auto oldEnd = edit.old_end_byte / sizeof(QChar);
+        const auto newEnd = edit.new_end_byte / sizeof(QChar);
+        if (position <= start) {
+            return position;
+        }
+        if (position >= oldEnd) {
+            return static_cast<qint64>(position) - oldEnd + newEnd;
+        }
+        return -1;
+    }
+
+    bool sameType(const treesitter::Node &oldNode, const treesitter::Node &newNode)
+    {
+        return qstrcmp(oldNode.rawType(), newNode.rawType()) == 0;
+    }
+
+    bool samePosition(const treesitter::Node &oldNode, const treesitter::Node &newNode)
+    {
+        const auto oldStart = oldNode.startPoint();
+        const auto oldEnd = oldNode.endPoint();
+        const auto newStart = newNode.startPoint();
+        const auto newEnd = newNode.endPoint();
+        return oldNode.startPosition() == newNode.startPosition() && oldNode.endPosition() == newNode.endPosition()
+            && oldStart.row == newStart.row && oldStart.column == newStart.column && oldEnd.row == newEnd.row
+            && oldEnd.column == newEnd.column;
+    }
+}
+
+bool TreeSitterTreeModel::TreeUpdate::isChanged(const treesitter::Node &newNode) const
+{
+    const auto start = newNode.startPosition();
+    const auto end = newNode.endPosition();
+    const auto intersects = [start, end](uint32_t rangeStart, uint32_t rangeEnd) {
+        return rangeStart / sizeof(QChar) <= end && start <= rangeEnd / sizeof(QChar);
+    };
+
+    if (intersects(edit.start_byte, edit.new_end_byte)) {
+        return true;
+    }
+    return std::ranges::any_of(changedRanges, [&intersects](const TSRange &range) {
+        return intersects(range.start_byte, range.end_byte);
+    });
+}
+
+void TreeSitterTreeModel::updateNode(TreeNode &node, const treesitter::Node &newNode, const TreeUpdate &update)
+{
+    // Get the field names with the children, looking them up afterward is linear in the number of children.
+    QList<treesitter::Node> newChildren;
+    QStringList newFieldNames;
+    const auto range = node.m_enableUnnamed ? newNode.childRange() : newNode.namedChildRange();
+    for (auto it = range.begin(); it != range.end(); ++it) {
+        newChildren.push_back(*it);
+        newFieldNames.push_back(it.fieldName());
+    }
+
+    // The views know the rows of a node from its old tree-sitter node, until they are created.
+    // Create them if the number of rows changed, so they can be matched against the new ones.
+    if (node.m_children.empty() && node.childCount() != static_cast<int>(newChildren.size())) {
+        node.children();
+    }
+    node.m_node = newNode;
+    if (node.m_children.empty()) {
+        return;
+    }
+
+    const auto oldCount = static_cast<int>(node.m_children.size());
+    const auto newCount = static_cast<int>(newChildren.size());
+    const bool changed = update.isChanged(newNode);
+
+    // Outside of the changed ranges, the children are the same, only their position may have moved.
+    // Inside, keep the children matching at the start and the end, and replace the ones in between.
+    int prefix = 0;
+    int suffix = 0;
+    if (!changed && oldCount == newCount) {
+        prefix = oldCount;
+    } else {
+        const auto minCount = std::min(oldCount, newCount);
+        while (prefix < minCount) {
+            const auto &oldChild = node.m_children[prefix]->m_node;
+            if (!sameType(oldChild, newChildren[prefix])
+                || mapPosition(oldChild.startPosition(), update.edit) != newChildren[prefix].startPosition()) {
+                break;
+            }
+            ++prefix;
+        }
+        while (suffix < minCount - prefix) {
+            const auto &oldChild = node.m_children[oldCount - 1 - suffix]->m_node;
+            const auto &newChild = newChildren[newCount - 1 - suffix];
+            if (!sameType(oldChild, newChild)
+                || mapPosition(oldChild.endPosition(), update.edit) != newChild.endPosition()) {
+                break;
+            }
+            ++suffix;
+        }
+    }
+
+    const auto parentIndex = indexFor(node, 0);
+    const int removed = oldCount - prefix - suffix;
+    const int inserted = newCount - prefix - suffix;
+
+    // Insert before removing, so the node keeps its children (and its row count) during the update.
+    if (inserted > 0) {
+        beginInsertRows(parentIndex, prefix, prefix + inserted - 1);
+        std::vector<std::unique_ptr<TreeNode>> insertedNodes;
+        insertedNodes.reserve(inserted);
+        for (int i = prefix; i < prefix + inserted; ++i) {
+            insertedNodes.emplace_back(new TreeNode(newChildren[i], &node, node.m_enableUnnamed, newFieldNames[i]));
+        }
+        node.m_children.insert(node.m_children.begin() + prefix, std::make_move_iterator(insertedNodes.begin()),
+                               std::make_move_iterator(insertedNodes.end()));
+        endInsertRows();
+    }
+    if (removed > 0) {
+        const int first = prefix + inserted;
+        beginRemoveRows(parentIndex, first, first + removed - 1);
+        node.m_children.erase(node.m_children.begin() + first, node.m_children.begin() + first + removed);
+        endRemoveRows();
+    }
+
+    int firstChanged = -1;
+    int lastChanged = -1;
+    const auto updateRow = [&](int row) {
+        auto &child = *node.m_children[row];
+        const auto &newChild = newChildren[row];
+        const bool rowChanged = !sameType(child.m_node, newChild) || !samePosition(child.m_node, newChild)
+            || child.m_fieldName != newFieldNames[row];
+        child.m_fieldName = newFieldNames[row];
+        if (rowChanged) {
+            firstChanged = firstChanged == -1 ? row : firstChanged;
+            lastChanged = row;
+        }
+        updateNode(child, newChild, update);
+    };
+    for (int row = 0; row < prefix; ++row) {
+        updateRow(row);
+    }
+    for (int row = newCount - suffix; row < newCount; ++row) {
+        updateRow(row);
+    }
+
+    if (firstChanged != -1) {
+        emit dataChanged(createIndex(firstChanged, 0, node.m_children[firstChanged].get()),
+                         createIndex(lastChanged, 1, node.m_children[lastChanged].get()));
+    }
+}
+
+void TreeSitterTreeModel::allCapturesChanged(const TreeNode &node)
+{
+    // Don't use TreeNode::children, rows that weren't created are not known by the views.
+    const auto &children = node.m_children;
+    if (children.empty()) {
+        return;
+    }
+
+    emit dataChanged(createIndex(0, 2, children.front().get()),
+                     createIndex(static_cast<int>(children.size()) - 1, 2, children.back().get()));
+    for (const auto &child : children) {
+        allCapturesChanged(*child);
+    }
+}
+
 void TreeSitterTreeModel::executeQuery(std::unique_ptr<treesitter::Predicates> &&predicates)
 {
     treesitter::QueryCursor cursor;
@@ -284,6 +480,7 @@ void TreeSitterTreeModel::executeQuery(std::unique_ptr<treesitter::Predicates> &
         m_query->numCaptures = 0;
         m_query->numMatches = 0;
 
+        cursor.setProfilingEnabled(true);
         cursor.execute(m_query->query, m_rootNode->tsNode(), std::move(predicates));
 
         while (const auto match = cursor.nextMatch()) {
@@ -295,6 +492,7 @@ void TreeSitterTreeModel::executeQuery(std::unique_ptr<treesitter::Predicates> &
                 m_query->captures[capture.node] += " @" + m_query->query->captureAt(capture.id).name;
             }
         }
+        m_query->profile = cursor.profile();
     }
 }
 
@@ -319,7 +517,11 @@ void TreeSitterTreeModel::setQuery(const std::shared_ptr<treesitter::Query> &que
 
     if (query != nullptr) {
         m_query =
-            QueryData {.query = query, .captures = decltype(m_query->captures)(), .numMatches = 0, .numCaptures = 0};
+            QueryData {.query = query,
+                       .captures = decltype(m_query->captures)(),
+                       .numMatches = 0,
+                       .numCaptures = 0,
+                       .profile = {}};
     } else {
         m_query = {};
     }
@@ -389,4 +591,12 @@ int TreeSitterTreeModel::captureCount() const
     return 0;
 }
 
+const treesitter::QueryProfile *TreeSitterTreeModel::queryProfile() const
+{
+    if (m_query.has_value() && m_query->profile.has_value()) {
+        return &m_query->profile.value();
+    }
+    return nullptr;
+}
+
 }
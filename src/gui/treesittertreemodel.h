@@ -28,7 +28,8 @@ public:
     class TreeNode
     {
     public:
-        explicit TreeNode(const treesitter::Node &node, const TreeNode *parent, bool enableUnnamed);
+        explicit TreeNode(const treesitter::Node &node, const TreeNode *parent, bool enableUnnamed,
+                          QString fieldName = {});
 
         int childCount() const;
         const TreeNode *child(int row) const;
@@ -54,6 +55,10 @@ public:
         mutable std::vector<std::unique_ptr<TreeNode>> m_children;
         treesitter::Node m_node;
         bool m_enableUnnamed;
+        // Field name of the node in its parent, found when creating the children, as looking it up is linear.
+        QString m_fieldName;
+
+        friend class TreeSitterTreeModel;
     };
 
     TreeSitterTreeModel(QObject *parent = nullptr);
@@ -73,20 +78,37 @@ public:
                   std::unique_ptr<treesitter::Predicates> &&predicates);
     void setCursorPosition(int position);
     void setTree(treesitter::Tree &&tree, std::unique_ptr<treesitter::Predicates> &&predicates, bool enableUnnamed);
+    // Replaces the tree by `tree`, parsed incrementally from it after `edit`, while keeping the rows of the nodes
+    // that didn't change. Only the rows of the nodes inside `changedRanges` are inserted or removed.
+    void updateTree(treesitter::Tree &&tree, const TSInputEdit &edit, const QList<TSRange> &changedRanges,
+                    std::unique_ptr<treesitter::Predicates> &&predicates);
     void clear();
 
+    const treesitter::Tree *tree() const;
+
     std::optional<treesitter::Node> tsNode(const QModelIndex &index) const;
 
     bool hasQuery() const;
     int patternCount() const;
     int captureCount() const;
     int matchCount() const;
+    const treesitter::QueryProfile *queryProfile() const;
 
 private:
     void positionChanged(int position);
     void capturesChanged(const std::unordered_map<treesitter::Node, QString> &oldCaptures);
     void executeQuery(std::unique_ptr<treesitter::Predicates> &&predicates);
 
+    struct TreeUpdate
+    {
+        const TSInputEdit &edit;
+        const QList<TSRange> &changedRanges;
+
+        bool isChanged(const treesitter::Node &newNode) const;
+    };
+    void updateNode(TreeNode &node, const treesitter::Node &newNode, const TreeUpdate &update);
+    void allCapturesChanged(const TreeNode &node);
+
     int m_cursorPosition;
     std::optional<treesitter::Tree> m_tree;
 
@@ -96,6 +118,7 @@ private:
         std::unordered_map<treesitter::Node, QString> captures;
         int numMatches;
         int numCaptures;
+        std::optional<treesitter::QueryProfile> profile;
     };
 
     std::optional<QueryData> m_query;
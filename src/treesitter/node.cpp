@@ -9,6 +9,7 @@
 */
 
 #include "node.h"
+#include "tree_cursor.h"
 #include "utils/log.h"
 
 #include <kdalgorithms.h>
@@ -118,30 +119,34 @@ uint32_t Node::childCount() const
 
 QList<Node> Node::children() const
 {
-    const auto count = childCount();
     QList<Node> result;
-    result.reserve(count);
-
-    for (uint32_t i = 0; i < count; i++) {
-        result.emplace_back(Node(ts_node_child(m_node, i)));
+    result.reserve(childCount());
+    for (auto child : childRange()) {
+        result.emplace_back(child);
     }
-
     return result;
 }
 
 QList<Node> Node::namedChildren() const
 {
-    const auto count = namedChildCount();
     QList<Node> result;
-    result.reserve(count);
-
-    for (uint32_t i = 0; i < count; i++) {
-        result.emplace_back(Node(ts_node_named_child(m_node, i)));
+    result.reserve(namedChildCount());
+    for (auto child : namedChildRange()) {
+        result.emplace_back(child);
     }
-
     return result;
 }
 
+ChildRange Node::childRange() const
+{
+    return ChildRange(*this, false);
+}
+
+ChildRange Node::namedChildRange() const
+{
+    return ChildRange(*this, true);
+}
+
 Node Node::nextSibling() const
 {
     return Node(ts_node_next_sibling(m_node));
@@ -207,7 +212,7 @@ bool Node::hasError() const
     return ts_node_has_error(m_node);
 }
 
-QString Node::textIn(const QString &source) const
+QStringView Node::textViewIn(QStringView source) const
 {
     const auto start = this->startPosition();
     const auto end = this->endPosition();
@@ -215,7 +220,12 @@ QString Node::textIn(const QString &source) const
     return source.sliced(start, end - start);
 }
 
-QString Node::textExcept(const QString &source, const QList<QString> &nodeTypes) const
+QString Node::textIn(QStringView source) const
+{
+    return textViewIn(source).toString();
+}
+
+QString Node::textExcept(QStringView source, const QList<QString> &nodeTypes) const
 {
     auto text = textIn(source);
 
@@ -239,15 +249,14 @@ QList<Node> Node::allChildrenOfType(const QList<QString> &nodeTypes) const
 {
     auto result = QList<Node>();
 
-    const auto allChildren = children();
-    for (const auto &child : allChildren) {
-        // break the recursion at the first node that is of the given type
-        // That way we don't get overlapping child nodes.
-        if (kdalgorithms::contains(nodeTypes, child.type())) {
-            result.push_back(child);
-        } else {
-            result.append(child.allChildrenOfType(nodeTypes));
-        }
+    const auto types = kdalgorithms::transformed<QByteArrayList>(nodeTypes, [](const QString &type) {
+        return type.toLatin1();
+    });
+    PreorderWalker walker(*this, types);
+    while (const auto child = walker.next()) {
+        result.push_back(*child);
+        // Don't visit the descendants of a node of the given type, that way we don't get overlapping child nodes.
+        walker.skipChildren();
     }
 
     return result;
@@ -268,4 +277,63 @@ Node Node::parent() const
     return Node(ts_node_parent(m_node));
 }
 
+// ------------------------ ChildIterator --------------------
+ChildIterator::ChildIterator(const Node &parent, bool namedOnly)
+    : m_cursor(ts_tree_cursor_new(parent.m_node))
+    , m_namedOnly(namedOnly)
+    , m_valid(ts_tree_cursor_goto_first_child(&m_cursor))
+{
+    skipUnnamed();
+}
+
+ChildIterator::ChildIterator(ChildIterator &&other) noexcept
+    : m_cursor(ts_tree_cursor_copy(&other.m_cursor))
+    , m_namedOnly(other.m_namedOnly)
+    , m_valid(other.m_valid)
+{
+    other.m_valid = false;
+}
+
+ChildIterator &ChildIterator::operator=(ChildIterator &&other) noexcept
+{
+    if (this != &other) {
+        ts_tree_cursor_delete(&m_cursor);
+        m_cursor = ts_tree_cursor_copy(&other.m_cursor);
+        m_namedOnly = other.m_namedOnly;
+        m_valid = other.m_valid;
+        other.m_valid = false;
+    }
+    return *this;
+}
+
+ChildIterator::~ChildIterator()
+{
+    ts_tree_cursor_delete(&m_cursor);
+}
+
+Node ChildIterator::operator*() const
+{
+    return Node(ts_tree_cursor_current_node(&m_cursor));
+}
+
+ChildIterator &ChildIterator::operator++()
+{
+    m_valid = ts_tree_cursor_goto_next_sibling(&m_cursor);
+    skipUnnamed();
+    return *this;
+}
+
+QString ChildIterator::fieldName() const
+{
+    const auto *name = ts_tree_cursor_current_field_name(&m_cursor);
+    return name ? QString(name) : QString();
+}
+
+void ChildIterator::skipUnnamed()
+{
+    while (m_namedOnly && m_valid && !ts_node_is_named(ts_tree_cursor_current_node(&m_cursor))) {
+        m_valid = ts_tree_cursor_goto_next_sibling(&m_cursor);
+    }
+}
+
 }
@@ -13,12 +13,16 @@
 #include <tree_sitter/api.h>
 
 #include <QString>
+#include <QStringView>
 #include <QVector>
+#include <iterator>
 
 namespace treesitter {
 
 using Point = TSPoint;
 
+class ChildRange;
+
 class Node
 {
 public:
@@ -40,6 +44,10 @@ public:
     uint32_t childCount() const;
     QVector<Node> children() const;
 
+    // Iterate over the children without allocating a list, prefer those to children() and namedChildren() in loops.
+    ChildRange childRange() const;
+    ChildRange namedChildRange() const;
+
     Node nextSibling() const;
     Node previousSibling() const;
     Node nextNamedSibling() const;
@@ -58,8 +66,10 @@ public:
 
     bool hasError() const;
 
-    QString textIn(const QString &source) const;
-    QString textExcept(const QString &source, const QVector<QString> &nodeTypes) const;
+    // Returns a view on the node text, only valid as long as `source` is alive.
+    QStringView textViewIn(QStringView source) const;
+    QString textIn(QStringView source) const;
+    QString textExcept(QStringView source, const QVector<QString> &nodeTypes) const;
 
     Node descendantForRange(uint32_t left, uint32_t right) const;
     Node parent() const;
@@ -79,6 +89,56 @@ public:
     friend class TreeCursor;
     friend class QueryCursor;
     friend class QueryMatch;
+    friend class ChildIterator;
+    friend class PreorderWalker;
+};
+
+// Iterator over the children of a node, using a TSTreeCursor.
+// ts_node_child is linear in the number of children, going to the next sibling with a cursor is not.
+// The iterator owns its cursor, so it can only be moved, which is enough for range-based for loops and std::ranges.
+class ChildIterator
+{
+public:
+    using value_type = Node;
+    using difference_type = std::ptrdiff_t;
+
+    ChildIterator(const Node &parent, bool namedOnly);
+    ChildIterator(ChildIterator &&other) noexcept;
+    ChildIterator &operator=(ChildIterator &&other) noexcept;
+    ~ChildIterator();
+
+    Node operator*() const;
+    ChildIterator &operator++();
+    void operator++(int) { ++*this; }
+
+    bool operator==(std::default_sentinel_t) const { return !m_valid; }
+
+    // The field name of the current child in its parent, a null QString if it has none.
+    QString fieldName() const;
+
+private:
+    void skipUnnamed();
+
+    TSTreeCursor m_cursor;
+    bool m_namedOnly;
+    bool m_valid;
+};
+
+class ChildRange
+{
+public:
+    ChildRange(const Node &parent, bool namedOnly)
+        : m_parent(parent)
+        , m_namedOnly(namedOnly)
+    {
+    }
+
+    ChildIterator begin() const { return ChildIterator(m_parent, m_namedOnly); }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    Node m_parent;
+    bool m_namedOnly;
 };
 
 }
@@ -13,6 +13,7 @@
 #include "treesitter/languages.h"
 
 #include <tree_sitter/api.h>
+#include <unordered_map>
 #include <utility>
 
 namespace treesitter {
@@ -83,4 +84,27 @@ TSLanguage *Parser::getLanguage(Core::Document::Type type)
         Q_UNREACHABLE();
     }
 }
+
+bool Parser::hasLanguage(Core::Document::Type type)
+{
+    switch (type) {
+    case Core::Document::Type::Qml:
+    case Core::Document::Type::Cpp:
+    case Core::Document::Type::CSharp:
+    case Core::Document::Type::Rust:
+        return true;
+    default:
+        return false;
+    }
+}
+
+Parser &Parser::threadParser(Core::Document::Type type)
+{
+    thread_local std::unordered_map<Core::Document::Type, Parser> parsers;
+    auto it = parsers.find(type);
+    if (it == parsers.end()) {
+        it = parsers.emplace(type, Parser(getLanguage(type))).first;
+    }
+    return it->second;
+}
 }
@@ -58,6 +58,11 @@ public:
     const TSLanguage *language() const;
 
     static TSLanguage *getLanguage(Core::Document::Type type);
+    // Only the types with a grammar can be passed to getLanguage.
+    static bool hasLanguage(Core::Document::Type type);
+
+    // Parsers can't be shared between threads, each thread keeps its own parser for each type, reused between calls.
+    static Parser &threadParser(Core::Document::Type type);
 
 private:
     TSParser *m_parser;
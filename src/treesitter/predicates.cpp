@@ -18,63 +18,91 @@
 #include <ranges>
 #include <set>
 
+#include <QElapsedTimer>
 #include <QRegularExpression>
 
 namespace treesitter {
 
-QString QString_identity(const QString &string)
+static bool equal(QStringView left, QStringView right)
 {
-    return string;
+    return left == right;
 }
 
-QString QString_no_whitespace(const QString &string)
+// Same as comparing the strings with all whitespaces removed, but without building those strings.
+static bool equalIgnoringWhitespace(QStringView left, QStringView right)
 {
-    auto simplified = string.simplified();
-    simplified.replace(" ", "");
-    return simplified;
+    auto leftIt = left.cbegin();
+    auto rightIt = right.cbegin();
+    while (true) {
+        while (leftIt != left.cend() && leftIt->isSpace())
+            ++leftIt;
+        while (rightIt != right.cend() && rightIt->isSpace())
+            ++rightIt;
+
+        if (leftIt == left.cend() || rightIt == right.cend())
+            return leftIt == left.cend() && rightIt == right.cend();
+        if (*leftIt != *rightIt)
+            return false;
+        ++leftIt;
+        ++rightIt;
+    }
 }
 
-Predicates::Filters Predicates::filters()
+const Predicates::Filters &Predicates::filters()
 {
-    Predicates::Filters filters;
+    static const auto filters = [] {
+        Predicates::Filters filters;
 #define REGISTER_FILTER(NAME)                                                                                          \
     filters.filterFunctions[#NAME "?"] = &Predicates::filter_##NAME;                                                   \
     filters.checkFunctions[#NAME "?"] = &Predicates::checkFilter_##NAME
 
-    REGISTER_FILTER(eq);
-    REGISTER_FILTER(eq_except);
-    REGISTER_FILTER(like);
-    REGISTER_FILTER(like_except);
-    REGISTER_FILTER(match);
-    REGISTER_FILTER(in_message_map);
-    REGISTER_FILTER(not_is);
+        REGISTER_FILTER(eq);
+        REGISTER_FILTER(eq_except);
+        REGISTER_FILTER(like);
+        REGISTER_FILTER(like_except);
+        REGISTER_FILTER(match);
+        REGISTER_FILTER(in_message_map);
+        REGISTER_FILTER(not_is);
+        REGISTER_FILTER(any_of);
+        REGISTER_FILTER(not_any_of);
 #undef REGISTER_FILTER
 
+        // Names used by the other tree-sitter bindings.
+        filters.filterFunctions["any-of?"] = &Predicates::filter_any_of;
+        filters.checkFunctions["any-of?"] = &Predicates::checkFilter_any_of;
+        filters.filterFunctions["not-any-of?"] = &Predicates::filter_not_any_of;
+        filters.checkFunctions["not-any-of?"] = &Predicates::checkFilter_not_any_of;
+
+        return filters;
+    }();
     return filters;
 }
 
-Predicates::Commands Predicates::commands()
+const Predicates::Commands &Predicates::commands()
 {
-    Predicates::Commands commands;
+    static const auto commands = [] {
+        Predicates::Commands commands;
 
 #define REGISTER_COMMAND(NAME)                                                                                         \
     commands.commandFunctions[#NAME "!"] = &Predicates::command_##NAME;                                                \
     commands.checkFunctions[#NAME "!"] = &Predicates::checkCommand_##NAME;
 
-    REGISTER_COMMAND(exclude)
+        REGISTER_COMMAND(exclude)
 #undef REGISTER_COMMAND
+        return commands;
+    }();
     return commands;
 }
 
 std::optional<QString> Predicates::checkPredicate(const Query::Predicate &predicate)
 {
-    const auto filters = Predicates::filters();
+    const auto &filters = Predicates::filters();
     auto it = filters.checkFunctions.find(predicate.name);
     if (it != filters.checkFunctions.cend()) {
         return it->second(predicate.arguments);
     }
 
-    const auto commands = Predicates::commands();
+    const auto &commands = Predicates::commands();
     it = commands.checkFunctions.find(predicate.name);
     if (it != commands.checkFunctions.cend()) {
         return it->second(predicate.arguments);
@@ -83,37 +111,71 @@ std::optional<QString> Predicates::checkPredicate(const Query::Predicate &predic
     return "Unknown predicate";
 }
 
-Predicates::Predicates(QString source)
-    : m_source(std::move(source))
+Predicates::Predicates(QString source, Query::Parameters parameters /* = {} */,
+                       std::shared_ptr<PredicateCaches> caches /* = {} */)
+    : m_caches(caches ? std::move(caches) : std::make_shared<PredicateCaches>())
+    , m_source(std::move(source))
+    , m_parameters(std::move(parameters))
+{
+}
+
+const Query::Parameters &Predicates::parameters() const
 {
+    return m_parameters;
 }
 
-void Predicates::executeCommands(QueryMatch &match) const
+void Predicates::executeCommands(QueryMatch &match, QueryProfile::Pattern *profile /* = nullptr */) const
 {
-    const auto patterns = match.query()->patterns();
-    const auto &pattern = patterns.at(match.patternIndex());
+    const auto &pattern = match.query()->patterns().at(match.patternIndex());
+    const auto &commands = Predicates::commands();
 
-    for (const auto &predicate : pattern.predicates) {
-        const auto commands = Predicates::commands();
+    for (int i = 0; i < pattern.predicates.size(); ++i) {
+        const auto &predicate = pattern.predicates.at(i);
         const auto it = commands.commandFunctions.find(predicate.name);
         if (it != commands.commandFunctions.cend()) {
             const auto commandPredicate = it->second;
+            QElapsedTimer timer;
+            if (profile) {
+                timer.start();
+            }
+
             (this->*(commandPredicate))(match, predicate.arguments);
+
+            if (profile) {
+                auto &predicateProfile = profile->predicates[i];
+                ++predicateProfile.calls;
+                predicateProfile.nsecs += timer.nsecsElapsed();
+            }
         }
     }
 }
 
-bool Predicates::filterMatch(const QueryMatch &match) const
+bool Predicates::filterMatch(const QueryMatch &match, QueryProfile::Pattern *profile /* = nullptr */) const
 {
-    const auto patterns = match.query()->patterns();
-    const auto &pattern = patterns.at(match.patternIndex());
+    const auto &pattern = match.query()->patterns().at(match.patternIndex());
+    const auto &filters = Predicates::filters();
 
-    for (const auto &predicate : pattern.predicates) {
-        const auto filters = Predicates::filters();
+    for (int i = 0; i < pattern.predicates.size(); ++i) {
+        const auto &predicate = pattern.predicates.at(i);
         const auto it = filters.filterFunctions.find(predicate.name);
         if (it != filters.filterFunctions.cend()) {
             const auto filterPredicate = it->second;
-            if (!(this->*(filterPredicate))(match, predicate.arguments)) {
+            QElapsedTimer timer;
+            if (profile) {
+                timer.start();
+            }
+
+            const bool accepted = (this->*(filterPredicate))(match, predicate.arguments);
+
+            if (profile) {
+                auto &predicateProfile = profile->predicates[i];
+                ++predicateProfile.calls;
+                predicateProfile.nsecs += timer.nsecsElapsed();
+                if (!accepted) {
+                    ++predicateProfile.rejections;
+                }
+            }
+            if (!accepted) {
                 return false;
             }
         }
@@ -181,34 +243,45 @@ std::optional<QString> Predicates::checkFilter_eq(const Predicates::PredicateArg
     }
     return {};
 }
-bool Predicates::filter_eq_with(const QueryMatch &match, const QList<std::variant<Query::Capture, QString>> &arguments,
-                                const std::function<QString(const QString &)> &textTransform) const
+bool Predicates::filter_eq_with(const QueryMatch &match, const PredicateArguments &arguments,
+                                TextComparison textEqual) const
 {
-    std::set<QString> texts;
+    // All texts must be equal to the first one, compare views on the source instead of collecting copies.
+    std::optional<QStringView> reference;
+    bool allEqual = true;
+    auto compare = [&](QStringView text) {
+        if (!reference.has_value())
+            reference = text;
+        else if (allEqual)
+            allEqual = textEqual(*reference, text);
+    };
 
     const auto matched = matchArguments(match, arguments);
     for (const auto &arg : matched) {
         if (const auto *capture = std::get_if<QueryMatch::Capture>(&arg)) {
-            texts.emplace(textTransform(capture->node.textIn(m_source)));
+            compare(capture->node.textViewIn(m_source));
         } else if (const auto *string = std::get_if<QString>(&arg)) {
-            texts.emplace(textTransform(*string));
+            compare(*string);
         } else if (std::holds_alternative<MissingCapture>(arg)) {
             spdlog::warn("Predicates: #eq? - Unmatched capture!");
-            // Insert an empty string into the set if we find an unmatched capture.
+            // Compare with an empty string if we find an unmatched capture.
             // This likely means we have encountered a quantified capture that matched 0 times.
-            // By inserting an empty string, we can check that all other things are also "empty".
-            texts.emplace("");
+            // By using an empty string, we can check that all other things are also "empty".
+            compare(QStringView());
+        } else if (std::holds_alternative<MissingParameter>(arg)) {
+            spdlog::warn("Predicates: #eq? - Unbound parameter!");
+            return false;
         } else {
             spdlog::warn("Predicates: #eq? - Impossible argument type!");
             return false;
         }
     }
-    return texts.size() == 1;
+    return reference.has_value() && allEqual;
 }
 
-bool Predicates::filter_eq(const QueryMatch &match, const QList<std::variant<Query::Capture, QString>> &arguments) const
+bool Predicates::filter_eq(const QueryMatch &match, const PredicateArguments &arguments) const
 {
-    return filter_eq_with(match, arguments, QString_identity);
+    return filter_eq_with(match, arguments, equal);
 }
 
 std::optional<QString> Predicates::checkFilter_eq_except(const Predicates::PredicateArguments &arguments)
@@ -218,7 +291,7 @@ std::optional<QString> Predicates::checkFilter_eq_except(const Predicates::Predi
     }
     auto args = arguments;
 
-    if (!std::holds_alternative<QString>(args.front())) {
+    if (!std::holds_alternative<QString>(args.front()) && !std::holds_alternative<Query::Parameter>(args.front())) {
         return "First argument must be a string";
     }
     args.pop_front();
@@ -238,17 +311,16 @@ std::optional<QString> Predicates::checkFilter_eq_except(const Predicates::Predi
 }
 
 bool Predicates::filter_like(const QueryMatch &match,
-                             const QList<std::variant<Query::Capture, QString>> &arguments) const
+                             const PredicateArguments &arguments) const
 {
-    return filter_eq_with(match, arguments, QString_no_whitespace);
+    return filter_eq_with(match, arguments, equalIgnoringWhitespace);
 }
 bool Predicates::filter_eq_except_with(const QueryMatch &match,
-                                       const QList<std::variant<Query::Capture, QString>> &arguments,
-                                       const std::function<QString(const QString &)> &textTransform) const
+                                       const PredicateArguments &arguments,
+                                       TextComparison textEqual) const
 {
     auto args = arguments;
-    if (const auto *rawExpected = std::get_if<QString>(&args.front())) {
-        auto expected = textTransform(*rawExpected);
+    if (const auto expected = stringArgument(args.front())) {
         args.pop_front();
         if (const auto *rawCapture = std::get_if<Query::Capture>(&args.front())) {
             // we need to copy the capture here, as otherwise it might get dropped
@@ -269,11 +341,11 @@ bool Predicates::filter_eq_except_with(const QueryMatch &match,
                 // Insert an empty string into the set if we find an unmatched capture.
                 // This likely means we have encountered a quantified capture that matched 0 times.
                 // So check whether the expected string is also empty
-                return expected.isEmpty();
+                return textEqual(*expected, QStringView());
             }
 
             for (const auto &idCapture : idCaptures) {
-                if (expected != textTransform(idCapture.node.textExcept(m_source, types))) {
+                if (!textEqual(*expected, idCapture.node.textExcept(m_source, types))) {
                     return false;
                 }
             }
@@ -291,12 +363,12 @@ bool Predicates::filter_eq_except_with(const QueryMatch &match,
 
 bool Predicates::filter_eq_except(const QueryMatch &match, const PredicateArguments &arguments) const
 {
-    return filter_eq_except_with(match, arguments, QString_identity);
+    return filter_eq_except_with(match, arguments, equal);
 }
 
 bool Predicates::filter_like_except(const QueryMatch &match, const PredicateArguments &arguments) const
 {
-    return filter_eq_except_with(match, arguments, QString_no_whitespace);
+    return filter_eq_except_with(match, arguments, equalIgnoringWhitespace);
 }
 
 bool Predicates::filter_not_is(const QueryMatch &match, const PredicateArguments &arguments) const
@@ -322,6 +394,55 @@ bool Predicates::filter_not_is(const QueryMatch &match, const PredicateArguments
     return std::ranges::none_of(captures, containsType);
 }
 
+std::optional<QString> Predicates::checkFilter_any_of(const Predicates::PredicateArguments &arguments)
+{
+    if (arguments.size() < 2) {
+        return "Too few arguments";
+    }
+    if (!std::holds_alternative<Query::Capture>(arguments.first())) {
+        return "First argument must be a capture";
+    }
+    // The strings are collected in a StringSet by the Query, anything else is left as is.
+    if (arguments.size() != 2 || !std::holds_alternative<Query::StringSet>(arguments.at(1))) {
+        return "Other arguments must be strings";
+    }
+    return {};
+}
+
+std::optional<QString> Predicates::checkFilter_not_any_of(const Predicates::PredicateArguments &arguments)
+{
+    return Predicates::checkFilter_any_of(arguments);
+}
+
+bool Predicates::filter_any_of(const QueryMatch &match, const PredicateArguments &arguments) const
+{
+    const auto captureId = std::get<Query::Capture>(arguments.at(0)).id;
+    const auto &values = *std::get<Query::StringSet>(arguments.at(1)).values;
+
+    bool found = false;
+    for (const auto &capture : match.captures()) {
+        if (capture.id == captureId) {
+            found = true;
+            if (!values.contains(capture.node.textViewIn(m_source))) {
+                return false;
+            }
+        }
+    }
+    // Same as #eq?, an unmatched quantified capture is an empty string.
+    return found || values.contains(QStringView());
+}
+
+bool Predicates::filter_not_any_of(const QueryMatch &match, const PredicateArguments &arguments) const
+{
+    // Unmatched captures are ignored, like for #not_is?.
+    const auto captureId = std::get<Query::Capture>(arguments.at(0)).id;
+    const auto &values = *std::get<Query::StringSet>(arguments.at(1)).values;
+
+    return std::ranges::none_of(match.captures(), [&](const QueryMatch::Capture &capture) {
+        return capture.id == captureId && values.contains(capture.node.textViewIn(m_source));
+    });
+}
+
 std::optional<QString> Predicates::checkFilter_like(const Predicates::PredicateArguments &arguments)
 {
     return Predicates::checkFilter_eq(arguments);
@@ -381,7 +502,7 @@ std::optional<QString> Predicates::checkFilter_not_is(const Predicates::Predicat
 }
 
 bool Predicates::filter_match(const QueryMatch &match,
-                              const QList<std::variant<Query::Capture, QString>> &arguments) const
+                              const PredicateArguments &arguments) const
 {
     const auto matched = matchArguments(match, arguments);
 
@@ -390,7 +511,7 @@ bool Predicates::filter_match(const QueryMatch &match,
     }
 
     if (const auto regexString = std::get_if<QString>(&matched.first())) {
-        const QRegularExpression regex(*regexString);
+        const auto &regex = regularExpression(*match.query(), *regexString);
         if (!regex.isValid()) {
             spdlog::warn("Predicates: #match? - Invalid regex");
             return false;
@@ -398,8 +519,7 @@ bool Predicates::filter_match(const QueryMatch &match,
 
         for (const auto &argument : matched | std::views::drop(1)) {
             if (const auto *capture = std::get_if<QueryMatch::Capture>(&argument)) {
-                auto source = capture->node.textIn(m_source);
-                if (!regex.match(source).hasMatch()) {
+                if (!regex.matchView(capture->node.textViewIn(m_source)).hasMatch()) {
                     return false;
                 }
             } else if (std::holds_alternative<MissingCapture>(argument)) {
@@ -419,36 +539,49 @@ bool Predicates::filter_match(const QueryMatch &match,
     return true;
 }
 
-void Predicates::insertCache(std::unique_ptr<PredicateCache> cache) const
+const QRegularExpression &Predicates::regularExpression(const Query &query, const QString &pattern) const
 {
-    m_caches.emplace_back(std::move(cache));
+    if (const auto *regex = query.regularExpression(pattern)) {
+        return *regex;
+    }
+
+    auto it = m_regularExpressions.find(pattern);
+    if (it == m_regularExpressions.end()) {
+        it = m_regularExpressions.insert(pattern, QRegularExpression(pattern));
+    }
+    return *it;
 }
 
-class MessageMapCache : public PredicateCache
+// The message map of the document, if any. Not finding one is cached as well, it's the case of most documents.
+class Predicates::MessageMapCache : public PredicateCache
 {
 public:
-    MessageMapCache(const Node &begin, const Node &end)
-        : m_begin(begin)
-        , m_end(end)
+    MessageMapCache(std::optional<Node> begin, std::optional<Node> end)
+        : m_begin(std::move(begin))
+        , m_end(std::move(end))
     {
     }
 
     ~MessageMapCache() override = default;
 
-    Node m_begin;
-    Node m_end;
+    bool isValid() const { return m_begin.has_value() && m_end.has_value(); }
+
+    std::optional<Node> m_begin;
+    std::optional<Node> m_end;
 };
 
-void Predicates::findMessageMap() const
+const Predicates::MessageMapCache &Predicates::findMessageMap() const
 {
-    if (findCache<MessageMapCache>()) {
-        // Already found it!
-        return;
+    if (const auto *cache = m_caches->find<MessageMapCache>()) {
+        // Already searched for it!
+        return *cache;
     }
 
     if (!m_rootNode.has_value()) {
+        // Don't cache anything, another query may have a root node.
         spdlog::warn("Predicate: #in_message_map? - No rootNode!");
-        return;
+        static const MessageMapCache noMessageMap({}, {});
+        return noMessageMap;
     }
 
     // This variable is "static" because Query construction is actually a non-trivial task.
@@ -470,18 +603,30 @@ void Predicates::findMessageMap() const
 )
     )EOF");
 
-    QueryCursor cursor;
-    cursor.execute(query, *m_rootNode, std::make_unique<Predicates>(m_source));
-
-    auto match = cursor.nextMatch();
-    if (match.has_value()) {
-        auto begin = match->capturesNamed("begin");
-        auto end = match->capturesNamed("end");
+    // The caches may be shared by queries run on any node of the tree, always search the whole tree.
+    auto root = *m_rootNode;
+    for (auto parent = root.parent(); !parent.isNull(); parent = parent.parent()) {
+        root = parent;
+    }
 
-        if (!begin.isEmpty() && !end.isEmpty()) {
-            insertCache(std::make_unique<MessageMapCache>(begin.first().node, end.first().node));
+    QueryCursor cursor;
+    cursor.execute(query, root, std::make_unique<Predicates>(m_source));
+
+    std::optional<Node> begin;
+    std::optional<Node> end;
+    if (const auto match = cursor.nextMatch()) {
+        const auto beginCaptures = match->capturesNamed("begin");
+        const auto endCaptures = match->capturesNamed("end");
+        if (!beginCaptures.isEmpty() && !endCaptures.isEmpty()) {
+            begin = beginCaptures.first().node;
+            end = endCaptures.first().node;
         }
     }
+
+    auto cache = std::make_unique<MessageMapCache>(std::move(begin), std::move(end));
+    const auto &result = *cache;
+    m_caches->insert(std::move(cache));
+    return result;
 }
 
 std::optional<QString> Predicates::checkFilter_in_message_map(const Predicates::PredicateArguments &arguments)
@@ -501,15 +646,13 @@ std::optional<QString> Predicates::checkFilter_in_message_map(const Predicates::
 
 bool Predicates::filter_in_message_map(const QueryMatch &match, const PredicateArguments &arguments) const
 {
-    findMessageMap();
-
-    if (const auto *message_map = findCache<MessageMapCache>()) {
+    if (const auto &message_map = findMessageMap(); message_map.isValid()) {
         const auto matched = matchArguments(match, arguments);
 
         for (const auto &argument : matched) {
             if (const auto capture = std::get_if<QueryMatch::Capture>(&argument)) {
-                if (!(message_map->m_begin.endPosition() <= capture->node.startPosition()
-                      && capture->node.endPosition() <= message_map->m_end.startPosition())) {
+                if (!(message_map.m_begin->endPosition() <= capture->node.startPosition()
+                      && capture->node.endPosition() <= message_map.m_end->startPosition())) {
                     // We're outside of the message map
                     return false;
                 }
@@ -526,29 +669,52 @@ bool Predicates::filter_in_message_map(const QueryMatch &match, const PredicateA
     }
 }
 
-QList<std::variant<QString, QueryMatch::Capture, Predicates::MissingCapture>>
-Predicates::matchArguments(const QueryMatch &match, const Predicates::PredicateArguments &arguments) const
+Predicates::MatchedArguments Predicates::matchArguments(const QueryMatch &match,
+                                                        const Predicates::PredicateArguments &arguments) const
 {
-    QList<std::variant<QString, QueryMatch::Capture, Predicates::MissingCapture>> result;
+    MatchedArguments result;
 
     for (const auto &argument : arguments) {
         if (const auto string = std::get_if<QString>(&argument)) {
             result.emplace_back(*string);
+        } else if (const auto parameter = std::get_if<Query::Parameter>(&argument)) {
+            const auto it = m_parameters.constFind(parameter->name);
+            if (it != m_parameters.cend())
+                result.emplace_back(*it);
+            else
+                result.emplace_back(MissingParameter {.parameter = *parameter});
         } else if (const auto captureArgument = std::get_if<Query::Capture>(&argument)) {
-            const auto captures = match.capturesWithId(captureArgument->id);
-
             // Multiple captures for the same ID may exist, if quantifiers are used.
             // Add all of them.
-            for (const auto &capture : captures) {
-                result.emplace_back(capture);
+            bool found = false;
+            for (const auto &capture : match.captures()) {
+                if (capture.id == captureArgument->id) {
+                    result.emplace_back(capture);
+                    found = true;
+                }
             }
-            if (captures.isEmpty())
+            if (!found)
                 result.emplace_back(MissingCapture {.capture = *captureArgument});
         }
     }
     return result;
 }
 
+std::optional<QString> Predicates::stringArgument(const Query::Argument &argument) const
+{
+    if (const auto string = std::get_if<QString>(&argument)) {
+        return *string;
+    }
+    if (const auto parameter = std::get_if<Query::Parameter>(&argument)) {
+        const auto it = m_parameters.constFind(parameter->name);
+        if (it != m_parameters.cend()) {
+            return *it;
+        }
+        spdlog::warn("Predicates: Unbound parameter ${}", parameter->name);
+    }
+    return {};
+}
+
 void Predicates::setRootNode(const Node &node)
 {
     m_rootNode = node;
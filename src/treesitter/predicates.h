@@ -13,7 +13,13 @@
 #include "node.h"
 #include "query.h"
 
+#include <QHash>
+#include <QRegularExpression>
 #include <QString>
+#include <QStringView>
+#include <QVarLengthArray>
+#include <memory>
+#include <vector>
 
 namespace treesitter {
 
@@ -26,6 +32,30 @@ public:
     virtual ~PredicateCache() = default;
 };
 
+// The caches of the predicates, e.g. the message map found by #in_message_map?.
+// They are only valid for the tree they were computed on, a document keeps them until its text changes, so they are
+// shared by all queries run on the same revision of the document.
+class PredicateCaches
+{
+public:
+    template <class T>
+    T *find() const
+    {
+        for (auto &cache : m_caches) {
+            if (auto *result = dynamic_cast<T *>(cache.get())) {
+                return result;
+            }
+        }
+        return nullptr;
+    }
+
+    void insert(std::unique_ptr<PredicateCache> cache) { m_caches.emplace_back(std::move(cache)); }
+    size_t size() const { return m_caches.size(); }
+
+private:
+    std::vector<std::unique_ptr<PredicateCache>> m_caches;
+};
+
 // At the moment, predicates are just member functions of the Predicates class.
 // However, in the future we may want to separate the Predicates class into two:
 // 1. A PredicateList class, containing a list of predicates, but no context for the predicates to execute
@@ -35,7 +65,7 @@ public:
 //      This would replace the existing Predicates class to support execution of the predicates.
 class Predicates
 {
-    using PredicateArguments = QVector<std::variant<Query::Capture, QString>>;
+    using PredicateArguments = QVector<Query::Argument>;
     struct Filters
     {
         std::unordered_map<QString, bool (Predicates::*)(const QueryMatch &, const PredicateArguments &) const>
@@ -51,20 +81,26 @@ class Predicates
             commandFunctions;
     };
 
-    static Filters filters();
-    static Commands commands();
+    static const Filters &filters();
+    static const Commands &commands();
 
 public:
-    explicit Predicates(QString source);
+    // Without caches, the predicates use their own, only kept for the lifetime of this instance.
+    explicit Predicates(QString source, Query::Parameters parameters = {},
+                        std::shared_ptr<PredicateCaches> caches = {});
+
+    // Values bound to the "$name" parameters of the query.
+    const Query::Parameters &parameters() const;
 
     // Returns an error message if the predicate is not supported
     static std::optional<QString> checkPredicate(const Query::Predicate &predicate);
 
     // Executes all command-predicates (e.g. exclude!) on the match.
-    void executeCommands(QueryMatch &match) const;
+    // If a profile is given, the calls and time of each predicate are recorded in it.
+    void executeCommands(QueryMatch &match, QueryProfile::Pattern *profile = nullptr) const;
 
     // Returns true if the match fulfills all query predicates.
-    bool filterMatch(const QueryMatch &match) const;
+    bool filterMatch(const QueryMatch &match, QueryProfile::Pattern *profile = nullptr) const;
 
 private:
     // ################# Commands #########################
@@ -87,12 +123,17 @@ private:
     PREDICATE_FILTER(match);
     PREDICATE_FILTER(in_message_map);
     PREDICATE_FILTER(not_is);
+    PREDICATE_FILTER(any_of);
+    PREDICATE_FILTER(not_any_of);
 #undef PREDICATE_FILTER
 
-    bool filter_eq_with(const QueryMatch &match, const QVector<std::variant<Query::Capture, QString>> &arguments,
-                        const std::function<QString(const QString &)> &textTransform) const;
-    bool filter_eq_except_with(const QueryMatch &match, const QVector<std::variant<Query::Capture, QString>> &arguments,
-                               const std::function<QString(const QString &)> &textTransform) const;
+    // Texts are compared as views on the source, without copying them.
+    using TextComparison = bool (*)(QStringView, QStringView);
+
+    bool filter_eq_with(const QueryMatch &match, const PredicateArguments &arguments,
+                        TextComparison textEqual) const;
+    bool filter_eq_except_with(const QueryMatch &match, const PredicateArguments &arguments,
+                               TextComparison textEqual) const;
 
     // ################## Argument matching #########################
     // Marker type indicating a capture is missing
@@ -100,33 +141,38 @@ private:
     {
         Query::Capture capture;
     };
+    // Marker type indicating no value is bound to a parameter
+    struct MissingParameter
+    {
+        Query::Parameter parameter;
+    };
 
-    QVector<std::variant<QString, QueryMatch::Capture, MissingCapture>>
-    matchArguments(const QueryMatch &match, const PredicateArguments &arguments) const;
+    // Most predicates only have a handful of arguments, avoid allocating for them.
+    using MatchedArguments =
+        QVarLengthArray<std::variant<QString, QueryMatch::Capture, MissingCapture, MissingParameter>, 8>;
 
-    // ################## Caches #########################
-    mutable std::vector<std::unique_ptr<PredicateCache>> m_caches;
+    MatchedArguments matchArguments(const QueryMatch &match, const PredicateArguments &arguments) const;
 
-    template <class T>
-    T *findCache() const
-    {
-        for (auto &cache : m_caches) {
-            if (auto *result = dynamic_cast<T *>(cache.get())) {
-                return result;
-            }
-        }
-        return nullptr;
-    }
+    // Returns the string argument, or the value bound to the parameter argument.
+    std::optional<QString> stringArgument(const Query::Argument &argument) const;
+
+    // ################## Caches #########################
+    const std::shared_ptr<PredicateCaches> m_caches;
 
-    void insertCache(std::unique_ptr<PredicateCache>) const;
+    class MessageMapCache;
+    const MessageMapCache &findMessageMap() const;
 
-    void findMessageMap() const;
+    // Regular expressions used by #match?, usually compiled once by the query, see Query::regularExpression.
+    const QRegularExpression &regularExpression(const Query &query, const QString &pattern) const;
+    mutable QHash<QString, QRegularExpression> m_regularExpressions;
 
     // ################## Context data #########################
     friend class QueryCursor;
     void setRootNode(const Node &node);
 
+    // Implicitly shared: the source is usually the snapshot the tree was parsed from, not a copy of it.
     const QString m_source;
+    const Query::Parameters m_parameters;
     std::optional<Node> m_rootNode;
 };
 
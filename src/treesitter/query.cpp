@@ -11,15 +11,21 @@
 #include "query.h"
 #include "node.h"
 #include "predicates.h"
+#include "utils/log.h"
 
+#include <QElapsedTimer>
+#include <QRegularExpression>
 #include <QStringList>
+#include <algorithm>
 #include <kdalgorithms.h>
 #include <tree_sitter/api.h>
+#include <vector>
 
 namespace treesitter {
 
-Query::Query(const TSLanguage *language, const QString &query)
+Query::Query(const TSLanguage *language, const QString &query, ParameterSyntax parameterSyntax)
     : m_query(nullptr)
+    , m_parameterSyntax(parameterSyntax)
 {
     m_utf8_text = query.toUtf8();
     uint32_t error_offset;
@@ -36,8 +42,16 @@ Query::Query(const TSLanguage *language, const QString &query)
         };
     }
 
-    const auto patterns = this->patterns();
-    for (const auto &pattern : patterns) {
+    const auto count = ts_query_pattern_count(m_query);
+    m_patterns.reserve(count);
+    for (uint32_t patternIndex = 0; patternIndex < count; ++patternIndex) {
+        auto start_byte = ts_query_start_byte_for_pattern(m_query, patternIndex);
+        auto predicates = predicatesForPattern(patternIndex);
+
+        m_patterns.emplace_back(Pattern {.predicates = std::move(predicates), .utf8_start_byte = start_byte});
+    }
+
+    for (const auto &pattern : std::as_const(m_patterns)) {
         for (const auto &predicate : pattern.predicates) {
             auto error = Predicates::checkPredicate(predicate);
             if (error.has_value()) {
@@ -47,12 +61,36 @@ Query::Query(const TSLanguage *language, const QString &query)
 
                 throw Error {.utf8_offset = static_cast<uint32_t>(offset), .description = error.value()};
             }
+
+            for (const auto &argument : predicate.arguments) {
+                if (const auto *parameter = std::get_if<Parameter>(&argument)) {
+                    if (!m_parameters.contains(parameter->name)) {
+                        m_parameters.push_back(parameter->name);
+                    }
+                }
+            }
+
+            // The regular expression is always a string, see Predicates::checkFilter_match.
+            if (predicate.name == "match?") {
+                const auto &pattern = std::get<QString>(predicate.arguments.first());
+                if (!m_regularExpressions.contains(pattern)) {
+                    QRegularExpression regex(pattern);
+                    // Compile it now, the query may be shared between threads afterward.
+                    regex.optimize();
+                    m_regularExpressions.insert(pattern, std::move(regex));
+                }
+            }
         }
     }
 }
 
 Query::Query(Query &&other) noexcept
-    : m_query(other.m_query)
+    : m_utf8_text(std::move(other.m_utf8_text))
+    , m_query(other.m_query)
+    , m_parameterSyntax(other.m_parameterSyntax)
+    , m_patterns(std::move(other.m_patterns))
+    , m_parameters(std::move(other.m_parameters))
+    , m_regularExpressions(std::move(other.m_regularExpressions))
 {
     other.m_query = nullptr;
 }
@@ -72,7 +110,47 @@ Query &Query::operator=(Query &&other) noexcept
 
 void Query::swap(Query &other) noexcept
 {
+    std::swap(m_utf8_text, other.m_utf8_text);
     std::swap(m_query, other.m_query);
+    std::swap(m_parameterSyntax, other.m_parameterSyntax);
+    std::swap(m_patterns, other.m_patterns);
+    std::swap(m_parameters, other.m_parameters);
+    std::swap(m_regularExpressions, other.m_regularExpressions);
+}
+
+// A string argument like "$className" is a parameter, its value is bound when executing the query.
+static std::optional<Query::Parameter> parameterFromString(const QString &string)
+{
+    static const QRegularExpression parameterRegex(R"(^\$([A-Za-z_]\w*)$)");
+    const auto match = parameterRegex.match(string);
+    if (match.hasMatch()) {
+        return Query::Parameter {.name = match.captured(1)};
+    }
+    return {};
+}
+
+// The string arguments of the set predicates are replaced by a single StringSet argument.
+static void collectStringSet(Query::Predicate &predicate)
+{
+    static const QStringList setPredicates {"any_of?", "not_any_of?", "any-of?", "not-any-of?"};
+    if (!setPredicates.contains(predicate.name) || predicate.arguments.size() < 2) {
+        return;
+    }
+    const auto strings = predicate.arguments.sliced(1);
+    if (!std::ranges::all_of(strings, [](const auto &argument) {
+            return std::holds_alternative<QString>(argument);
+        })) {
+        // Left as is, the predicate check reports the error.
+        return;
+    }
+
+    auto values = std::make_shared<Query::StringSet::Values>();
+    values->reserve(strings.size());
+    for (const auto &string : strings) {
+        values->insert(std::get<QString>(string));
+    }
+    predicate.arguments.resize(1);
+    predicate.arguments.emplace_back(Query::StringSet {.values = std::move(values)});
 }
 
 QList<Query::Predicate> Query::predicatesForPattern(uint32_t index) const
@@ -81,7 +159,7 @@ QList<Query::Predicate> Query::predicatesForPattern(uint32_t index) const
     const auto predicateSteps = ts_query_predicates_for_pattern(m_query, index, &predicatesLength);
 
     QList<Query::Predicate> predicates;
-    Predicate predicate {.name = QString(), .arguments = QList<std::variant<Capture, QString>> {}};
+    Predicate predicate {.name = QString(), .arguments = QList<Argument> {}};
     for (uint32_t predicateIndex = 0; predicateIndex < predicatesLength; ++predicateIndex) {
         const auto &step = predicateSteps[predicateIndex];
         // We don't really need the length here, but TreeSitter crashes if we give it a nullptr.
@@ -93,16 +171,22 @@ QList<Query::Predicate> Query::predicatesForPattern(uint32_t index) const
             if (predicate.name.isEmpty()) {
                 predicate.name = ts_query_string_value_for_id(m_query, step.value_id, &length);
             } else {
-                predicate.arguments.emplace_back(std::in_place_type<QString>,
-                                                 ts_query_string_value_for_id(m_query, step.value_id, &length));
+                const QString value = ts_query_string_value_for_id(m_query, step.value_id, &length);
+                auto parameter = m_parameterSyntax == WithParameters ? parameterFromString(value) : std::nullopt;
+                if (parameter) {
+                    predicate.arguments.emplace_back(std::in_place_type<Parameter>, std::move(*parameter));
+                } else {
+                    predicate.arguments.emplace_back(std::in_place_type<QString>, value);
+                }
             }
             break;
         case TSQueryPredicateStepTypeCapture:
             predicate.arguments.emplace_back(std::in_place_type<Capture>, captureAt(step.value_id));
             break;
         case TSQueryPredicateStepTypeDone:
+            collectStringSet(predicate);
             predicates.emplace_back(std::move(predicate));
-            predicate = Predicate {.name = QString(), .arguments = QList<std::variant<Capture, QString>>()};
+            predicate = Predicate {.name = QString(), .arguments = QList<Argument>()};
             break;
         }
     }
@@ -110,19 +194,9 @@ QList<Query::Predicate> Query::predicatesForPattern(uint32_t index) const
     return predicates;
 }
 
-QList<Query::Pattern> Query::patterns() const
+const QList<Query::Pattern> &Query::patterns() const
 {
-    QList<Query::Pattern> result;
-
-    auto count = ts_query_pattern_count(m_query);
-    result.reserve(count);
-    for (uint32_t patternIndex = 0; patternIndex < count; ++patternIndex) {
-        auto start_byte = ts_query_start_byte_for_pattern(m_query, patternIndex);
-        auto predicates = predicatesForPattern(patternIndex);
-
-        result.emplace_back(Pattern {.predicates = std::move(predicates), .utf8_start_byte = start_byte});
-    }
-    return result;
+    return m_patterns;
 }
 
 QList<Query::Capture> Query::captures() const
@@ -143,14 +217,38 @@ Query::Capture Query::captureAt(uint32_t index) const
     return Capture {.name = QString(name), .id = index};
 }
 
+QStringList Query::parameters() const
+{
+    return m_parameters;
+}
+
+const QByteArray &Query::utf8Text() const
+{
+    return m_utf8_text;
+}
+
+const QRegularExpression *Query::regularExpression(const QString &pattern) const
+{
+    const auto it = m_regularExpressions.constFind(pattern);
+    return it != m_regularExpressions.cend() ? &it.value() : nullptr;
+}
+
 // ------------------------ QueryMatch --------------------
 QueryMatch::QueryMatch(const TSQueryMatch &match, std::shared_ptr<Query> query)
-    : m_id(match.id)
-    , m_pattern_index(match.pattern_index)
-    , m_query(std::move(query))
+    : m_query(std::move(query))
+{
+    assign(match);
+}
+
+// Reuses the storage of the captures, so a QueryMatch can be filled again without allocating.
+void QueryMatch::assign(const TSQueryMatch &match)
 {
+    m_id = match.id;
+    m_pattern_index = match.pattern_index;
+
     // It seems advancing the query cursor may delete the captures of the last match.
     // Therefore copy the captures into a member of the QueryMatch, so we actually own them.
+    m_captures.clear();
     m_captures.reserve(match.capture_count);
 
     for (uint16_t i = 0; i < match.capture_count; ++i) {
@@ -193,7 +291,7 @@ void QueryMatch::setCaptures(QList<Capture> &&captures)
     m_captures = std::move(captures);
 }
 
-QList<QueryMatch::Capture> QueryMatch::captures() const
+const QList<QueryMatch::Capture> &QueryMatch::captures() const
 {
     return m_captures;
 }
@@ -206,22 +304,75 @@ QList<QueryMatch::Capture> QueryMatch::capturesWithId(uint32_t id) const
 }
 
 // ----------------------- QueryCursor --------------------
+namespace {
+    // TSQueryCursors of the current thread not used by a QueryCursor.
+    // Scripts can run hundreds of thousands of small queries, reusing the cursors avoids allocating their internal
+    // buffers every time. ts_query_cursor_exec resets the state of a cursor, only the byte range must be reset.
+    class CursorPool
+    {
+    public:
+        ~CursorPool()
+        {
+            for (auto *cursor : m_cursors) {
+                ts_query_cursor_delete(cursor);
+            }
+        }
+
+        TSQueryCursor *take()
+        {
+            if (m_cursors.empty()) {
+                return ts_query_cursor_new();
+            }
+            auto *cursor = m_cursors.back();
+            m_cursors.pop_back();
+            return cursor;
+        }
+
+        void release(TSQueryCursor *cursor)
+        {
+            // Only a few cursors are alive at the same time, don't keep more than that around.
+            if (m_cursors.size() < MaxPoolSize) {
+                ts_query_cursor_set_byte_range(cursor, 0, UINT32_MAX);
+                m_cursors.push_back(cursor);
+            } else {
+                ts_query_cursor_delete(cursor);
+            }
+        }
+
+    private:
+        static constexpr size_t MaxPoolSize = 8;
+        std::vector<TSQueryCursor *> m_cursors;
+    };
+
+    CursorPool &cursorPool()
+    {
+        thread_local CursorPool pool;
+        return pool;
+    }
+}
+
 QueryCursor::QueryCursor()
-    : m_cursor(ts_query_cursor_new())
+    : m_cursor(cursorPool().take())
 {
 }
 
 QueryCursor::~QueryCursor()
 {
     if (m_cursor) {
-        ts_query_cursor_delete(m_cursor);
+        cursorPool().release(m_cursor);
     }
 }
 
 QueryCursor::QueryCursor(QueryCursor &&other) noexcept
     : m_query(std::move(other.m_query))
+    , m_progressCallback(std::move(other.m_progressCallback))
     , m_predicates(std::move(other.m_predicates))
     , m_cursor(std::move(other.m_cursor))
+    , m_profilingEnabled(other.m_profilingEnabled)
+    , m_profile(std::move(other.m_profile))
+    , m_match(std::move(other.m_match))
+    , m_captureMatches(std::move(other.m_captureMatches))
+    , m_nextPruneByte(other.m_nextPruneByte)
 {
     other.m_cursor = nullptr;
 }
@@ -234,7 +385,20 @@ QueryCursor &QueryCursor::operator=(QueryCursor &&other) noexcept
 
 void QueryCursor::swap(QueryCursor &other) noexcept
 {
+    std::swap(m_query, other.m_query);
+    std::swap(m_progressCallback, other.m_progressCallback);
+    std::swap(m_predicates, other.m_predicates);
     std::swap(m_cursor, other.m_cursor);
+    std::swap(m_profilingEnabled, other.m_profilingEnabled);
+    std::swap(m_profile, other.m_profile);
+    std::swap(m_match, other.m_match);
+    std::swap(m_captureMatches, other.m_captureMatches);
+    std::swap(m_nextPruneByte, other.m_nextPruneByte);
+}
+
+void QueryCursor::setByteRange(uint32_t start, uint32_t end)
+{
+    ts_query_cursor_set_byte_range(m_cursor, start, end);
 }
 
 void QueryCursor::execute(std::shared_ptr<Query> query, const Node &node, std::unique_ptr<Predicates> &&predicates)
@@ -244,6 +408,32 @@ void QueryCursor::execute(std::shared_ptr<Query> query, const Node &node, std::u
         m_predicates->setRootNode(node);
     }
     m_query = std::move(query);
+    if (m_predicates) {
+        for (const auto &parameter : m_query->parameters()) {
+            if (!m_predicates->parameters().contains(parameter)) {
+                spdlog::warn("QueryCursor: parameter ${} is not bound!", parameter);
+            }
+        }
+    }
+
+    if (m_profilingEnabled) {
+        m_profile = QueryProfile();
+        const auto &patterns = m_query->patterns();
+        m_profile->patterns.reserve(patterns.size());
+        for (const auto &pattern : patterns) {
+            QueryProfile::Pattern patternProfile;
+            for (const auto &predicate : pattern.predicates) {
+                patternProfile.predicates.emplace_back(QueryProfile::Predicate {.name = predicate.name});
+            }
+            m_profile->patterns.emplace_back(std::move(patternProfile));
+        }
+    } else {
+        m_profile.reset();
+    }
+
+    m_match.reset();
+    m_captureMatches.clear();
+    m_nextPruneByte = UINT32_MAX;
     ts_query_cursor_exec(m_cursor, m_query->m_query, node.m_node);
 }
 
@@ -252,17 +442,48 @@ void QueryCursor::setProgressCallback(std::function<void()> callback)
     m_progressCallback = std::move(callback);
 }
 
+void QueryCursor::setProfilingEnabled(bool enabled)
+{
+    m_profilingEnabled = enabled;
+}
+
+const std::optional<QueryProfile> &QueryCursor::profile() const
+{
+    return m_profile;
+}
+
 std::optional<QueryMatch> QueryCursor::nextMatch()
+{
+    if (!m_profile) {
+        return findNextMatch();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    auto match = findNextMatch();
+    m_profile->totalNsecs += timer.nsecsElapsed();
+    return match;
+}
+
+std::optional<QueryMatch> QueryCursor::findNextMatch()
 {
     TSQueryMatch match;
 
     while (ts_query_cursor_next_match(m_cursor, &match)) {
         QueryMatch result(match, m_query);
+        auto *patternProfile = m_profile ? &m_profile->patterns[match.pattern_index] : nullptr;
+        if (patternProfile) {
+            ++patternProfile->candidates;
+        }
+
         if (m_predicates) {
-            m_predicates->executeCommands(result);
-            if (m_predicates->filterMatch(result)) {
+            m_predicates->executeCommands(result, patternProfile);
+            if (m_predicates->filterMatch(result, patternProfile)) {
                 return result;
             }
+            if (patternProfile) {
+                ++patternProfile->rejections;
+            }
         } else {
             return result;
         }
@@ -274,6 +495,125 @@ std::optional<QueryMatch> QueryCursor::nextMatch()
     return {};
 }
 
+std::optional<QueryMatch::Capture> QueryCursor::nextCapture(std::optional<uint32_t> captureId /* = {} */)
+{
+    if (!m_profile) {
+        return findNextCapture(captureId);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    auto capture = findNextCapture(captureId);
+    m_profile->totalNsecs += timer.nsecsElapsed();
+    return capture;
+}
+
+std::optional<QueryMatch::Capture> QueryCursor::findNextCapture(std::optional<uint32_t> captureId)
+{
+    TSQueryMatch match;
+    uint32_t captureIndex;
+
+    while (ts_query_cursor_next_capture(m_cursor, &match, &captureIndex)) {
+        const auto &tsCapture = match.captures[captureIndex];
+        const auto isWanted = !captureId.has_value() || tsCapture.index == captureId.value();
+        auto *patternProfile = m_profile ? &m_profile->patterns[match.pattern_index] : nullptr;
+
+        if (!m_predicates || m_query->patterns().at(match.pattern_index).predicates.isEmpty()) {
+            // Captures of a match are returned in order, count the match only once.
+            if (patternProfile && captureIndex == 0) {
+                ++patternProfile->candidates;
+            }
+            if (isWanted) {
+                return QueryMatch::Capture {.id = tsCapture.index, .node = Node(tsCapture.node)};
+            }
+            continue;
+        }
+
+        pruneCaptureMatches(ts_node_start_byte(tsCapture.node));
+
+        auto it = m_captureMatches.find(match.id);
+        if (it == m_captureMatches.end()) {
+            // The predicates run on the same QueryMatch for all matches, only filled with the captures of the
+            // tree-sitter match.
+            if (m_match) {
+                m_match->assign(match);
+            } else {
+                m_match = QueryMatch(match, m_query);
+            }
+            if (patternProfile) {
+                ++patternProfile->candidates;
+            }
+            m_predicates->executeCommands(*m_match, patternProfile);
+            if (!m_predicates->filterMatch(*m_match, patternProfile)) {
+                if (patternProfile) {
+                    ++patternProfile->rejections;
+                }
+                // Don't return the other captures of this match either.
+                ts_query_cursor_remove_match(m_cursor, match.id);
+                if (m_progressCallback) {
+                    m_progressCallback();
+                }
+                continue;
+            }
+
+            // Only keep the captures if commands like #exclude! removed some of them.
+            CaptureMatch captureMatch {.remainingCaptures = match.capture_count};
+            if (m_match->captures().size() != match.capture_count) {
+                captureMatch.keptCaptures = m_match->captures();
+                captureMatch.allKept = false;
+            }
+            for (uint16_t i = 0; i < match.capture_count; ++i) {
+                captureMatch.lastStartByte =
+                    std::max(captureMatch.lastStartByte, ts_node_start_byte(match.captures[i].node));
+            }
+            m_nextPruneByte = std::min(m_nextPruneByte, captureMatch.lastStartByte);
+            it = m_captureMatches.insert(match.id, std::move(captureMatch));
+        }
+
+        const Node node(tsCapture.node);
+        const auto isKept = it->allKept
+            || std::ranges::any_of(it->keptCaptures, [&tsCapture, &node](const QueryMatch::Capture &capture) {
+                                    return capture.id == tsCapture.index && capture.node == node;
+                                });
+        if (--it->remainingCaptures == 0) {
+            m_captureMatches.erase(it);
+        }
+
+        if (isKept && isWanted) {
+            return QueryMatch::Capture {.id = tsCapture.index, .node = node};
+        }
+    }
+    return {};
+}
+
+// Captures are returned in document order: once a capture after the last capture of a match is returned, the match
+// can't return captures anymore. This removes the matches whose captures are not all returned, for example the ones
+// outside of the byte range.
+void QueryCursor::pruneCaptureMatches(uint32_t startByte)
+{
+    if (startByte <= m_nextPruneByte) {
+        return;
+    }
+    m_nextPruneByte = UINT32_MAX;
+    for (auto it = m_captureMatches.begin(); it != m_captureMatches.end();) {
+        if (it->lastStartByte < startByte) {
+            it = m_captureMatches.erase(it);
+        } else {
+            m_nextPruneByte = std::min(m_nextPruneByte, it->lastStartByte);
+            ++it;
+        }
+    }
+}
+
+QVector<QueryMatch::Capture> QueryCursor::allRemainingCaptures(std::optional<uint32_t> captureId /* = {} */)
+{
+    QVector<QueryMatch::Capture> captures;
+    for (auto capture = nextCapture(captureId); capture.has_value(); capture = nextCapture(captureId)) {
+        captures.emplace_back(capture.value());
+    }
+    return captures;
+}
+
 QList<QueryMatch> QueryCursor::allRemainingMatches()
 {
     QList<QueryMatch> matches;
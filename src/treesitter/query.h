@@ -13,10 +13,16 @@
 #include "node.h"
 
 #include <QByteArray>
+#include <QHash>
+#include <QRegularExpression>
 #include <QString>
+#include <QStringList>
 #include <QVector>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <tree_sitter/api.h>
+#include <unordered_set>
 
 struct TSLanguage;
 struct TSQuery;
@@ -36,10 +42,35 @@ public:
         uint32_t id;
     };
 
+    // A named placeholder in a predicate, written as a string starting with `$`, e.g. `(#eq? @name "$className")`.
+    // Its value is only bound when the query is executed, so the same compiled query can be reused for any value.
+    // Only queries constructed with WithParameters have parameters, in other queries `"$className"` is a string.
+    struct Parameter
+    {
+        QString name;
+    };
+
+    // The strings of a set predicate like `(#any_of? @name "OnOK" "OnCancel")`, collected when the query is
+    // constructed, so testing a capture doesn't depend on the number of strings.
+    struct StringSet
+    {
+        struct Hash
+        {
+            using is_transparent = void;
+            size_t operator()(QStringView string) const noexcept { return qHash(string); }
+        };
+        using Values = std::unordered_set<QString, Hash, std::equal_to<>>;
+
+        // Shared, as the arguments are copied with the predicates.
+        std::shared_ptr<const Values> values;
+    };
+
+    using Argument = std::variant<Capture, QString, Parameter, StringSet>;
+
     struct Predicate
     {
         QString name;
-        QVector<std::variant<Capture, QString>> arguments;
+        QVector<Argument> arguments;
     };
 
     struct Pattern
@@ -54,8 +85,16 @@ public:
         QString description;
     };
 
+    // Values bound to the query parameters, by parameter name (without the leading `$`).
+    using Parameters = QHash<QString, QString>;
+
+    enum ParameterSyntax {
+        NoParameters,
+        WithParameters,
+    };
+
     // throws a Query::Error if the query is ill-formed.
-    Query(const TSLanguage *language, const QString &query);
+    Query(const TSLanguage *language, const QString &query, ParameterSyntax parameterSyntax = NoParameters);
 
     Query(const Query &) = delete;
     Query(Query &&) noexcept;
@@ -67,16 +106,31 @@ public:
 
     void swap(Query &other) noexcept;
 
-    QVector<Pattern> patterns() const;
+    // The patterns are computed once when the query is constructed, so this is cheap to call for every match.
+    const QVector<Pattern> &patterns() const;
 
     QVector<Capture> captures() const;
     Capture captureAt(uint32_t index) const;
 
+    // Names of all parameters used by the predicates of this query.
+    QStringList parameters() const;
+
+    // The query source, as given to tree-sitter.
+    const QByteArray &utf8Text() const;
+
+    // Regular expressions of the #match? predicates, compiled once with the query and shared by all cursors.
+    // Returns nullptr if the pattern is not used by this query.
+    const QRegularExpression *regularExpression(const QString &pattern) const;
+
 private:
     QVector<Predicate> predicatesForPattern(uint32_t index) const;
 
     QByteArray m_utf8_text;
     TSQuery *m_query;
+    ParameterSyntax m_parameterSyntax = NoParameters;
+    QVector<Pattern> m_patterns;
+    QStringList m_parameters;
+    QHash<QString, QRegularExpression> m_regularExpressions;
 
     friend class QueryCursor;
 };
@@ -101,7 +155,7 @@ public:
     uint32_t patternIndex() const;
 
     void setCaptures(QVector<Capture> &&captures);
-    QVector<Capture> captures() const;
+    const QVector<Capture> &captures() const;
     QVector<Capture> capturesWithId(uint32_t id) const;
 
     // Captures with quantifiers may return multiple values for the same capture.
@@ -111,6 +165,7 @@ public:
 
 private:
     QueryMatch(const TSQueryMatch &match, std::shared_ptr<Query> query);
+    void assign(const TSQueryMatch &match);
 
     uint32_t m_id;
     uint16_t m_pattern_index;
@@ -121,7 +176,38 @@ private:
     friend class QueryCursor;
 };
 
+// Statistics recorded by a QueryCursor with profiling enabled, see QueryCursor::setProfilingEnabled.
+// Times are in nanoseconds.
+struct QueryProfile
+{
+    struct Predicate
+    {
+        QString name;
+        int calls = 0;
+        // Candidates discarded by this predicate, always 0 for commands like #exclude!.
+        int rejections = 0;
+        qint64 nsecs = 0;
+    };
+
+    struct Pattern
+    {
+        // Matches found by tree-sitter for this pattern, before running the predicates.
+        int candidates = 0;
+        // Candidates discarded by one of the predicates.
+        int rejections = 0;
+        // Same order as the predicates of the Query::Pattern.
+        QVector<Predicate> predicates;
+    };
+
+    QVector<Pattern> patterns;
+    // Total time spent in the cursor, including tree-sitter matching and the predicates.
+    qint64 totalNsecs = 0;
+};
+
 // TODO: Should this also be a member-class of Query?
+// The underlying TSQueryCursor is taken from a pool of the current thread, and given back to it on destruction, so
+// creating a QueryCursor for each small query doesn't allocate a new one every time. Each execute resets it, and its
+// byte range is reset when given back.
 class QueryCursor
 {
 public:
@@ -137,6 +223,9 @@ public:
 
     void swap(QueryCursor &other) noexcept;
 
+    // Only returns the matches intersecting the range, in bytes, must be called before execute.
+    void setByteRange(uint32_t start, uint32_t end);
+
     void execute(std::shared_ptr<Query> query, const Node &node, std::unique_ptr<Predicates> &&predicates);
 
     std::optional<QueryMatch> nextMatch();
@@ -146,11 +235,28 @@ public:
     // will no longer return new matches.
     QVector<QueryMatch> allRemainingMatches();
 
+    // Get the next capture, in document order, optionally only the captures with the given id.
+    // Unlike nextMatch, no QueryMatch is created for patterns without predicates. For the other patterns, the
+    // predicates are executed once per match, when its first capture is found.
+    // Don't mix calls to nextMatch and nextCapture after an execution.
+    std::optional<QueryMatch::Capture> nextCapture(std::optional<uint32_t> captureId = {});
+
+    // Get all remaining captures, see nextCapture.
+    QVector<QueryMatch::Capture> allRemainingCaptures(std::optional<uint32_t> captureId = {});
+
     // The progress callback is called after each match is found, even if it is discarded later by the predicate engine.
     // It allows the UI to update and remain responsive while the query is running.
     void setProgressCallback(std::function<void()> callback);
 
+    // Profiling must be enabled before calling execute, the profile is reset on each execution.
+    void setProfilingEnabled(bool enabled);
+    const std::optional<QueryProfile> &profile() const;
+
 private:
+    std::optional<QueryMatch> findNextMatch();
+    std::optional<QueryMatch::Capture> findNextCapture(std::optional<uint32_t> captureId);
+    void pruneCaptureMatches(uint32_t startByte);
+
     // The query must be kept alive for as long as the cursor is alive.
     // Otherwise, no new matches can be returned and the Predicates can't be executed.
     std::shared_ptr<Query> m_query;
@@ -158,6 +264,26 @@ private:
 
     std::unique_ptr<Predicates> m_predicates;
     TSQueryCursor *m_cursor;
+
+    bool m_profilingEnabled = false;
+    std::optional<QueryProfile> m_profile;
+
+    // Match the predicates of nextCapture run on, reused for all matches.
+    std::optional<QueryMatch> m_match;
+
+    // Matches accepted by the predicates, whose captures are not all returned by nextCapture yet.
+    struct CaptureMatch
+    {
+        // Only set if commands like #exclude! removed some captures.
+        QVector<QueryMatch::Capture> keptCaptures;
+        bool allKept = true;
+        uint32_t remainingCaptures = 0;
+        // Start of the last capture of the match, in bytes.
+        uint32_t lastStartByte = 0;
+    };
+    QHash<uint32_t, CaptureMatch> m_captureMatches;
+    // Smallest lastStartByte of m_captureMatches, see pruneCaptureMatches.
+    uint32_t m_nextPruneByte = UINT32_MAX;
 };
 
 using QueryList = QVector<std::shared_ptr<Query>>;
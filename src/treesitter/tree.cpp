@@ -10,11 +10,50 @@
 
 #include "tree.h"
 
+#include <cstdlib>
 #include <tree_sitter/api.h>
 #include <utility>
 
 namespace treesitter {
 
+static TSPoint pointAt(QStringView text, qsizetype position)
+{
+    const auto before = text.first(position);
+    const auto lineStart = before.lastIndexOf(u'\n') + 1;
+    return TSPoint {.row = static_cast<uint32_t>(before.count(u'\n')),
+                    .column = static_cast<uint32_t>((position - lineStart) * sizeof(QChar))};
+}
+
+std::optional<TSInputEdit> inputEdit(QStringView oldText, QStringView newText)
+{
+    const auto minSize = std::min(oldText.size(), newText.size());
+
+    qsizetype prefix = 0;
+    while (prefix < minSize && oldText[prefix] == newText[prefix]) {
+        ++prefix;
+    }
+    if (prefix == oldText.size() && prefix == newText.size()) {
+        return {};
+    }
+
+    qsizetype suffix = 0;
+    while (suffix < minSize - prefix
+           && oldText[oldText.size() - 1 - suffix] == newText[newText.size() - 1 - suffix]) {
+        ++suffix;
+    }
+
+    const auto oldEnd = oldText.size() - suffix;
+    const auto newEnd = newText.size() - suffix;
+    return TSInputEdit {
+        .start_byte = static_cast<uint32_t>(prefix * sizeof(QChar)),
+        .old_end_byte = static_cast<uint32_t>(oldEnd * sizeof(QChar)),
+        .new_end_byte = static_cast<uint32_t>(newEnd * sizeof(QChar)),
+        .start_point = pointAt(oldText, prefix),
+        .old_end_point = pointAt(oldText, oldEnd),
+        .new_end_point = pointAt(newText, newEnd),
+    };
+}
+
 Tree::Tree(TSTree *tree)
     : m_tree(tree)
 {
@@ -49,4 +88,24 @@ Node Tree::rootNode() const
     return Node(ts_tree_root_node(m_tree));
 }
 
+Tree Tree::copy() const
+{
+    return Tree(ts_tree_copy(m_tree));
+}
+
+void Tree::edit(const TSInputEdit &edit)
+{
+    ts_tree_edit(m_tree, &edit);
+}
+
+QList<TSRange> Tree::changedRanges(const Tree &newTree) const
+{
+    uint32_t length = 0;
+    auto *ranges = ts_tree_get_changed_ranges(m_tree, newTree.m_tree, &length);
+    QList<TSRange> result(ranges, ranges + length);
+    // The ranges are allocated by tree-sitter with malloc.
+    free(ranges);
+    return result;
+}
+
 }
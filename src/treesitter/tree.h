@@ -12,12 +12,22 @@
 
 #include "node.h"
 
+#include <QList>
+#include <QStringView>
+#include <optional>
+#include <tree_sitter/api.h>
+
 struct TSTree;
 
 namespace treesitter {
 
 class Parser;
 
+// Computes the edit turning `oldText` into `newText`, as a single range replaced between their common prefix and
+// suffix. Positions are in bytes of the UTF-16 text, as used by the parser.
+// Returns an empty optional if both texts are identical.
+std::optional<TSInputEdit> inputEdit(QStringView oldText, QStringView newText);
+
 class Tree
 {
 public:
@@ -31,6 +41,16 @@ public:
 
     Node rootNode() const;
 
+    // Shallow copy, sharing the nodes with this tree. Editing the copy doesn't affect this tree.
+    Tree copy() const;
+
+    // Adjusts the tree to an edit of its source, so it can be passed to Parser::parseString for an incremental parse.
+    // Note: existing Node instances of this tree are not updated.
+    void edit(const TSInputEdit &edit);
+
+    // Ranges whose syntactic structure differs between this tree (edited) and `newTree`, parsed from it.
+    QList<TSRange> changedRanges(const Tree &newTree) const;
+
     void swap(Tree &other) noexcept;
 
 private:
@@ -39,9 +59,6 @@ private:
     TSTree *m_tree;
 
     friend class Parser;
-
-    // TODO: Once update is implemented, store weak pointers to all
-    // TSNodes so that they may be updated as well.
 };
 
 }
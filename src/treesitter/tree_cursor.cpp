@@ -13,6 +13,7 @@
 #include <tree_sitter/api.h>
 
 #include <QString>
+#include <utility>
 
 namespace treesitter {
 TreeCursor::TreeCursor(Node node)
@@ -46,4 +47,57 @@ bool TreeCursor::gotoParent()
     return ts_tree_cursor_goto_parent(&m_cursor);
 }
 
+// ------------------------ PreorderWalker --------------------
+PreorderWalker::PreorderWalker(const Node &root, QByteArrayList types /* = {} */)
+    : m_cursor(ts_tree_cursor_new(root.m_node))
+    , m_types(std::move(types))
+{
+}
+
+PreorderWalker::~PreorderWalker()
+{
+    ts_tree_cursor_delete(&m_cursor);
+}
+
+std::optional<Node> PreorderWalker::next()
+{
+    while (advance()) {
+        const auto node = ts_tree_cursor_current_node(&m_cursor);
+        if (m_types.isEmpty() || m_types.contains(QByteArrayView(ts_node_type(node)))) {
+            return Node(node);
+        }
+    }
+    return {};
+}
+
+void PreorderWalker::skipChildren()
+{
+    m_skipChildren = true;
+}
+
+bool PreorderWalker::advance()
+{
+    if (m_finished) {
+        return false;
+    }
+
+    const bool skipChildren = std::exchange(m_skipChildren, false);
+    if (!skipChildren && ts_tree_cursor_goto_first_child(&m_cursor)) {
+        ++m_depth;
+        return true;
+    }
+
+    // Go to the next sibling of the current node or of its closest ancestor, without leaving the root.
+    while (m_depth > 0) {
+        if (ts_tree_cursor_goto_next_sibling(&m_cursor)) {
+            return true;
+        }
+        ts_tree_cursor_goto_parent(&m_cursor);
+        --m_depth;
+    }
+
+    m_finished = true;
+    return false;
+}
+
 }
@@ -12,6 +12,9 @@
 
 #include "node.h"
 
+#include <QByteArrayList>
+#include <optional>
+
 namespace treesitter {
 
 class TreeCursor
@@ -32,4 +35,40 @@ public:
 private:
     TSTreeCursor m_cursor;
 };
+
+// Visits the descendants of a node in preorder, without allocating anything.
+// If types are given, only the nodes of one of those types are returned, but all nodes are still visited.
+//
+// PreorderWalker walker(root, {"function_definition"});
+// while (auto node = walker.next()) {
+//     ...
+//     walker.skipChildren();
+// }
+class PreorderWalker
+{
+public:
+    explicit PreorderWalker(const Node &root, QByteArrayList types = {});
+    PreorderWalker(const PreorderWalker &) = delete;
+    PreorderWalker(PreorderWalker &&) = delete;
+    ~PreorderWalker();
+
+    PreorderWalker &operator=(const PreorderWalker &) = delete;
+    PreorderWalker &operator=(PreorderWalker &&) = delete;
+
+    // Returns the next descendant in preorder, the root itself is not returned.
+    std::optional<Node> next();
+
+    // The descendants of the node last returned by next() won't be visited.
+    void skipChildren();
+
+private:
+    bool advance();
+
+    TSTreeCursor m_cursor;
+    QByteArrayList m_types;
+    uint32_t m_depth = 0;
+    bool m_skipChildren = false;
+    bool m_finished = false;
+};
+
 }
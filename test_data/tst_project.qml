@@ -34,33 +34,77 @@ Script {
         compare(rcdoc.type, Document.Rc)
     }
 
+    function test_get() {
+        Project.root = Dir.currentScriptPath + "/projects/mfc-dialog"
+
+        var doc = Project.get("TutorialDlg.h")
+        compare(Project.get(Project.root + "/TutorialDlg.h"), doc)
+        compare(Project.get(Project.root + "/./res/../TutorialDlg.h"), doc)
+
+        Project.open("TutorialDlg.h")
+        Project.open("Tutorial.rc")
+        compare(Project.openPrevious().fileName, doc.fileName)
+    }
+
+    function test_preload() {
+        Project.root = Dir.currentScriptPath + "/projects/cpp-project"
+
+        var main = Project.get("main.cpp")
+        var documents = Project.preload(["myobject.h", "main.cpp", "myobject.cpp"])
+        compare(documents.length, 3)
+        compare(documents[1], main)
+        compare(documents[0], Project.get("myobject.h"))
+        compare(documents[0].type, Document.Cpp)
+        verify(documents[2].text.includes("MyObject::"))
+        verify(documents[0].findSymbol("MyObject") !== null)
+    }
+
     function test_findInFiles() {
-        if(Project.isFindInFilesAvailable()) {
+        Project.root = Dir.currentScriptPath + "/projects/mfc-dialog"
+
         let simplePattern = "CTutorialApp::InitInstance()"
         let simpleResults = Project.findInFiles(simplePattern)
 
-            compare(simpleResults.length, 2)
+        compare(simpleResults.length, 2)
+
+        simpleResults.sort((a, b) => a.file.localeCompare(b.file));
+
+        compare(simpleResults[0].file, Project.root + "/Tutorial.cpp")
+        compare(simpleResults[0].line, 38)
+        compare(simpleResults[0].column, 6)
+        compare(simpleResults[0].text, "CTutorialApp::InitInstance")
+        compare(simpleResults[1].file, Project.root + "/TutorialDlg.h")
+        compare(simpleResults[1].line, 9)
+        compare(simpleResults[1].column, 9)
 
-            simpleResults.sort((a, b) => a.file.localeCompare(b.file));
+        let multilinePattern = "SetIcon\\(m_hIcon,\\s*TRUE\\);.*\\s*SetIcon\\(m_hIcon,\\s*FALSE\\);";
+        let multilineResults = Project.findInFiles(multilinePattern)
 
-            compare(simpleResults[0].file, Project.root + "/Tutorial.cpp")
-            compare(simpleResults[0].line, 38)
-            compare(simpleResults[0].column, 6)
-            compare(simpleResults[1].file, Project.root + "/TutorialDlg.h")
-            compare(simpleResults[1].line, 9)
-            compare(simpleResults[1].column, 9)
+        compare(multilineResults.length, 1)
 
-            let multilinePattern = "SetIcon\\(m_hIcon,\\s*TRUE\\);.*\\s*SetIcon\\(m_hIcon,\\s*FALSE\\);";
-            let multilineResults = Project.findInFiles(multilinePattern)
+        compare(multilineResults[0].file, Project.root + "/TutorialDlg.cpp")
+        compare(multilineResults[0].line, 58)
+        compare(multilineResults[0].column, 2)
 
-            compare(multilineResults.length, 1)
+        compare(Project.findInFiles("[").length, 0)
+    }
+
+    function test_queryAll() {
+        Project.root = Dir.currentScriptPath + "/projects/mfc-dialog"
 
-            compare(multilineResults[0].file, Project.root + "/TutorialDlg.cpp")
-            compare(multilineResults[0].line, 58)
-            compare(multilineResults[0].column, 2)
-        }
-        else {
-            Message.warning("Ripgrep (rg) isn't available on the system")
-        }
+        let query = "(function_definition declarator: (function_declarator declarator: (qualified_identifier) @name (#eq? @name \"CTutorialApp::InitInstance\")))"
+        let matches = Project.queryAll(["cpp"], query)
+        compare(matches.length, 1)
+        compare(matches[0].file, "Tutorial.cpp")
+        compare(matches[0].captures.length, 1)
+        compare(matches[0].captures[0].name, "name")
+        compare(matches[0].captures[0].text, "CTutorialApp::InitInstance")
+        compare(matches[0].captures[0].line, 38)
+        compare(matches[0].captures[0].column, 6)
+
+        let dialogMatches = Project.queryAll(["*Dlg.cpp"], "(function_definition) @function")
+        for (let match of dialogMatches)
+            compare(match.file, "TutorialDlg.cpp")
+        verify(dialogMatches.length > 0)
     }
 }
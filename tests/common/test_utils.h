@@ -105,6 +105,21 @@ inline bool compareDirectories(const QString &current, const QString &expected)
     return result;
 }
 
+/**
+ * @brief Create the file `path` inside `root`, with its parent directories, and write `content` in it.
+ * Return true if the file has been created.
+ */
+inline bool createFile(const QString &root, const QString &path, const QByteArray &content = {})
+{
+    const QString fileName = root + '/' + path;
+    if (!QDir().mkpath(QFileInfo(fileName).absolutePath()))
+        return false;
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    return file.write(content) == content.size();
+}
+
 /**
  * @brief The FileTester class to handle expected/original files
  * Create a temporary file based on an original one, and also compare to an expected one.
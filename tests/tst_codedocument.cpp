@@ -10,14 +10,23 @@
 
 #include "common/test_utils.h"
 #include "core/codedocument.h"
+#include "core/codedocument_p.h"
 #include "core/knutcore.h"
 #include "core/lsp_utils.h"
 #include "core/project.h"
+#include "core/querycache.h"
 #include "core/querymatch.h"
+#include "core/settings.h"
+#include "treesitter/languages.h"
+#include "treesitter/query.h"
 
 #include <QAction>
+#include <QDateTime>
+#include <QDirIterator>
 #include <QPlainTextEdit>
+#include <QPointer>
 #include <QSignalSpy>
+#include <QTemporaryDir>
 #include <QTemporaryFile>
 #include <QTest>
 #include <kdalgorithms.h>
@@ -207,6 +216,32 @@ private slots:
         verifySymbol(headerDocument, symbol, "MyObject::m_message", Core::Symbol::Kind::Field, "m_message");
     }
 
+    void findSymbols()
+    {
+        CHECK_CLANGD_VERSION;
+
+        INIT_KNUT_PROJECT;
+
+        auto headerDocument = qobject_cast<Core::CodeDocument *>(project->open("myobject.h"));
+
+        // Same results as findSymbol, in the order of the names.
+        const QStringList names = {"myobject::saymessage", "sayMessage", "m_message", "unknown", "MyEnum::A"};
+        auto symbols = headerDocument->findSymbols(names);
+        QCOMPARE(symbols.size(), names.size());
+        for (int i = 0; i < names.size(); ++i)
+            QCOMPARE(symbols.at(i), headerDocument->findSymbol(names.at(i)));
+        QVERIFY(symbols.at(3) == nullptr);
+        verifySymbol(headerDocument, symbols.at(0), "MyObject::sayMessage", Core::Symbol::Kind::Method, "sayMessage");
+        verifySymbol(headerDocument, symbols.at(4), "MyObject::MyEnum::A", Core::Symbol::Kind::Enum, "A");
+
+        symbols = headerDocument->findSymbols({"MyObject::MyEnum", "myobject::myenum", "MyEnum"},
+                                              Core::TextDocument::FindWholeWords
+                                                  | Core::TextDocument::FindCaseSensitively);
+        verifySymbol(headerDocument, symbols.at(0), "MyObject::MyEnum", Core::Symbol::Kind::Enum, "MyEnum");
+        QVERIFY(symbols.at(1) == nullptr);
+        QVERIFY(symbols.at(2) == nullptr);
+    }
+
     void followSymbol()
     {
         CHECK_CLANGD_VERSION;
@@ -401,6 +436,298 @@ private slots:
         QCOMPARE(counter.count(), 1);
     }
 
+    void queryCache()
+    {
+        INIT_KNUT_PROJECT;
+
+        auto codedocument = qobject_cast<Core::CodeDocument *>(Core::Project::instance()->get("main.cpp"));
+
+        QTemporaryDir directory;
+        Core::QueryCache cache(directory.path());
+
+        auto query = std::make_shared<treesitter::Query>(tree_sitter_cpp(), R"EOF(
+                (function_definition
+                  declarator: (function_declarator
+                    declarator: (identifier) @name)) @function
+                      )EOF");
+        const auto matches = codedocument->query(query);
+        QVERIFY(!matches.isEmpty());
+
+        const auto documentKey =
+            Core::QueryCache::documentKey(codedocument->text(), codedocument->includedRanges(), tree_sitter_cpp());
+        const auto queryKey = Core::QueryCache::queryKey(*query, {});
+        QVERIFY(Core::QueryCache::queryKey(*query, {{"name", "main"}}) != queryKey);
+
+        QVERIFY(!cache.find(*codedocument, documentKey, queryKey).has_value());
+        cache.insert(*codedocument, documentKey, queryKey, matches);
+
+        const auto cached = cache.find(*codedocument, documentKey, queryKey);
+        QVERIFY(cached.has_value());
+        QCOMPARE(cached->size(), matches.size());
+        for (int i = 0; i < matches.size(); ++i) {
+            const auto &captures = matches.at(i).captures();
+            const auto &cachedCaptures = cached->at(i).captures();
+            QCOMPARE(cachedCaptures.size(), captures.size());
+            for (int j = 0; j < captures.size(); ++j) {
+                QCOMPARE(cachedCaptures.at(j).name, captures.at(j).name);
+                QCOMPARE(cachedCaptures.at(j).range.start(), captures.at(j).range.start());
+                QCOMPARE(cachedCaptures.at(j).range.end(), captures.at(j).range.end());
+            }
+        }
+
+        // A new content invalidates the entries stored for the previous one.
+        const auto newKey = Core::QueryCache::documentKey(codedocument->text() + '\n', codedocument->includedRanges(),
+                                                          tree_sitter_cpp());
+        QVERIFY(newKey != documentKey);
+        QVERIFY(!cache.find(*codedocument, newKey, queryKey).has_value());
+        cache.insert(*codedocument, newKey, queryKey, {});
+        QVERIFY(!cache.find(*codedocument, documentKey, queryKey).has_value());
+        QVERIFY(cache.find(*codedocument, newKey, queryKey)->isEmpty());
+    }
+
+    void queryFromQueryCache()
+    {
+        Test::FileTester file(Test::testDataPath() + "/tst_codedocument/ast/header.h");
+        QTemporaryDir directory;
+        {
+            INIT_KNUT_PROJECT;
+            SET_DEFAULT_VALUE(QueryCacheEnabled, true);
+            SET_DEFAULT_VALUE(QueryCacheDirectory, directory.path());
+
+            const QString query = "(function_definition declarator: (_) @declarator) @function";
+            auto codedocument = qobject_cast<Core::CodeDocument *>(project->get(file.fileName()));
+            const auto matches = codedocument->query(query);
+            QCOMPARE(matches.size(), 1);
+            const auto declarator = matches.first().get("declarator").text();
+            QCOMPARE(codedocument->helper()->parseCount(), 1);
+            codedocument->close();
+
+            // The file didn't change, the results are restored from the cache without parsing it.
+            codedocument = qobject_cast<Core::CodeDocument *>(project->get(file.fileName()));
+            const auto cached = codedocument->query(query);
+            QCOMPARE(cached.size(), 1);
+            QCOMPARE(cached.first().get("declarator").text(), declarator);
+            QCOMPARE(codedocument->helper()->parseCount(), 0);
+
+            // A new content isn't in the cache, the document is parsed.
+            codedocument->insertAtPosition("// Comment\n", 0);
+            QCOMPARE(codedocument->query(query).size(), 1);
+            QCOMPARE(codedocument->helper()->parseCount(), 1);
+            QCOMPARE(codedocument->query(query).size(), 1);
+            QCOMPARE(codedocument->helper()->parseCount(), 1);
+
+            SET_DEFAULT_VALUE(QueryCacheEnabled, false);
+        }
+    }
+
+    void queryCacheEviction()
+    {
+        INIT_KNUT_PROJECT;
+
+        QTemporaryDir directory;
+        QTemporaryDir files;
+        QVERIFY(QFile::copy(project->root() + "/main.cpp", files.path() + "/main.cpp"));
+        QVERIFY(QFile::copy(project->root() + "/myobject.h", files.path() + "/myobject.h"));
+        auto source = qobject_cast<Core::CodeDocument *>(project->get(files.path() + "/main.cpp"));
+        auto header = qobject_cast<Core::CodeDocument *>(project->get(files.path() + "/myobject.h"));
+
+        Core::QueryCache cache(directory.path());
+        auto query = std::make_shared<treesitter::Query>(tree_sitter_cpp(), "(identifier) @name");
+        const auto queryKey = Core::QueryCache::queryKey(*query, {});
+        auto insert = [&](Core::CodeDocument *document) {
+            const auto documentKey =
+                Core::QueryCache::documentKey(document->text(), document->includedRanges(), tree_sitter_cpp());
+            cache.insert(*document, documentKey, queryKey, document->query(query));
+            return documentKey;
+        };
+        const auto sourceKey = insert(source);
+        const auto headerKey = insert(header);
+
+        // Entries of a file that doesn't exist anymore are removed when the cache is opened.
+        QVERIFY(QFile::remove(files.path() + "/myobject.h"));
+        {
+            Core::QueryCache reopened(directory.path());
+        }
+        QVERIFY(cache.find(*source, sourceKey, queryKey).has_value());
+        QVERIFY(!cache.find(*header, headerKey, queryKey).has_value());
+
+        // Old entries are removed.
+        QDirIterator it(directory.path(), QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            QFile entry(it.next());
+            QVERIFY(entry.open(QIODevice::ReadWrite));
+            QVERIFY(entry.setFileTime(QDateTime::currentDateTime().addDays(-31), QFileDevice::FileModificationTime));
+        }
+        {
+            Core::QueryCache reopened(directory.path());
+        }
+        QVERIFY(!cache.find(*source, sourceKey, queryKey).has_value());
+
+        // The oldest entries are removed until the cache fits in its maximum size.
+        insert(source);
+        QVERIFY(cache.find(*source, sourceKey, queryKey).has_value());
+        {
+            Core::QueryCache reopened(directory.path(), 0);
+        }
+        QVERIFY(!cache.find(*source, sourceKey, queryKey).has_value());
+    }
+
+    void symbolsFromQueryCache()
+    {
+        Test::FileTester file(Test::testDataPath() + "/tst_codedocument/ast/header.h");
+        QTemporaryDir directory;
+        {
+            INIT_KNUT_PROJECT;
+            SET_DEFAULT_VALUE(QueryCacheEnabled, true);
+            SET_DEFAULT_VALUE(QueryCacheDirectory, directory.path());
+
+            auto codedocument = qobject_cast<Core::CodeDocument *>(project->get(file.fileName()));
+            const auto symbolCount = codedocument->symbols().size();
+            QVERIFY(symbolCount > 0);
+            QCOMPARE(codedocument->helper()->parseCount(), 1);
+            codedocument->close();
+
+            // The file didn't change, its symbols are restored from the cache without parsing it.
+            codedocument = qobject_cast<Core::CodeDocument *>(project->get(file.fileName()));
+            QCOMPARE(codedocument->symbols().size(), symbolCount);
+            QCOMPARE(codedocument->helper()->parseCount(), 0);
+
+            // Without a previous tree, nothing tells which symbols changed: they are all queried again.
+            codedocument->insertAtPosition("// Comment\n", 0);
+            QCOMPARE(codedocument->symbols().size(), symbolCount);
+            QCOMPARE(codedocument->helper()->parseCount(), 1);
+
+            // The previous tree is parsed incrementally, only the changed symbols are queried again.
+            codedocument->insertAtPosition("// Other comment\n", 0);
+            QCOMPARE(codedocument->symbols().size(), symbolCount);
+            QCOMPARE(codedocument->helper()->parseCount(), 2);
+
+            SET_DEFAULT_VALUE(QueryCacheEnabled, false);
+        }
+    }
+
+    void unload()
+    {
+        Test::FileTester file(Test::testDataPath() + "/tst_codedocument/ast/header.h");
+        {
+            INIT_KNUT_PROJECT;
+
+            auto codedocument = qobject_cast<Core::CodeDocument *>(project->get(file.fileName()));
+            const auto text = codedocument->text();
+            const auto symbolCount = codedocument->symbols().size();
+            QVERIFY(symbolCount > 0);
+            const auto *symbol = codedocument->symbols().first();
+            const auto symbolName = symbol->name();
+            const auto rangeMark = codedocument->createRangeMark(5, 15);
+            const auto rangeMarkText = rangeMark.text();
+            codedocument->setPosition(10);
+            QVERIFY(codedocument->memoryUsage() > 0);
+            const auto childCount = codedocument->children().size();
+
+            QVERIFY(codedocument->unload());
+            QVERIFY(!codedocument->isLoaded());
+            QCOMPARE(codedocument->memoryUsage(), qint64(0));
+            QCOMPARE(project->memoryStatistics().value("unloadedDocuments").toInt(), 1);
+            // Symbols are only deleted once back in the event loop, the code running can still use them.
+            QPointer<const Core::Symbol> symbolPointer(symbol);
+            QCOMPARE(symbol->name(), symbolName);
+            QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+            QVERIFY(symbolPointer.isNull());
+
+            // Accessing the document loads it again, as it was.
+            codedocument->ensureLoaded();
+            QCOMPARE(codedocument->text(), text);
+            QVERIFY(codedocument->isLoaded());
+            QCOMPARE(rangeMark.start(), 5);
+            QCOMPARE(rangeMark.end(), 15);
+            QCOMPARE(rangeMark.text(), rangeMarkText);
+            QVERIFY(!codedocument->hasChanged());
+            QCOMPARE(codedocument->position(), 10);
+            QCOMPARE(codedocument->symbols().size(), symbolCount);
+            QCOMPARE(project->memoryStatistics().value("reloads").toInt(), 1);
+
+            // Unloading doesn't leak the symbols.
+            for (int i = 0; i < 3; ++i) {
+                QVERIFY(codedocument->unload());
+                codedocument->ensureLoaded();
+                QCOMPARE(codedocument->symbols().size(), symbolCount);
+            }
+            QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+            QCOMPARE(codedocument->children().size(), childCount);
+            QCOMPARE(project->memoryStatistics().value("reloads").toInt(), 4);
+
+            // Changes would be lost.
+            codedocument->insert("// Comment\n");
+            QVERIFY(!codedocument->unload());
+            QVERIFY(codedocument->isLoaded());
+
+            // Closing an unloaded document isn't a reload.
+            auto *other = project->get("main.cpp");
+            const auto loadedDocuments = project->memoryStatistics().value("loadedDocuments").toInt();
+            QVERIFY(other->unload());
+            other->close();
+            QCOMPARE(project->memoryStatistics().value("reloads").toInt(), 4);
+            QCOMPARE(project->memoryStatistics().value("loadedDocuments").toInt(), loadedDocuments - 1);
+        }
+    }
+
+    void documentPaths()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        Core::KnutCore core;
+        auto project = Core::Project::instance();
+        project->setRoot(dir.path());
+
+        auto *first = project->get("first.txt");
+        auto *second = project->get("second.txt");
+        QVERIFY(first && second);
+        QCOMPARE(project->get(dir.path() + "/first.txt"), first);
+
+        // Saving a document with the name of another one: the saved document is returned for this name.
+        QVERIFY(second->saveAs(dir.path() + "/first.txt"));
+        QCOMPARE(project->get("first.txt"), second);
+
+        // Once renamed again, the other document is found again.
+        QVERIFY(second->saveAs(dir.path() + "/third.txt"));
+        QCOMPARE(project->get("third.txt"), second);
+        QCOMPARE(project->get("first.txt"), first);
+
+        // A closed document isn't returned anymore.
+        first->close();
+        auto *reopened = project->get("first.txt");
+        QVERIFY(reopened != first);
+        QCOMPARE(reopened->fileName(), dir.path() + "/first.txt");
+    }
+
+    void saveAllDocuments()
+    {
+        Test::FileTester file(Test::testDataPath() + "/tst_codedocument/ast/header.h");
+        {
+            INIT_KNUT_PROJECT;
+
+            auto codedocument = qobject_cast<Core::CodeDocument *>(project->get(file.fileName()));
+            codedocument->insert("// Comment\n");
+            QVERIFY(project->saveAllDocuments());
+            QVERIFY(!codedocument->hasChanged());
+            auto savedText = [&file]() {
+                QFile savedFile(file.fileName());
+                return savedFile.open(QIODevice::ReadOnly) ? QString::fromUtf8(savedFile.readAll()) : QString();
+            };
+            QCOMPARE(savedText(), codedocument->text());
+
+            // A change made while the snapshot is written is kept.
+            codedocument->insert("// Other comment\n");
+            const auto snapshot = codedocument->saveSnapshot();
+            QVERIFY(snapshot.has_value());
+            const auto text = codedocument->text();
+            codedocument->insert("// Last comment\n");
+            QVERIFY(codedocument->finishSave(*snapshot, snapshot->write()));
+            QVERIFY(codedocument->hasChanged());
+            QCOMPARE(savedText(), text);
+        }
+    }
+
     void queryInRange()
     {
         INIT_KNUT_PROJECT;
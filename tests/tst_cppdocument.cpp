@@ -58,6 +58,26 @@ private slots:
                               });
     }
 
+    void headerSourcePairs()
+    {
+        Core::KnutCore core;
+        auto project = Core::Project::instance();
+        project->setRoot(Test::testDataPath() + "/tst_cppdocument/headerSource");
+
+        const auto pairs = project->headerSourcePairs();
+        QStringList result;
+        for (const auto &pair : pairs) {
+            const auto map = pair.toMap();
+            result.push_back(map.value("header").toString() + " => " + map.value("source").toString());
+        }
+        const QStringList expected = {"folder2/foo.h => folder1/foo.cpp", "test/foo.h => test/foo.cpp",
+                                      "test/hello.h => test/hello.cpp",
+                                      "test/subfolder2/foo.h => test/subfolder1/foo.cpp",
+                                      "test/world.hpp => test/world.cxx"};
+        QCOMPARE(result, expected);
+        QVERIFY(project->documents().isEmpty());
+    }
+
     void insertForwardDeclaration()
     {
         {
@@ -391,6 +391,86 @@ private slots:
             QCOMPARE(match.get("return").text(), "void");
         });
     }
+
+    void excludeMacrosAfterEdit()
+    {
+        const auto sameRanges = [](const QList<treesitter::Range> &ranges,
+                                   const QList<treesitter::Range> &otherRanges) {
+            return std::ranges::equal(ranges, otherRanges, [](const auto &range, const auto &other) {
+                return range.start_byte == other.start_byte && range.end_byte == other.end_byte
+                    && range.start_point.row == other.start_point.row
+                    && range.start_point.column == other.start_point.column
+                    && range.end_point.row == other.end_point.row && range.end_point.column == other.end_point.column;
+            });
+        };
+
+        Core::KnutCore core;
+        QFile file(Test::testDataPath() + "/tst_cppdocument/treesitterExcludesMacros/AFX_EXT_CLASS.h");
+        QVERIFY(file.open(QIODevice::ReadOnly));
+
+        // Not attached to a file, so the edits are not saved.
+        Core::CppDocument document;
+        document.setText(QString::fromUtf8(file.readAll()));
+        QCOMPARE(document.includedRanges().size(), 5);
+
+        // The excluded macros are updated from the edited blocks only, and must match a full scan.
+        document.insertAtPosition("\nAFX_EXT_CLASS int AFX_EXT_CLASS m_other;", document.text().indexOf("};"));
+        document.deleteRegion(0, document.text().indexOf("class"));
+        document.replace(document.text().indexOf("publicAFX_EXT_CLASS"), document.text().indexOf(":\n"), "public");
+
+        Core::CppDocument fullScan;
+        fullScan.setText(document.text());
+        const auto ranges = document.includedRanges();
+        QCOMPARE(ranges.size(), 6);
+        QVERIFY(sameRanges(ranges, fullScan.includedRanges()));
+    }
+
+    void incrementalSymbols()
+    {
+        Core::KnutCore core;
+
+        // Not attached to a file, so the edits are not saved.
+        Core::CppDocument document;
+        document.setText(R"(class MyClass
+{
+public:
+    void foo();
+    int m_bar = 0;
+};
+
+void MyClass::foo()
+{
+    m_bar = 1;
+}
+
+int main()
+{
+    return 0;
+}
+)");
+        const auto symbols = document.symbols();
+        const auto mainSymbol = document.findSymbol("main");
+        QVERIFY(mainSymbol);
+
+        // Only the symbols touched by the edit are queried again, the others are kept.
+        document.insertAtPosition("\n    int baz = m_bar;", document.text().indexOf("m_bar = 1;") + 10);
+        document.insertAtPosition("\nvoid other() {}\n", document.text().indexOf("int main"));
+        const auto newSymbols = document.symbols();
+        QCOMPARE(newSymbols.size(), symbols.size() + 1);
+        QCOMPARE(document.findSymbol("main"), mainSymbol);
+        QVERIFY(document.findSymbol("other"));
+
+        Core::CppDocument fullScan;
+        fullScan.setText(document.text());
+        const auto fullSymbols = fullScan.symbols();
+        QCOMPARE(newSymbols.size(), fullSymbols.size());
+        for (int i = 0; i < newSymbols.size(); ++i) {
+            QCOMPARE(newSymbols.at(i)->name(), fullSymbols.at(i)->name());
+            QCOMPARE(newSymbols.at(i)->kind(), fullSymbols.at(i)->kind());
+            QCOMPARE(newSymbols.at(i)->range().start(), fullSymbols.at(i)->range().start());
+            QCOMPARE(newSymbols.at(i)->range().end(), fullSymbols.at(i)->range().end());
+        }
+    }
 };
 
 QTEST_MAIN(TestCppDocumentTreeSitter)
@@ -0,0 +1,154 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "common/test_utils.h"
+#include "core/directorywalker.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSemaphore>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThreadPool>
+#include <algorithm>
+
+class TestDirectoryWalker : public QObject
+{
+    Q_OBJECT
+
+    static QStringList walkedFiles(Core::DirectoryWalker &walker, const QString &path = {})
+    {
+        QStringList files;
+        const auto directories = walker.walk(path);
+        for (const auto &directory : directories)
+            files.append(directory.files);
+        std::ranges::sort(files);
+        return files;
+    }
+
+private slots:
+    void ignoreFiles()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const auto root = dir.path();
+
+        QVERIFY(Test::createFile(root, ".gitignore", "# Comment\nbuild/\n*.o\n!keep.o\n/root.txt\ndoc/**/*.tmp\n"));
+        QVERIFY(Test::createFile(root, ".hidden.txt"));
+        QVERIFY(Test::createFile(root, "main.cpp"));
+        QVERIFY(Test::createFile(root, "main.o"));
+        QVERIFY(Test::createFile(root, "keep.o"));
+        QVERIFY(Test::createFile(root, "root.txt"));
+        QVERIFY(Test::createFile(root, "build/output.cpp"));
+        QVERIFY(Test::createFile(root, "doc/a/b/notes.tmp"));
+        QVERIFY(Test::createFile(root, "doc/a/b/notes.md"));
+        QVERIFY(Test::createFile(root, "src/.knutignore", "generated/\nlocal.txt\n"));
+        QVERIFY(Test::createFile(root, "src/root.txt"));
+        QVERIFY(Test::createFile(root, "src/local.txt"));
+        QVERIFY(Test::createFile(root, "src/util.o"));
+        QVERIFY(Test::createFile(root, "src/generated/ui.cpp"));
+        QVERIFY(Test::createFile(root, "src/sub/local.txt"));
+        QVERIFY(Test::createFile(root, "third_party/lib.cpp"));
+
+        Core::DirectoryWalker walker(root, {"third_party/"});
+        const QStringList expected = {"doc/a/b/notes.md", "keep.o", "main.cpp", "src/root.txt"};
+        QCOMPARE(walkedFiles(walker), expected);
+
+        // A new exclude list applies to the next walk.
+        QVERIFY(walker.setExcludes({}));
+        QVERIFY(!walker.setExcludes({}));
+        QCOMPARE(walkedFiles(walker),
+                 (QStringList {"doc/a/b/notes.md", "keep.o", "main.cpp", "src/root.txt", "third_party/lib.cpp"}));
+
+        // Listing a sub-directory uses the ignore files of its parents.
+        Core::DirectoryWalker otherWalker(root);
+        QCOMPARE(walkedFiles(otherWalker, "src"), QStringList {"src/root.txt"});
+        const auto directory = otherWalker.list("src");
+        QCOMPARE(directory.files, QStringList {"src/root.txt"});
+        QCOMPARE(directory.subDirectories, QStringList {"src/sub"});
+
+        // Changing an ignore file is detected.
+        QVERIFY(!otherWalker.reloadIgnoreFiles("src"));
+        QVERIFY(Test::createFile(root, "src/.knutignore", "generated/\n"));
+        QVERIFY(otherWalker.reloadIgnoreFiles("src"));
+        QCOMPARE(walkedFiles(otherWalker, "src"),
+                 (QStringList {"src/local.txt", "src/root.txt", "src/sub/local.txt"}));
+    }
+
+    void busyThreadPool()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const auto root = dir.path();
+        for (int i = 0; i < 40; ++i)
+            QVERIFY(Test::createFile(root, QString("dir%1/file%2.cpp").arg(i % 8).arg(i)));
+
+        // All the threads of the pool are busy, the walk is done by the calling thread only.
+        auto *pool = QThreadPool::globalInstance();
+        const auto maxThreadCount = pool->maxThreadCount();
+        pool->setMaxThreadCount(2);
+        QSemaphore blocked;
+        for (int i = 0; i < 2; ++i)
+            pool->start([&blocked]() {
+                blocked.acquire();
+            });
+        Core::DirectoryWalker walker(root);
+        const auto files = walkedFiles(walker);
+        blocked.release(2);
+        QVERIFY(pool->waitForDone());
+        pool->setMaxThreadCount(maxThreadCount);
+        QCOMPARE(files.size(), 40);
+    }
+
+    void benchmark_data()
+    {
+        QTest::addColumn<bool>("useWalker");
+
+        QTest::newRow("QDirIterator") << false;
+        QTest::newRow("DirectoryWalker") << true;
+    }
+
+    void benchmark()
+    {
+        QFETCH(bool, useWalker);
+
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const auto root = dir.path();
+        for (int i = 0; i < 50; ++i) {
+            for (int j = 0; j < 40; ++j)
+                QVERIFY(Test::createFile(root, QString("dir%1/sub%2/file%3.cpp").arg(i).arg(j % 4).arg(j)));
+        }
+
+        qsizetype fileCount = 0;
+        QBENCHMARK {
+            if (useWalker) {
+                Core::DirectoryWalker walker(root);
+                fileCount = walkedFiles(walker).size();
+            } else {
+                QDirIterator it(root, QDirIterator::Subdirectories);
+                QStringList files;
+                while (it.hasNext()) {
+                    it.next();
+                    const auto fi = it.fileInfo();
+                    if (fi.isFile())
+                        files.push_back(QDir(root).relativeFilePath(fi.absoluteFilePath()));
+                }
+                std::ranges::sort(files);
+                fileCount = files.size();
+            }
+        }
+        QCOMPARE(fileCount, static_cast<qsizetype>(2000));
+    }
+};
+
+QTEST_MAIN(TestDirectoryWalker)
+#include "tst_directorywalker.moc"
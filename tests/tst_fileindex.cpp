@@ -0,0 +1,71 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "common/test_utils.h"
+#include "core/fileindex.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+class TestFileIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void updateFiles()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const auto root = dir.path();
+
+        QVERIFY(Test::createFile(root, "main.cpp"));
+        QVERIFY(Test::createFile(root, "main.h"));
+        QVERIFY(Test::createFile(root, "doc/readme.md"));
+        QVERIFY(Test::createFile(root, "src/util.cpp"));
+        QVERIFY(Test::createFile(root, "src/Util.h"));
+        QVERIFY(Test::createFile(root, "src/sub/deep.cpp"));
+
+        Core::FileIndex index(root, {});
+        QCOMPARE(index.allFiles(),
+                 (QStringList {"doc/readme.md", "main.cpp", "main.h", "src/Util.h", "src/sub/deep.cpp",
+                               "src/util.cpp"}));
+        QCOMPARE(index.filesWithExtensions({"CPP"}, Qt::CaseInsensitive),
+                 (QStringList {"main.cpp", "src/sub/deep.cpp", "src/util.cpp"}));
+        QCOMPARE(index.filesWithExtensions({"CPP"}, Qt::CaseSensitive), QStringList {});
+        QCOMPARE(index.filesWithExtensions({"cpp", "h"}, Qt::CaseSensitive),
+                 (QStringList {"main.cpp", "main.h", "src/Util.h", "src/sub/deep.cpp", "src/util.cpp"}));
+        QCOMPARE(index.filesWithBaseName("util"), (QStringList {"src/Util.h", "src/util.cpp"}));
+
+        // Remove a file and a directory, add a file and a directory: the index follows the file system right away,
+        // without waiting for the notifications of the watcher.
+        QVERIFY(QFile::remove(root + "/main.cpp"));
+        QVERIFY(QDir(root + "/src/sub").removeRecursively());
+        QVERIFY(Test::createFile(root, "src/new.cpp"));
+        QVERIFY(Test::createFile(root, "doc/api/index.md"));
+
+        QCOMPARE(index.allFiles(),
+                 (QStringList {"doc/api/index.md", "doc/readme.md", "main.h", "src/Util.h", "src/new.cpp",
+                               "src/util.cpp"}));
+        QCOMPARE(index.filesWithExtensions({"cpp"}, Qt::CaseSensitive), (QStringList {"src/new.cpp", "src/util.cpp"}));
+        QCOMPARE(index.filesWithExtensions({"md"}, Qt::CaseSensitive),
+                 (QStringList {"doc/api/index.md", "doc/readme.md"}));
+        QCOMPARE(index.filesWithBaseName("main"), QStringList {"main.h"});
+        QCOMPARE(index.filesWithBaseName("deep"), QStringList {});
+
+        // Files in a new directory are also followed.
+        QVERIFY(QFile::remove(root + "/doc/api/index.md"));
+        QCOMPARE(index.filesWithExtensions({"md"}, Qt::CaseSensitive), QStringList {"doc/readme.md"});
+    }
+};
+
+QTEST_MAIN(TestFileIndex)
+#include "tst_fileindex.moc"
@@ -0,0 +1,109 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "common/test_utils.h"
+#include "core/findinfiles.h"
+
+#include <QStringEncoder>
+#include <QTemporaryDir>
+#include <QTest>
+
+class TestFindInFiles : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void extractRequiredLiteral_data()
+    {
+        QTest::addColumn<QString>("pattern");
+        QTest::addColumn<QByteArray>("literal");
+
+        QTest::newRow("literal") << "foo" << QByteArray("foo");
+        QTest::newRow("any") << "foo.*bar" << QByteArray("foo");
+        QTest::newRow("optional") << "ab?cd" << QByteArray("cd");
+        QTest::newRow("star") << "abc*d" << QByteArray("ab");
+        QTest::newRow("plus") << "x+yz" << QByteArray("yz");
+        QTest::newRow("repeat") << "a{2,3}bcd" << QByteArray("bcd");
+        QTest::newRow("class") << "[abc]def" << QByteArray("def");
+        QTest::newRow("class with bracket") << "[]x]yz" << QByteArray("yz");
+        QTest::newRow("negated class with bracket") << "[^]x]y" << QByteArray("y");
+        QTest::newRow("escaped character") << "\\.cpp" << QByteArray(".cpp");
+        QTest::newRow("character class escape") << "\\d+abc" << QByteArray("abc");
+        QTest::newRow("word boundary") << "\\bword\\b" << QByteArray("word");
+        QTest::newRow("group") << "(?:ab)cd" << QByteArray("cd");
+        QTest::newRow("alternation") << "foo|bar" << QByteArray();
+        QTest::newRow("inline flag") << "(?i)foo" << QByteArray();
+    }
+
+    void extractRequiredLiteral()
+    {
+        QFETCH(QString, pattern);
+        QFETCH(QByteArray, literal);
+
+        QCOMPARE(Core::FindInFiles::extractRequiredLiteral(pattern), literal);
+    }
+
+    void encodings()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString text = QString::fromUtf8("// é\nint héllo = 0;\n");
+        QVERIFY(Test::createFile(dir.path(), "utf8.cpp", text.toUtf8()));
+        QVERIFY(Test::createFile(dir.path(), "utf8bom.cpp", "\xef\xbb\xbf" + text.toUtf8()));
+        QByteArray utf16 = QStringEncoder(QStringConverter::Utf16LE, QStringConverter::Flag::WriteBom).encode(text);
+        QVERIFY(Test::createFile(dir.path(), "utf16.cpp", utf16));
+        QVERIFY(Test::createFile(dir.path(), "binary.cpp", QByteArray("int h\0llo;\nhéllo", 17)));
+        QStringList files;
+        for (const auto &fileName : {"utf8.cpp", "utf8bom.cpp", "utf16.cpp", "binary.cpp"})
+            files.push_back(dir.path() + '/' + fileName);
+
+        // UTF-16 files are decoded, the columns are in characters.
+        Core::FindInFiles findInFiles(QString::fromUtf8("héllo"));
+        const auto matches = findInFiles.run(files);
+        QCOMPARE(matches.size(), 3);
+        for (int i = 0; i < 3; ++i) {
+            QCOMPARE(matches.at(i).fileName, files.at(i));
+            QCOMPARE(matches.at(i).line, 2);
+            QCOMPARE(matches.at(i).column, 5);
+        }
+    }
+
+    void maxResults()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QStringList files;
+        for (int i = 0; i < 20; ++i) {
+            const auto fileName = QString("file%1.cpp").arg(i);
+            QVERIFY(Test::createFile(dir.path(), fileName, "foo();\nfoo();\nfoo();\n"));
+            files.push_back(dir.path() + '/' + fileName);
+        }
+
+        // The search stops itself at the maximum, the files not searched show in the progress.
+        Core::FindInFiles findInFiles("foo");
+        findInFiles.setMaxResults(10);
+        auto future = findInFiles.start(files);
+        future.waitForFinished();
+        QCOMPARE(future.resultCount(), 10);
+        QVERIFY(!future.isCanceled());
+        QVERIFY(future.progressValue() < future.progressMaximum());
+
+        QCOMPARE(findInFiles.run(files).size(), 10);
+
+        findInFiles.setMaxResults(0);
+        future = findInFiles.start(files);
+        future.waitForFinished();
+        QCOMPARE(future.resultCount(), 60);
+        QCOMPARE(future.progressValue(), future.progressMaximum());
+    }
+};
+
+QTEST_MAIN(TestFindInFiles)
+#include "tst_findinfiles.moc"
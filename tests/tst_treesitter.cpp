@@ -14,8 +14,10 @@
 #include "treesitter/predicates.h"
 #include "treesitter/query.h"
 #include "treesitter/tree.h"
+#include "treesitter/tree_cursor.h"
 
 #include <QTest>
+#include <functional>
 
 class TestTreeSitter : public QObject
 {
@@ -53,6 +55,129 @@ private slots:
         QCOMPARE(root.namedChildren().size(), 9);
     }
 
+    void childIteration()
+    {
+        auto source = readTestFile("/tst_treesitter/main.cpp");
+
+        treesitter::Parser parser(tree_sitter_cpp());
+        auto tree = parser.parseString(source);
+        QVERIFY(tree.has_value());
+
+        // Compare against the index-based API of tree-sitter on every node.
+        std::function<void(const treesitter::Node &)> checkChildren = [&](const treesitter::Node &node) {
+            QList<treesitter::Node> children;
+            QStringList fieldNames;
+            const auto range = node.childRange();
+            for (auto it = range.begin(); it != range.end(); ++it) {
+                children.push_back(*it);
+                fieldNames.push_back(it.fieldName());
+            }
+            QCOMPARE(children.size(), static_cast<qsizetype>(node.childCount()));
+            for (uint32_t i = 0; i < node.childCount(); ++i) {
+                QVERIFY(children[i] == node.children().at(i));
+                QCOMPARE(fieldNames[i], node.fieldNameForChild(children[i]));
+            }
+
+            uint32_t namedIndex = 0;
+            for (const auto &child : node.namedChildRange()) {
+                QVERIFY(child == node.namedChild(namedIndex++));
+            }
+            QCOMPARE(namedIndex, node.namedChildCount());
+
+            for (const auto &child : children) {
+                checkChildren(child);
+            }
+        };
+        checkChildren(tree->rootNode());
+    }
+
+    void preorderWalker()
+    {
+        auto source = readTestFile("/tst_treesitter/main.cpp");
+
+        treesitter::Parser parser(tree_sitter_cpp());
+        auto tree = parser.parseString(source);
+        QVERIFY(tree.has_value());
+
+        QList<treesitter::Node> expected;
+        std::function<void(const treesitter::Node &)> collect = [&](const treesitter::Node &node) {
+            for (const auto &child : node.childRange()) {
+                expected.push_back(child);
+                collect(child);
+            }
+        };
+        collect(tree->rootNode());
+
+        QList<treesitter::Node> visited;
+        treesitter::PreorderWalker walker(tree->rootNode());
+        while (const auto node = walker.next()) {
+            visited.push_back(*node);
+        }
+        QCOMPARE(visited.size(), expected.size());
+        QVERIFY(visited == expected);
+
+        // Filtering by type, and skipping the children of nested functions.
+        QStringList functions;
+        treesitter::PreorderWalker functionWalker(tree->rootNode(), {"function_definition"});
+        while (const auto node = functionWalker.next()) {
+            QCOMPARE(node->type(), "function_definition");
+            functions.push_back(node->textIn(source));
+            functionWalker.skipChildren();
+        }
+        const auto expectedFunctions = std::ranges::count_if(expected, [](const treesitter::Node &node) {
+            if (node.type() != "function_definition")
+                return false;
+            for (auto parent = node.parent(); !parent.isNull(); parent = parent.parent()) {
+                if (parent.type() == "function_definition")
+                    return false;
+            }
+            return true;
+        });
+        QCOMPARE(functions.size(), static_cast<qsizetype>(expectedFunctions));
+        QVERIFY(!functions.isEmpty());
+    }
+
+    void incrementalParse()
+    {
+        const QString oldText = "int a = 1;\nint b = 2;\n";
+        const QString newText = "int a = 1;\nint bc = 2;\nint d;\n";
+
+        const auto bytes = [](int characters) {
+            return static_cast<uint32_t>(characters * sizeof(QChar));
+        };
+
+        auto edit = treesitter::inputEdit(oldText, newText);
+        QVERIFY(edit.has_value());
+        QCOMPARE(edit->start_byte, bytes(16));
+        QCOMPARE(edit->old_end_byte, bytes(20));
+        QCOMPARE(edit->new_end_byte, bytes(28));
+        QCOMPARE(edit->start_point.row, 1u);
+        QCOMPARE(edit->start_point.column, bytes(5));
+        QCOMPARE(edit->new_end_point.row, 2u);
+        QCOMPARE(edit->new_end_point.column, bytes(5));
+        QVERIFY(!treesitter::inputEdit(oldText, oldText).has_value());
+
+        treesitter::Parser parser(tree_sitter_cpp());
+        auto oldTree = parser.parseString(oldText);
+        QVERIFY(oldTree.has_value());
+
+        // Editing a copy keeps the original tree untouched.
+        auto editedTree = oldTree->copy();
+        editedTree.edit(edit.value());
+        QCOMPARE(oldTree->rootNode().endPosition(), static_cast<uint32_t>(oldText.size()));
+
+        auto newTree = parser.parseString(newText, &editedTree);
+        QVERIFY(newTree.has_value());
+        QCOMPARE(newTree->rootNode().namedChildCount(), 3u);
+
+        // The first declaration is not affected by the edit.
+        const auto changedRanges = editedTree.changedRanges(newTree.value());
+        QVERIFY(!changedRanges.isEmpty());
+        for (const auto &range : changedRanges) {
+            QVERIFY(range.start_byte >= bytes(11));
+        }
+    }
+
 #define VERIFY_PREDICATE_ERROR(queryString)                                                                            \
     QVERIFY_THROWS_EXCEPTION(Error, treesitter::Query(tree_sitter_cpp(), queryString))
 
@@ -225,6 +350,207 @@ private slots:
         QVERIFY(!cursor.nextMatch().has_value());
     }
 
+    void node_text_view()
+    {
+        auto [source, tree, cursor] = runQuery(R"EOF(
+            (function_definition
+                declarator: (function_declarator
+                    parameters: (parameter_list
+                        (parameter_declaration) @param
+                        (#like? "const std::string &" @param))))
+        )EOF");
+
+        auto match = cursor.nextMatch();
+        QVERIFY(match.has_value());
+        const auto node = match->capturesNamed("param").first().node;
+
+        // The view points directly into the source, no text is copied.
+        const auto view = node.textViewIn(source);
+        QCOMPARE(view.toString(), "const std::string&");
+        QVERIFY(view.constData() == source.constData() + node.startPosition());
+    }
+
+    void query_parameters()
+    {
+        auto source = readTestFile("/tst_treesitter/main.cpp");
+        treesitter::Parser parser(tree_sitter_cpp());
+        auto tree = parser.parseString(source);
+        QVERIFY(tree.has_value());
+
+        auto query = std::make_shared<treesitter::Query>(tree_sitter_cpp(), R"EOF(
+            (function_definition
+                (function_declarator
+                    declarator: (_) @name
+                    (#eq? @name "$functionName")
+                    ))
+        )EOF",
+                                                         treesitter::Query::WithParameters);
+        QCOMPARE(query->parameters(), QStringList {"functionName"});
+
+        // The same query can be executed with different values bound to the parameter.
+        treesitter::QueryCursor cursor;
+        cursor.execute(query, tree->rootNode(),
+                       std::make_unique<treesitter::Predicates>(source, treesitter::Query::Parameters {
+                                                                            {"functionName", "main"}}));
+        auto matches = cursor.allRemainingMatches();
+        QCOMPARE(matches.size(), 1);
+        QCOMPARE(matches.first().capturesNamed("name").first().node.textIn(source), "main");
+
+        cursor.execute(query, tree->rootNode(),
+                       std::make_unique<treesitter::Predicates>(source, treesitter::Query::Parameters {
+                                                                            {"functionName", "myFreeFunction"}}));
+        matches = cursor.allRemainingMatches();
+        QCOMPARE(matches.size(), 1);
+        QCOMPARE(matches.first().capturesNamed("name").first().node.textIn(source), "myFreeFunction");
+
+        // Unbound parameters never match
+        cursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(source));
+        QVERIFY(!cursor.nextMatch().has_value());
+
+        // Without parameters, as for user queries, "$functionName" is a string.
+        auto literalQuery = std::make_shared<treesitter::Query>(tree_sitter_cpp(), R"EOF(
+            (function_definition
+                (function_declarator
+                    declarator: (_) @name
+                    (#eq? @name "$functionName")
+                    ))
+        )EOF");
+        QVERIFY(literalQuery->parameters().isEmpty());
+        cursor.execute(literalQuery, tree->rootNode(),
+                       std::make_unique<treesitter::Predicates>(source, treesitter::Query::Parameters {
+                                                                            {"functionName", "main"}}));
+        QVERIFY(!cursor.nextMatch().has_value());
+    }
+
+    void query_profile()
+    {
+        auto source = readTestFile("/tst_treesitter/main.cpp");
+
+        treesitter::Parser parser(tree_sitter_cpp());
+        auto tree = parser.parseString(source);
+        QVERIFY(tree.has_value());
+
+        auto query = std::make_shared<treesitter::Query>(tree_sitter_cpp(), R"EOF(
+            (function_definition
+                (function_declarator
+                    declarator: (_) @name
+                    (#eq? @name "main")))
+            (field_expression) @field
+        )EOF");
+
+        treesitter::QueryCursor cursor;
+        cursor.setProfilingEnabled(true);
+        cursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(source));
+        const auto matches = cursor.allRemainingMatches();
+
+        const auto &profile = cursor.profile();
+        QVERIFY(profile.has_value());
+        QCOMPARE(profile->patterns.size(), 2);
+        QVERIFY(profile->totalNsecs > 0);
+
+        const auto &functions = profile->patterns.at(0);
+        QVERIFY(functions.candidates > 1);
+        QCOMPARE(functions.rejections, functions.candidates - 1);
+        QCOMPARE(functions.predicates.size(), 1);
+        QCOMPARE(functions.predicates.first().name, "eq?");
+        QCOMPARE(functions.predicates.first().calls, functions.candidates);
+        QCOMPARE(functions.predicates.first().rejections, functions.rejections);
+
+        const auto &fields = profile->patterns.at(1);
+        QCOMPARE(fields.rejections, 0);
+        QVERIFY(fields.predicates.isEmpty());
+        QCOMPARE(matches.size(), 1 + fields.candidates);
+
+        // Profiling is disabled by default
+        treesitter::QueryCursor defaultCursor;
+        defaultCursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(source));
+        QVERIFY(!defaultCursor.profile().has_value());
+    }
+
+    void query_captures()
+    {
+        auto source = readTestFile("/tst_treesitter/main.cpp");
+
+        treesitter::Parser parser(tree_sitter_cpp());
+        auto tree = parser.parseString(source);
+        QVERIFY(tree.has_value());
+
+        auto query = std::make_shared<treesitter::Query>(tree_sitter_cpp(), R"EOF(
+            (function_definition
+                (function_declarator
+                    declarator: (_) @name
+                    parameters: (_) @parameters
+                    (#match? "Function" @name)))
+            (field_expression) @field
+        )EOF");
+        const auto nameId = query->captures().at(0).id;
+
+        treesitter::QueryCursor matchCursor;
+        matchCursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(source));
+        const auto matches = matchCursor.allRemainingMatches();
+        QStringList matchNames;
+        qsizetype matchCaptureCount = 0;
+        for (const auto &match : matches) {
+            matchCaptureCount += match.captures().size();
+            for (const auto &capture : match.capturesNamed("name")) {
+                matchNames.push_back(capture.node.textIn(source));
+            }
+        }
+
+        // The captures of the matches rejected by the predicates are not returned.
+        treesitter::QueryCursor cursor;
+        cursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(source));
+        const auto captures = cursor.allRemainingCaptures();
+        QCOMPARE(captures.size(), matchCaptureCount);
+        QVERIFY(std::ranges::is_sorted(captures, {}, [](const auto &capture) {
+            return capture.node.startPosition();
+        }));
+
+        cursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(source));
+        const auto names = cursor.allRemainingCaptures(nameId);
+        QCOMPARE(names.size(), 3);
+        QStringList captureNames;
+        for (const auto &capture : names) {
+            QCOMPARE(capture.id, nameId);
+            captureNames.push_back(capture.node.textIn(source));
+        }
+        QCOMPARE(captureNames, matchNames);
+    }
+
+    void reused_query_cursor()
+    {
+        auto source = readTestFile("/tst_treesitter/main.cpp");
+
+        treesitter::Parser parser(tree_sitter_cpp());
+        auto tree = parser.parseString(source);
+        QVERIFY(tree.has_value());
+
+        auto query = std::make_shared<treesitter::Query>(tree_sitter_cpp(), R"EOF(
+            (function_definition
+                (function_declarator
+                    declarator: (_) @name
+                    (#match? "Function" @name)))
+        )EOF");
+        QVERIFY(query->regularExpression("Function"));
+        QVERIFY(!query->regularExpression("Other"));
+
+        treesitter::QueryCursor referenceCursor;
+        referenceCursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(source));
+        const auto matchCount = referenceCursor.allRemainingMatches().size();
+        QVERIFY(matchCount > 1);
+
+        // Cursors stopped in the middle of a query are given back to the pool, and must be reset when reused.
+        for (int i = 0; i < 20; ++i) {
+            treesitter::QueryCursor cursor;
+            cursor.execute(query, tree->rootNode(), std::make_unique<treesitter::Predicates>(source));
+            if (i % 2 == 0) {
+                QVERIFY(cursor.nextMatch().has_value());
+            } else {
+                QCOMPARE(cursor.allRemainingMatches().size(), matchCount);
+            }
+        }
+    }
+
     void match_predicate_errors()
     {
         using Error = treesitter::Query::Error;
@@ -295,6 +621,29 @@ private slots:
 
         auto matches = cursor.allRemainingMatches();
         QCOMPARE(matches.size(), 3);
+
+        // Caches shared between queries, the message map is only searched once: each search adds its result to the
+        // caches, the second query uses the one of the first query.
+        auto caches = std::make_shared<treesitter::PredicateCaches>();
+        const treesitter::PredicateCache *messageMap = nullptr;
+        for (int i = 0; i < 2; ++i) {
+            treesitter::QueryCursor sharedCursor;
+            sharedCursor.execute(query, tree->rootNode(),
+                                 std::make_unique<treesitter::Predicates>(source, treesitter::Query::Parameters {},
+                                                                          caches));
+            QCOMPARE(sharedCursor.allRemainingMatches().size(), 3);
+            QCOMPARE(caches->size(), size_t(1));
+            if (i == 0)
+                messageMap = caches->find<treesitter::PredicateCache>();
+            QVERIFY(messageMap);
+            QCOMPARE(caches->find<treesitter::PredicateCache>(), messageMap);
+        }
+
+        // The message map is searched in the whole tree, even when the query runs on a part of it.
+        const auto firstCall = matches.first().capturesNamed("call").first().node;
+        treesitter::QueryCursor nodeCursor;
+        nodeCursor.execute(query, firstCall, std::make_unique<treesitter::Predicates>(source));
+        QCOMPARE(nodeCursor.allRemainingMatches().size(), 1);
     }
 
     void eq_except_predicate_errors()
@@ -464,6 +813,66 @@ private slots:
         auto matches = cursor.allRemainingMatches();
         QCOMPARE(matches.size(), 1); // Only one function that returns a string, and not an int.
     }
+
+    void any_of_predicate_errors()
+    {
+        using Error = treesitter::Query::Error;
+        // Too few arguments
+        VERIFY_PREDICATE_ERROR("((identifier) @ident (#any_of? @ident))");
+
+        // First argument is not a capture
+        VERIFY_PREDICATE_ERROR("((identifier) @ident (#any_of? \"main\" @ident))");
+
+        // Non-string argument
+        VERIFY_PREDICATE_ERROR("((identifier) @ident (#not_any_of? @ident \"main\" @ident))");
+    }
+
+    void any_of_predicate()
+    {
+        auto [source, tree, cursor] = runQuery(R"EOF(
+            (function_definition
+                (function_declarator
+                    declarator: (_) @name
+                    (#any_of? @name "myFreeFunction" "myOtherFreeFunction" "unknownFunction")))
+        )EOF");
+
+        QStringList names;
+        for (const auto &match : cursor.allRemainingMatches()) {
+            names.push_back(match.capturesNamed("name").first().node.textIn(source));
+        }
+        QCOMPARE(names, QStringList({"myFreeFunction", "myOtherFreeFunction"}));
+
+        auto query = std::make_shared<treesitter::Query>(tree_sitter_cpp(), R"EOF(
+            (function_definition
+                (function_declarator
+                    declarator: (_) @name
+                    (#not-any-of? @name "myFreeFunction" "myOtherFreeFunction")))
+            (function_definition
+                (function_declarator
+                    declarator: (_) @name)) @all
+        )EOF");
+
+        // The strings are collected into a single set argument.
+        const auto &arguments = query->patterns().first().predicates.first().arguments;
+        QCOMPARE(arguments.size(), 2);
+        QVERIFY(std::holds_alternative<treesitter::Query::StringSet>(arguments.at(1)));
+        QVERIFY(std::get<treesitter::Query::StringSet>(arguments.at(1)).values->size() == 2);
+
+        treesitter::QueryCursor notCursor;
+        notCursor.execute(query, tree.rootNode(), std::make_unique<treesitter::Predicates>(source));
+        int excluded = 0;
+        int all = 0;
+        for (const auto &match : notCursor.allRemainingMatches()) {
+            if (match.patternIndex() == 0) {
+                const auto name = match.capturesNamed("name").first().node.textIn(source);
+                QVERIFY(name != "myFreeFunction" && name != "myOtherFreeFunction");
+                ++excluded;
+            } else {
+                ++all;
+            }
+        }
+        QCOMPARE(excluded, all - 2);
+    }
 };
 
 QTEST_MAIN(TestTreeSitter)
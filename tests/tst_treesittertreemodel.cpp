@@ -0,0 +1,119 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "gui/treesittertreemodel.h"
+#include "treesitter/languages.h"
+#include "treesitter/parser.h"
+#include "treesitter/predicates.h"
+#include "treesitter/tree.h"
+
+#include <QAbstractItemModelTester>
+#include <QPersistentModelIndex>
+#include <QTest>
+
+namespace {
+// Creates the rows of all the nodes, like expanding all the items of a view, and returns their indexes.
+QList<QPersistentModelIndex> allIndexes(const QAbstractItemModel &model, const QModelIndex &parent = {})
+{
+    QList<QPersistentModelIndex> indexes;
+    for (int row = 0; row < model.rowCount(parent); ++row) {
+        const auto index = model.index(row, 0, parent);
+        indexes.push_back(index);
+        indexes.append(allIndexes(model, index));
+    }
+    return indexes;
+}
+
+// Node and range columns of all the rows, indented by depth.
+QStringList dump(const QAbstractItemModel &model, const QModelIndex &parent = {}, int depth = 0)
+{
+    QStringList lines;
+    for (int row = 0; row < model.rowCount(parent); ++row) {
+        const auto index = model.index(row, 0, parent);
+        lines.push_back(QString(depth * 2, ' ') + index.data().toString() + ' '
+                        + index.siblingAtColumn(1).data().toString());
+        lines.append(dump(model, index, depth + 1));
+    }
+    return lines;
+}
+}
+
+class TestTreeSitterTreeModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void updateTree()
+    {
+        const QString oldText = "int a = 1;\n\nvoid f()\n{\n    return;\n}\n\nint b = 2;\n";
+        const QString newText = "int a = 1;\n\nvoid f()\n{\n    g(1);\n    return;\n}\n\nint b = 2;\n";
+
+        treesitter::Parser parser(tree_sitter_cpp());
+        auto oldTree = parser.parseString(oldText);
+        QVERIFY(oldTree.has_value());
+        auto editedTree = oldTree->copy();
+
+        Gui::TreeSitterTreeModel model;
+        QAbstractItemModelTester tester(&model, QAbstractItemModelTester::FailureReportingMode::QtTest);
+        model.setTree(std::move(oldTree.value()), std::make_unique<treesitter::Predicates>(oldText), false);
+        allIndexes(model);
+
+        // translation_unit: declaration, function_definition, declaration
+        const QPersistentModelIndex root = model.index(0, 0);
+        QCOMPARE(model.rowCount(root), 3);
+        const QPersistentModelIndex function = model.index(1, 0, root);
+        const QPersistentModelIndex body = model.index(2, 0, function);
+        QCOMPARE(body.data().toString(), "body: compound_statement");
+        const QPersistentModelIndex returnStatement = model.index(0, 0, body);
+        QCOMPARE(returnStatement.data().toString(), "return_statement");
+
+        // The rows outside of the edit, with the text of their node.
+        QList<std::pair<QPersistentModelIndex, QString>> unchangedRows;
+        for (const int row : {0, 2}) {
+            const QPersistentModelIndex declaration = model.index(row, 0, root);
+            unchangedRows.emplace_back(declaration, declaration.data().toString());
+            for (const auto &index : allIndexes(model, declaration))
+                unchangedRows.emplace_back(index, index.data().toString());
+        }
+
+        const auto edit = treesitter::inputEdit(oldText, newText);
+        QVERIFY(edit.has_value());
+        editedTree.edit(edit.value());
+        auto newTree = parser.parseString(newText, &editedTree);
+        QVERIFY(newTree.has_value());
+        const auto changedRanges = editedTree.changedRanges(newTree.value());
+        model.updateTree(std::move(newTree.value()), edit.value(), changedRanges,
+                         std::make_unique<treesitter::Predicates>(newText));
+
+        // The rows of the nodes that didn't change are kept, even if their position moved.
+        for (const auto &[index, text] : std::as_const(unchangedRows)) {
+            QVERIFY(index.isValid());
+            QCOMPARE(index.data().toString(), text);
+        }
+        QCOMPARE(root.row(), 0);
+        QCOMPARE(function.row(), 1);
+        QVERIFY(body.isValid());
+        // The new statement is inserted before the existing one.
+        QVERIFY(returnStatement.isValid());
+        QCOMPARE(returnStatement.row(), 1);
+        QCOMPARE(returnStatement.data().toString(), "return_statement");
+        QCOMPARE(model.index(0, 0, body).data().toString(), "expression_statement");
+
+        // Same rows as a model built from scratch.
+        auto freshTree = parser.parseString(newText);
+        QVERIFY(freshTree.has_value());
+        Gui::TreeSitterTreeModel freshModel;
+        freshModel.setTree(std::move(freshTree.value()), std::make_unique<treesitter::Predicates>(newText), false);
+        QCOMPARE(dump(model), dump(freshModel));
+    }
+};
+
+QTEST_MAIN(TestTreeSitterTreeModel)
+#include "tst_treesittertreemodel.moc"
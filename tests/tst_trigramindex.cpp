@@ -0,0 +1,131 @@
+/*
+  This file is part of Knut.
+
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: GPL-3.0-only
+
+  Contact KDAB at <info@kdab.com> for commercial licensing options.
+*/
+
+#include "common/test_utils.h"
+#include "core/findinfiles.h"
+#include "core/trigramindex.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThreadPool>
+
+class TestTrigramIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void trigrams()
+    {
+        const std::vector<quint32> expected = {0x616263, 0x626361, 0x636162};
+        QCOMPARE(Core::TrigramIndex::trigrams("abcabca"), expected);
+        QVERIFY(Core::TrigramIndex::trigrams("ab").empty());
+    }
+
+    void candidates()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const auto root = dir.path() + "/project";
+        const auto indexFile = dir.path() + "/index/trigrams.idx";
+
+        QVERIFY(Test::createFile(root, "a.cpp", "void foo();\n"));
+        QVERIFY(Test::createFile(root, "b.cpp", "void bar();\n"));
+        QVERIFY(Test::createFile(root, "c.cpp", "int foobar = 0;\n"));
+        QVERIFY(Test::createFile(root, "d.bin", QByteArray("foo\0bar", 7)));
+        const QStringList files = {"a.cpp", "b.cpp", "c.cpp", "d.bin"};
+
+        {
+            Core::TrigramIndex index(root, indexFile);
+            QCOMPARE(index.candidates(files, "foo"), (QStringList {"a.cpp", "c.cpp"}));
+            QCOMPARE(index.candidates(files, "foobar"), QStringList {"c.cpp"});
+            QCOMPARE(index.candidates(files, "baz"), QStringList {});
+            // Too short to use the index, all text files are candidates.
+            QCOMPARE(index.candidates(files, "fo"), (QStringList {"a.cpp", "b.cpp", "c.cpp"}));
+        }
+        QVERIFY(QFileInfo::exists(indexFile));
+
+        // The index is loaded from the file, and updated for the files changed.
+        QVERIFY(Test::createFile(root, "b.cpp", "void foo(int bar);\n"));
+        QVERIFY(QFile::remove(root + "/c.cpp"));
+        QVERIFY(Test::createFile(root, "e.cpp", "// foobar\n"));
+        const QStringList newFiles = {"a.cpp", "b.cpp", "d.bin", "e.cpp"};
+        Core::TrigramIndex index(root, indexFile);
+        QCOMPARE(index.candidates(newFiles, "foo"), (QStringList {"a.cpp", "b.cpp", "e.cpp"}));
+        QCOMPARE(index.candidates(newFiles, "foobar"), QStringList {"e.cpp"});
+        QVERIFY(index.save());
+
+        Core::TrigramIndex savedIndex(root, indexFile);
+        QCOMPARE(savedIndex.candidates(newFiles, "bar"), (QStringList {"b.cpp", "e.cpp"}));
+    }
+
+    void invalidate()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const auto root = dir.path() + "/project";
+        const auto indexFile = dir.path() + "/index/trigrams.idx";
+        QVERIFY(Test::createFile(root, "a.cpp", "void foo();\n"));
+        QVERIFY(Test::createFile(root, "sub/b.cpp", "void foo();\n"));
+        const QStringList files = {"a.cpp", "sub/b.cpp"};
+
+        Core::TrigramIndex index(root, indexFile);
+        QCOMPARE(index.candidates(files, "foo"), files);
+        // Saved after the update, not only when the index is destroyed.
+        QVERIFY(QFileInfo::exists(indexFile));
+
+        // Only the files of the directories invalidated are checked again.
+        // Different sizes, the modification time may not change that fast.
+        QVERIFY(Test::createFile(root, "a.cpp", "void bar(int);\n"));
+        QVERIFY(Test::createFile(root, "sub/b.cpp", "void bar(int);\n"));
+        QCOMPARE(index.candidates(files, "bar"), QStringList {});
+        index.invalidate({"sub"});
+        QCOMPARE(index.candidates(files, "bar"), QStringList {"sub/b.cpp"});
+        index.invalidate({""});
+        QCOMPARE(index.candidates(files, "bar"), files);
+
+        QVERIFY(Test::createFile(root, "a.cpp", "int foo;\n"));
+        index.invalidateAll();
+        QCOMPARE(index.candidates(files, "foo"), QStringList {"a.cpp"});
+    }
+
+    void backgroundSearch()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const auto root = dir.path();
+        for (int i = 0; i < 20; ++i)
+            QVERIFY(Test::createFile(root, QString("file%1.cpp").arg(i), i % 2 ? "void foo();\n" : "void bar();\n"));
+        QVERIFY(Test::createFile(root, "sub/file.cpp", "int foo = 0;\n"));
+        QStringList files = {"sub/file.cpp"};
+        for (int i = 0; i < 20; ++i)
+            files.push_back(QString("file%1.cpp").arg(i));
+
+        // The index is updated on a thread of the global pool, even when it's the only one.
+        auto *pool = QThreadPool::globalInstance();
+        const auto maxThreadCount = pool->maxThreadCount();
+        pool->setMaxThreadCount(1);
+        Core::TrigramIndex index(root, dir.path() + "/trigrams.idx");
+        Core::FindInFiles findInFiles("foo");
+        auto future = findInFiles.start([&index, &files, &root]() {
+            auto candidates = index.candidates(files, "foo");
+            for (auto &path : candidates)
+                path = root + '/' + path;
+            return candidates;
+        });
+        future.waitForFinished();
+        pool->setMaxThreadCount(maxThreadCount);
+        QCOMPARE(future.resultCount(), 11);
+    }
+};
+
+QTEST_MAIN(TestTrigramIndex)
+#include "tst_trigramindex.moc"